@@ -0,0 +1,324 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * Recovery benchmark.
+ * `generate` writes logs through the logger of LineairDB: every key is
+ * inserted once and then random keys are overwritten so that the given ratio
+ * of the logged writes are overwrites. `recover` measures the instantiation of
+ * LineairDB with recovery enabled on these logs. `all` (default) runs both in
+ * a single process; run `generate` and `recover` separately to measure the
+ * peak memory of recovery alone.
+ */
+
+#include <lineairdb/config.h>
+#include <lineairdb/database.h>
+#include <lineairdb/transaction.h>
+#include <lineairdb/tx_status.h>
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cxxopts.hpp>
+#include <experimental/filesystem>
+#include <fstream>
+#include <iostream>
+#include <magic_enum.hpp>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "types.h"
+
+namespace fs = std::experimental::filesystem;
+
+struct LogSpec {
+  size_t keys;
+  double overwrite_ratio;
+  size_t payload_size;
+  size_t writes_per_transaction;
+  size_t clients;
+  uint64_t seed;
+
+  size_t Writes() const {
+    return keys + static_cast<size_t>(keys * overwrite_ratio /
+                                      (1.0 - overwrite_ratio));
+  }
+};
+
+uint64_t LogBytes() {
+  uint64_t bytes = 0;
+  for (auto& file : fs::directory_iterator("lineairdb_logs")) {
+    if (fs::is_regular_file(file.path())) bytes += fs::file_size(file.path());
+  }
+  return bytes;
+}
+
+uint64_t PeakMemoryKB() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+double Seconds(std::chrono::steady_clock::duration elapsed) {
+  return std::chrono::duration<double>(elapsed).count();
+}
+
+void Generate(const LineairDB::Config& config, const LogSpec& spec,
+              rapidjson::Document& result_json) {
+  auto& allocator = result_json.GetAllocator();
+  fs::remove_all("lineairdb_logs");
+
+  LineairDB::Config generation_config = config;
+  generation_config.enable_recovery   = false;
+  generation_config.enable_logging    = true;
+  LineairDB::Database db(generation_config);
+
+  const size_t writes       = spec.Writes();
+  const size_t transactions = (writes + spec.writes_per_transaction - 1) /
+                              spec.writes_per_transaction;
+  static const std::byte payload[LineairDB::ValueBufferSize] = {};
+  std::atomic<size_t> commits(0);
+  std::atomic<size_t> aborts(0);
+
+  auto begin = std::chrono::steady_clock::now();
+  std::vector<std::thread> clients;
+  for (size_t c = 0; c < spec.clients; c++) {
+    clients.emplace_back([&, c]() {
+      std::mt19937_64 random(spec.seed + c);
+      for (size_t t = c; t < transactions; t += spec.clients) {
+        std::vector<std::string> keys;
+        for (size_t i = t * spec.writes_per_transaction;
+             i < std::min(writes, (t + 1) * spec.writes_per_transaction);
+             i++) {
+          // the first `keys` writes insert each key exactly once.
+          const size_t key = i < spec.keys ? i : random() % spec.keys;
+          keys.emplace_back(std::to_string(key));
+        }
+        db.ExecuteTransaction(
+            [&, keys](LineairDB::Transaction& tx) {
+              for (auto& key : keys) {
+                tx.Write(key, payload, spec.payload_size);
+              }
+            },
+            [&](LineairDB::TxStatus status) {
+              if (status == LineairDB::TxStatus::Committed) {
+                commits++;
+              } else {
+                aborts++;
+              }
+            });
+      }
+    });
+  }
+  for (auto& client : clients) { client.join(); }
+  db.Fence();
+  while (commits.load() + aborts.load() < transactions) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  const double seconds = Seconds(end - begin);
+  const uint64_t bytes = LogBytes();
+  std::cout << "Generated " << bytes << " bytes of logs (" << writes
+            << " writes, " << aborts.load() << " aborted transactions) in "
+            << seconds << " seconds" << std::endl;
+
+  result_json.AddMember("generated_writes", static_cast<uint64_t>(writes),
+                        allocator);
+  result_json.AddMember("generation_aborts",
+                        static_cast<uint64_t>(aborts.load()), allocator);
+  result_json.AddMember("log_bytes", bytes, allocator);
+  result_json.AddMember("logging_seconds", seconds, allocator);
+  result_json.AddMember("logging_mb_per_sec", bytes / seconds / 1e6,
+                        allocator);
+  result_json.AddMember("logging_writes_per_sec", writes / seconds,
+                        allocator);
+}
+
+void Recover(const LineairDB::Config& config, const LogSpec& spec,
+             rapidjson::Document& result_json) {
+  auto& allocator = result_json.GetAllocator();
+  if (!fs::exists("lineairdb_logs")) {
+    std::cerr << "No logs to recover; run `generate` first." << std::endl;
+    exit(1);
+  }
+  const uint64_t bytes           = LogBytes();
+  const uint64_t memory_before   = PeakMemoryKB();
+  const size_t logged_writes     = spec.Writes();
+  LineairDB::Config recovery_cfg = config;
+  recovery_cfg.enable_recovery   = true;
+  // NOTE: logging is disabled not to overwrite the logs being measured.
+  recovery_cfg.enable_logging = false;
+
+  auto begin = std::chrono::steady_clock::now();
+  auto db    = std::make_unique<LineairDB::Database>(recovery_cfg);
+  auto end   = std::chrono::steady_clock::now();
+  const uint64_t memory_after = PeakMemoryKB();
+
+  std::atomic<size_t> recovered_keys(0);
+  db->ParallelScan(
+      [&](const std::string_view,
+          const std::pair<const std::byte* const, const size_t>) {
+        recovered_keys++;
+      },
+      recovery_cfg.max_thread);
+  db.reset(nullptr);
+
+  const double seconds = Seconds(end - begin);
+  std::cout << "Recovered " << recovered_keys.load() << " keys from " << bytes
+            << " bytes of logs in " << seconds << " seconds" << std::endl;
+  if (recovered_keys.load() != spec.keys) {
+    std::cerr << "Expected " << spec.keys << " keys but recovered "
+              << recovered_keys.load() << std::endl;
+  }
+
+  result_json.AddMember("recovered_keys",
+                        static_cast<uint64_t>(recovered_keys.load()),
+                        allocator);
+  result_json.AddMember("recovery_seconds", seconds, allocator);
+  result_json.AddMember("recovery_mb_per_sec", bytes / seconds / 1e6,
+                        allocator);
+  result_json.AddMember("recovery_records_per_sec", logged_writes / seconds,
+                        allocator);
+  result_json.AddMember("peak_memory_kb_before_recovery", memory_before,
+                        allocator);
+  result_json.AddMember("peak_memory_kb", memory_after, allocator);
+}
+
+int main(int argc, char** argv) {
+  cxxopts::Options options(
+      "recovery", "Recovery: measures logging and recovery of LineairDB");
+
+  options.add_options()          //
+      ("h,help", "Print usage")  //
+      ("m,mode", "all, generate or recover",
+       cxxopts::value<std::string>()->default_value("all"))  //
+      ("k,keys", "The number of distinct keys in the logs",
+       cxxopts::value<size_t>()->default_value("100000"))  //
+      ("w,overwrite", "Ratio of overwrites in the logged writes, in [0, 1)",
+       cxxopts::value<double>()->default_value("0.5"))  //
+      ("p,payload", "Size (bytes) of each record",
+       cxxopts::value<size_t>()->default_value("8"))  //
+      ("s,ws", "The number of writes in each transaction",
+       cxxopts::value<size_t>()->default_value("4"))  //
+      ("q,clients", "The number of threads generating the logs",
+       cxxopts::value<size_t>()->default_value("1"))  //
+      ("S,seed", "Seed of the overwritten keys",
+       cxxopts::value<uint64_t>()->default_value("1"))  //
+      ("c,cc", "Concurrency control protocol",
+       cxxopts::value<std::string>()->default_value("Silo"))  //
+      ("e,epoch", "Size of epoch duration",
+       cxxopts::value<size_t>()->default_value("40"))  //
+      ("f,flush", "Log buffer size (bytes) of each thread to start writing",
+       cxxopts::value<size_t>()->default_value("0"))  //
+      ("P,partitions", "The number of key partitions of the logs",
+       cxxopts::value<size_t>()->default_value("0"))  //
+      ("t,thread", "The number of threads working on LineairDB",
+       cxxopts::value<size_t>()->default_value(
+           std::to_string(std::thread::hardware_concurrency())))  //
+      ("o,output", "Output JSON filename",
+       cxxopts::value<std::string>()->default_value("recovery_result.json"))  //
+      ;
+
+  auto result = options.parse(argc, argv);
+  if (result.count("help")) {
+    std::cout << options.help() << std::endl;
+    exit(0);
+  }
+
+  LogSpec spec;
+  spec.keys                   = result["keys"].as<size_t>();
+  spec.overwrite_ratio        = result["overwrite"].as<double>();
+  spec.payload_size           = result["payload"].as<size_t>();
+  spec.writes_per_transaction = result["ws"].as<size_t>();
+  spec.clients                = result["clients"].as<size_t>();
+  spec.seed                   = result["seed"].as<uint64_t>();
+  if (spec.keys == 0 || spec.writes_per_transaction == 0 || spec.clients == 0) {
+    std::cerr << "keys, ws and clients must be positive" << std::endl;
+    exit(1);
+  }
+  if (spec.overwrite_ratio < 0 || 1 <= spec.overwrite_ratio) {
+    std::cerr << "overwrite ratio must be in [0, 1)" << std::endl;
+    exit(1);
+  }
+  if (LineairDB::ValueBufferSize < spec.payload_size) {
+    std::cerr << "payload must not exceed " << LineairDB::ValueBufferSize
+              << " bytes" << std::endl;
+    exit(1);
+  }
+
+  // NOTE: writes of SiloNWR may be omitted and not logged; Silo logs every
+  // committed write.
+  LineairDB::Config config;
+  auto protocol = result["cc"].as<std::string>();
+  config.concurrency_control_protocol =
+      magic_enum::enum_cast<LineairDB::Config::ConcurrencyControl>(protocol)
+          .value();
+  config.max_thread          = result["thread"].as<size_t>();
+  config.epoch_duration_ms   = result["epoch"].as<size_t>();
+  config.log_flush_threshold = result["flush"].as<size_t>();
+  config.log_partitions      = result["partitions"].as<size_t>();
+
+  rapidjson::Document result_json(rapidjson::kObjectType);
+  auto& allocator = result_json.GetAllocator();
+  const auto mode = result["mode"].as<std::string>();
+  if (mode != "all" && mode != "generate" && mode != "recover") {
+    std::cerr << "Unknown mode " << mode << std::endl;
+    exit(1);
+  }
+  if (mode != "recover") { Generate(config, spec, result_json); }
+  if (mode != "generate") { Recover(config, spec, result_json); }
+
+  result_json.AddMember("mode", rapidjson::Value(mode.c_str(), allocator),
+                        allocator);
+  result_json.AddMember("keys", static_cast<uint64_t>(spec.keys), allocator);
+  result_json.AddMember("overwrite", spec.overwrite_ratio, allocator);
+  result_json.AddMember("payload", static_cast<uint64_t>(spec.payload_size),
+                        allocator);
+  result_json.AddMember(
+      "protocol", rapidjson::Value(protocol.c_str(), allocator), allocator);
+  result_json.AddMember("threads", static_cast<uint64_t>(config.max_thread),
+                        allocator);
+  result_json.AddMember("log_flush_threshold",
+                        static_cast<uint64_t>(config.log_flush_threshold),
+                        allocator);
+  result_json.AddMember("log_partitions",
+                        static_cast<uint64_t>(config.log_partitions),
+                        allocator);
+
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  result_json.Accept(writer);
+  writer.Flush();
+
+  auto output_filename = result["output"].as<std::string>();
+  std::ofstream output_f(output_filename,
+                         std::ofstream::out | std::ofstream::trunc);
+  output_f << buffer.GetString();
+  if (!output_f.good()) {
+    std::cerr << "Unable to write output file" << output_filename << std::endl;
+    exit(1);
+  }
+  std::cout << "This benchmark result is saved into " << output_filename
+            << std::endl;
+  return 0;
+}
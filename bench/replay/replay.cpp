@@ -0,0 +1,241 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * Trace replay benchmark.
+ * Replays the workload traces recorded by LineairDB (see
+ * LineairDB::Config::enable_trace_recording) against any configuration.
+ * Transactions are submitted at the recorded arrival times divided by the
+ * given rate; `--rate 0` submits them as fast as possible.
+ * Values are not recorded; each write stores as many zero bytes as recorded.
+ */
+
+#include <lineairdb/config.h>
+#include <lineairdb/database.h>
+#include <lineairdb/transaction.h>
+#include <lineairdb/tx_status.h>
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cxxopts.hpp>
+#include <experimental/filesystem>
+#include <fstream>
+#include <iostream>
+#include <magic_enum.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "trace/trace_format.h"
+#include "types.h"
+
+struct RecordedTransaction {
+  uint64_t submitted_ns;
+  bool committed;
+  std::vector<LineairDB::Trace::Event> operations;
+};
+
+std::vector<RecordedTransaction> LoadTraces(const std::string& directory) {
+  using LineairDB::Trace::EventType;
+  std::vector<RecordedTransaction> transactions;
+  for (auto& file :
+       std::experimental::filesystem::directory_iterator(directory)) {
+    std::ifstream in(file.path(), std::ifstream::binary);
+    if (!LineairDB::Trace::ReadHeader(in)) {
+      std::cerr << "Skip a non-trace file " << file.path() << std::endl;
+      continue;
+    }
+    RecordedTransaction current;
+    bool in_transaction = false;
+    LineairDB::Trace::Event event;
+    while (LineairDB::Trace::ReadEvent(in, event)) {
+      switch (event.type) {
+        case EventType::Begin:
+          current        = {event.timestamp_ns, false, {}};
+          in_transaction = true;
+          break;
+        case EventType::Read:
+        case EventType::Write:
+          if (in_transaction) current.operations.push_back(event);
+          break;
+        case EventType::Commit:
+        case EventType::Abort:
+          if (!in_transaction) break;
+          current.committed = event.type == EventType::Commit;
+          transactions.emplace_back(std::move(current));
+          in_transaction = false;
+          break;
+      }
+    }
+  }
+  std::sort(transactions.begin(), transactions.end(),
+            [](const auto& lhs, const auto& rhs) {
+              return lhs.submitted_ns < rhs.submitted_ns;
+            });
+  return transactions;
+}
+
+int main(int argc, char** argv) {
+  cxxopts::Options options(
+      "replay", "Replay: replays recorded workload traces against LineairDB");
+
+  options.add_options()          //
+      ("h,help", "Print usage")  //
+      ("T,trace", "Directory of the trace files",
+       cxxopts::value<std::string>()->default_value(
+           LineairDB::Trace::TraceDirectory))  //
+      ("r,rate",
+       "Scale of the recorded arrival rate (2.0 submits twice as fast; 0 "
+       "submits as fast as possible)",
+       cxxopts::value<double>()->default_value("1.0"))  //
+      ("c,cc", "Concurrency control protocol",
+       cxxopts::value<std::string>()->default_value("SiloNWR"))  //
+      ("i,index", "Concurrent point index",
+       cxxopts::value<std::string>()->default_value("MPMCConcurrentHashSet"))  //
+      ("l,log", "Enable logging",
+       cxxopts::value<bool>()->default_value("false"))  //
+      ("e,epoch", "Size of epoch duration",
+       cxxopts::value<size_t>()->default_value("40"))  //
+      ("t,thread", "The number of threads working on LineairDB",
+       cxxopts::value<size_t>()->default_value(
+           std::to_string(std::thread::hardware_concurrency())))  //
+      ("o,output", "Output JSON filename",
+       cxxopts::value<std::string>()->default_value("replay_result.json"))  //
+      ;
+
+  auto result = options.parse(argc, argv);
+  if (result.count("help")) {
+    std::cout << options.help() << std::endl;
+    exit(0);
+  }
+
+  const auto trace_directory = result["trace"].as<std::string>();
+  const double rate          = result["rate"].as<double>();
+  auto transactions          = LoadTraces(trace_directory);
+  if (transactions.empty()) {
+    std::cerr << "No transaction is found in " << trace_directory << std::endl;
+    exit(1);
+  }
+  size_t recorded_commits = 0;
+  for (auto& transaction : transactions) {
+    if (transaction.committed) recorded_commits++;
+  }
+
+  std::experimental::filesystem::remove_all("lineairdb_logs");
+
+  /** Initialize LineairDB **/
+  LineairDB::Config config;
+  auto protocol = result["cc"].as<std::string>();
+  config.concurrency_control_protocol =
+      magic_enum::enum_cast<LineairDB::Config::ConcurrencyControl>(protocol)
+          .value();
+  auto index = result["index"].as<std::string>();
+  config.concurrent_point_index =
+      magic_enum::enum_cast<LineairDB::Config::ConcurrentPointIndex>(index)
+          .value();
+  config.enable_recovery   = false;
+  config.enable_logging    = result["log"].as<bool>();
+  config.max_thread        = result["thread"].as<size_t>();
+  config.epoch_duration_ms = result["epoch"].as<size_t>();
+  LineairDB::Database db(config);
+
+  /** Replay **/
+  static const std::byte payload[LineairDB::ValueBufferSize] = {};
+  std::atomic<size_t> commits(0);
+  std::atomic<size_t> aborts(0);
+  const uint64_t first_ns = transactions.front().submitted_ns;
+
+  auto begin = std::chrono::steady_clock::now();
+  for (auto& transaction : transactions) {
+    if (0 < rate) {
+      const auto offset = std::chrono::nanoseconds(static_cast<uint64_t>(
+          (transaction.submitted_ns - first_ns) / rate));
+      std::this_thread::sleep_until(begin + offset);
+    }
+    db.ExecuteTransaction(
+        [&](LineairDB::Transaction& tx) {
+          for (auto& operation : transaction.operations) {
+            if (operation.type == LineairDB::Trace::EventType::Read) {
+              tx.Read(operation.key);
+            } else {
+              tx.Write(operation.key, payload, operation.size);
+            }
+          }
+        },
+        [&](LineairDB::TxStatus status) {
+          if (status == LineairDB::TxStatus::Committed) {
+            commits++;
+          } else {
+            aborts++;
+          }
+        });
+  }
+  db.Fence();
+  while (commits.load() + aborts.load() < transactions.size()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  const uint64_t milliseconds =
+      std::chrono::duration_cast<std::chrono::milliseconds>(end - begin)
+          .count();
+  const uint64_t tps =
+      commits.load() * 1000 / std::max<uint64_t>(1, milliseconds);
+  std::cout << "Replayed " << transactions.size()
+            << " transactions. commits: " << commits.load()
+            << ", aborts: " << aborts.load() << ", tps: " << tps << std::endl;
+
+  rapidjson::Document result_json(rapidjson::kObjectType);
+  auto& allocator = result_json.GetAllocator();
+  result_json.AddMember("transactions",
+                        static_cast<uint64_t>(transactions.size()), allocator);
+  result_json.AddMember("recorded_commits",
+                        static_cast<uint64_t>(recorded_commits), allocator);
+  result_json.AddMember("commits", static_cast<uint64_t>(commits.load()),
+                        allocator);
+  result_json.AddMember("aborts", static_cast<uint64_t>(aborts.load()),
+                        allocator);
+  result_json.AddMember("milliseconds", milliseconds, allocator);
+  result_json.AddMember("tps", tps, allocator);
+  result_json.AddMember("rate", rate, allocator);
+  result_json.AddMember(
+      "protocol", rapidjson::Value(protocol.c_str(), allocator), allocator);
+  result_json.AddMember("index", rapidjson::Value(index.c_str(), allocator),
+                        allocator);
+  result_json.AddMember("threads", static_cast<uint64_t>(config.max_thread),
+                        allocator);
+
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  result_json.Accept(writer);
+  writer.Flush();
+
+  auto output_filename = result["output"].as<std::string>();
+  std::ofstream output_f(output_filename,
+                         std::ofstream::out | std::ofstream::trunc);
+  output_f << buffer.GetString();
+  if (!output_f.good()) {
+    std::cerr << "Unable to write output file" << output_filename << std::endl;
+    exit(1);
+  }
+  std::cout << "This benchmark result is saved into " << output_filename
+            << std::endl;
+  return 0;
+}
@@ -42,6 +42,7 @@
 #include <lineairdb/tx_status.h>
 #include <rapidjson/document.h>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <random>
@@ -51,6 +52,8 @@
 #include <vector>
 
 #include "interface.h"
+#include "latency_histogram.h"
+#include "perf_counter.h"
 #include "random_generator.hpp"
 #include "spdlog/spdlog.h"
 #include "util/thread_key_storage.h"
@@ -94,11 +97,13 @@ void PopulateDatabase(LineairDB::Database& db, Workload& workload,
 struct ThreadLocalResult {
   size_t commits = 0;
   size_t aborts  = 0;
+  LatencyHistogram latency;  // of committed transactions, in microseconds
 };
 ThreadKeyStorage<ThreadLocalResult> thread_local_result;
 
 void ExecuteWorkload(LineairDB::Database& db, Workload& workload,
-                     RandomGenerator* rand, void* payload) {
+                     RandomGenerator* rand, void* payload,
+                     std::atomic<size_t>* inflight) {
   std::function<void(LineairDB::Transaction&, std::string, void*, size_t)>
       operation;
 
@@ -116,7 +121,9 @@ void ExecuteWorkload(LineairDB::Database& db, Workload& workload,
       SPDLOG_ERROR("Scan operator is not implemented");
       exit(1);
     } else if (what_i_do < (proportion += workload.rmw_proportion)) {
-      operation = YCSB::Interface::ReadModifyWrite;
+      operation = workload.deferred_updates
+                      ? YCSB::Interface::DeferredReadModifyWrite
+                      : YCSB::Interface::ReadModifyWrite;
     } else {
       SPDLOG_ERROR("No operation has found");
       exit(1);
@@ -137,41 +144,58 @@ void ExecuteWorkload(LineairDB::Database& db, Workload& workload,
     }
   }
 
+  if (0 < workload.max_inflight_transactions) {
+    while (workload.max_inflight_transactions <= inflight->load()) {
+      std::this_thread::yield();
+    }
+  }
+  inflight->fetch_add(1);
+
   // do operations while transaction will commit.
+  const auto submitted_at = std::chrono::steady_clock::now();
   db.ExecuteTransaction(
       [operation, keys, payload, workload](LineairDB::Transaction& tx) {
         for (auto& key : keys) {
           operation(tx, key, payload, workload.payload_size);
         }
       },
-      [&](LineairDB::TxStatus status) {
+      [submitted_at, inflight](LineairDB::TxStatus status) {
         auto* result = thread_local_result.Get();
 
         if (status == LineairDB::TxStatus::Committed) {
           result->commits++;
+          result->latency.Add(
+              std::chrono::duration_cast<std::chrono::microseconds>(
+                  std::chrono::steady_clock::now() - submitted_at)
+                  .count());
         } else {
           result->aborts++;
         }
+        inflight->fetch_sub(1);
       });
 }
 
-rapidjson::Document RunBenchmark(LineairDB::Database& db, Workload& workload) {
+rapidjson::Document RunBenchmark(LineairDB::Database& db, Workload& workload,
+                                 std::vector<PerfCounter*>& counters) {
   std::vector<std::thread> clients;
   ThreadKeyStorage<RandomGenerator> thread_local_random;
 
   std::atomic<bool> finish_flag{false};
   std::atomic<bool> start_flag(false);
   std::atomic<size_t> waits_count(0);
+  // NOTE: callbacks may run after the clients have finished.
+  std::vector<std::atomic<size_t>> inflight(workload.client_thread_size);
   for (size_t i = 0; i < workload.client_thread_size; ++i) {
     clients.emplace_back(std::thread([&, i]() {
       std::byte buffer[workload.payload_size];
       RandomGenerator* rand = thread_local_random.Get();
-      rand->Init(workload.recordcount, workload.zipfian_theta);
+      rand->Init(workload.recordcount, workload.zipfian_theta,
+                 workload.seed == 0 ? 0 : workload.seed + i);
 
       waits_count.fetch_add(1);
 
       while (finish_flag.load() == false) {
-        ExecuteWorkload(db, workload, rand, buffer);
+        ExecuteWorkload(db, workload, rand, buffer, &inflight[i]);
       }
     }));
   }
@@ -180,12 +204,14 @@ rapidjson::Document RunBenchmark(LineairDB::Database& db, Workload& workload) {
   while (waits_count.load() != clients.size()) { std::this_thread::yield(); }
 
   SPDLOG_INFO("YCSB: Benchmark start.");
+  for (auto* counter : counters) { counter->Start(); }
   auto begin = std::chrono::high_resolution_clock::now();
   start_flag.store(true);
   std::this_thread::sleep_for(
       std::chrono::milliseconds(workload.measurement_duration));
   finish_flag.store(true);
   auto end = std::chrono::high_resolution_clock::now();
+  for (auto* counter : counters) { counter->Stop(); }
   for (auto& worker : clients) { worker.join(); }
   SPDLOG_INFO("YCSB: Benchmark end.");
 
@@ -194,9 +220,11 @@ rapidjson::Document RunBenchmark(LineairDB::Database& db, Workload& workload) {
 
   uint64_t total_commits = 0;
   uint64_t total_aborts  = 0;
+  LatencyHistogram latency;
   thread_local_result.ForEach([&](const ThreadLocalResult* res) {
     total_commits += res->commits;
     total_aborts += res->aborts;
+    latency.Merge(res->latency);
   });
 
   auto elapsed = end - begin;
@@ -213,6 +241,15 @@ rapidjson::Document RunBenchmark(LineairDB::Database& db, Workload& workload) {
   result_json.AddMember("commits", total_commits, allocator);
   result_json.AddMember("aborts", total_aborts, allocator);
   result_json.AddMember("tps", tps, allocator);
+  const double abort_rate =
+      total_aborts / static_cast<double>(
+                         std::max<uint64_t>(1, total_commits + total_aborts));
+  result_json.AddMember("abort_rate", abort_rate, allocator);
+  result_json.AddMember("latency_p50_us", latency.Percentile(50), allocator);
+  result_json.AddMember("latency_p90_us", latency.Percentile(90), allocator);
+  result_json.AddMember("latency_p99_us", latency.Percentile(99), allocator);
+  result_json.AddMember("latency_p999_us", latency.Percentile(99.9),
+                        allocator);
 
   return result_json;
 }
@@ -29,13 +29,16 @@
 #include <magic_enum.hpp>
 #include <set>
 #include <thread>
+#include <vector>
 
+#include "perf_counter.h"
 #include "workload.h"
 
 namespace YCSB {
 
 void PopulateDatabase(LineairDB::Database&, YCSB::Workload&, size_t);
-rapidjson::Document RunBenchmark(LineairDB::Database&, YCSB::Workload&);
+rapidjson::Document RunBenchmark(LineairDB::Database&, YCSB::Workload&,
+                                 std::vector<YCSB::PerfCounter*>&);
 
 }  // namespace YCSB
 
@@ -54,12 +57,26 @@ int main(int argc, char** argv) {
        cxxopts::value<std::string>()->default_value("a"))  //
       ("c,cc", "Concurrency control protocol",
        cxxopts::value<std::string>()->default_value("SiloNWR"))  //
+      ("i,index", "Concurrent point index",
+       cxxopts::value<std::string>()->default_value("MPMCConcurrentHashSet"))  //
+      ("m,hugepages", "Place the index and records on huge pages",
+       cxxopts::value<bool>()->default_value("false"))  //
+      ("a,arenas", "Allocate from per-worker jemalloc arenas",
+       cxxopts::value<bool>()->default_value("false"))  //
+      ("n,nowait", "Read locked records without waiting for writers",
+       cxxopts::value<bool>()->default_value("false"))  //
+      ("f,combining",
+       "Defer the updates of RMW and combine them on hot records",
+       cxxopts::value<bool>()->default_value("false"))  //
       ("l,log", "Enable logging",
        cxxopts::value<bool>()->default_value("false"))  //
       ("s,ws", "Size of working set for each transaction",
        cxxopts::value<size_t>()->default_value("4"))  //
       ("e,epoch", "Size of epoch duration",
        cxxopts::value<size_t>()->default_value("40"))  //
+      ("u,epoch_us",
+       "Size of epoch duration in microseconds, overriding --epoch (0: unused)",
+       cxxopts::value<size_t>()->default_value("0"))  //
       ("p,payload", "Size (bytes) of each record",
        cxxopts::value<size_t>()->default_value("8"))  //
       ("t,thread", "The number of threads working on LineairDB",
@@ -69,6 +86,12 @@ int main(int argc, char** argv) {
        cxxopts::value<size_t>()->default_value("1"))  //
       ("d,duration", "Measurement duration of this benchmark (milliseconds)",
        cxxopts::value<size_t>()->default_value("2000"))  //
+      ("S,seed", "Base seed of the random generators (0: random)",
+       cxxopts::value<uint64_t>()->default_value("0"))  //
+      ("x,inflight",
+       "The maximum number of in-flight transactions per client (0: "
+       "unbounded)",
+       cxxopts::value<size_t>()->default_value("0"))  //
       ("o,output", "Output JSON filename",
        cxxopts::value<std::string>()->default_value("ycsb_result.json"))  //
       ;
@@ -87,10 +110,26 @@ int main(int argc, char** argv) {
   config.concurrency_control_protocol =
       magic_enum::enum_cast<LineairDB::Config::ConcurrencyControl>(protocol)
           .value();
-  config.enable_recovery   = false;
-  config.enable_logging    = result["log"].as<bool>();
-  config.max_thread        = result["thread"].as<size_t>();
-  config.epoch_duration_ms = result["epoch"].as<size_t>();
+  auto index = result["index"].as<std::string>();
+  config.concurrent_point_index =
+      magic_enum::enum_cast<LineairDB::Config::ConcurrentPointIndex>(index)
+          .value();
+  config.enable_recovery          = false;
+  config.enable_logging           = result["log"].as<bool>();
+  config.max_thread               = result["thread"].as<size_t>();
+  config.epoch_duration_ms        = result["epoch"].as<size_t>();
+  config.epoch_duration_us        = result["epoch_us"].as<size_t>();
+  config.enable_huge_pages        = result["hugepages"].as<bool>();
+  config.enable_per_worker_arenas = result["arenas"].as<bool>();
+  config.enable_no_wait_reads     = result["nowait"].as<bool>();
+  config.enable_flat_combining    = result["combining"].as<bool>();
+
+  // NOTE: counters have to be opened before the thread pool is created.
+  YCSB::PerfCounter dtlb_load_misses(YCSB::PerfCounter::DTLBLoadMisses);
+  YCSB::PerfCounter dtlb_store_misses(YCSB::PerfCounter::DTLBStoreMisses);
+  std::vector<YCSB::PerfCounter*> counters;
+  if (dtlb_load_misses.IsAvailable()) counters.push_back(&dtlb_load_misses);
+  if (dtlb_store_misses.IsAvailable()) counters.push_back(&dtlb_store_misses);
   LineairDB::Database db(config);
 
   /** Configure the workload **/
@@ -98,18 +137,21 @@ int main(int argc, char** argv) {
   YCSB::Workload workload =
       YCSB::Workload::GeneratePredefinedWorkload(workload_type);
 
-  workload.recordcount          = result["records"].as<size_t>();
-  workload.zipfian_theta        = result["contention"].as<double>();
-  workload.reps_per_txn         = result["ws"].as<size_t>();
-  workload.payload_size         = result["payload"].as<size_t>();
-  workload.client_thread_size   = result["clients"].as<size_t>();
-  workload.measurement_duration = result["duration"].as<size_t>();
+  workload.recordcount               = result["records"].as<size_t>();
+  workload.zipfian_theta             = result["contention"].as<double>();
+  workload.reps_per_txn              = result["ws"].as<size_t>();
+  workload.payload_size              = result["payload"].as<size_t>();
+  workload.client_thread_size        = result["clients"].as<size_t>();
+  workload.measurement_duration      = result["duration"].as<size_t>();
+  workload.seed                      = result["seed"].as<uint64_t>();
+  workload.max_inflight_transactions = result["inflight"].as<size_t>();
+  workload.deferred_updates          = config.enable_flat_combining;
 
   /** Populate the table **/
   YCSB::PopulateDatabase(db, workload, std::thread::hardware_concurrency());
 
   /** Run the benchmark **/
-  auto result_json = YCSB::RunBenchmark(db, workload);
+  auto result_json = YCSB::RunBenchmark(db, workload, counters);
   auto& allocator  = result_json.GetAllocator();
 
   result_json.AddMember("workload",
@@ -117,8 +159,33 @@ int main(int argc, char** argv) {
                         allocator);
   result_json.AddMember(
       "protocol", rapidjson::Value(protocol.c_str(), allocator), allocator);
+  result_json.AddMember("index", rapidjson::Value(index.c_str(), allocator),
+                        allocator);
   result_json.AddMember("threads", static_cast<uint64_t>(config.max_thread),
                         allocator);
+  result_json.AddMember("clients",
+                        static_cast<uint64_t>(workload.client_thread_size),
+                        allocator);
+  result_json.AddMember("contention", workload.zipfian_theta, allocator);
+  result_json.AddMember("payload", static_cast<uint64_t>(workload.payload_size),
+                        allocator);
+  result_json.AddMember(
+      "epoch", static_cast<uint64_t>(config.epoch_duration_ms), allocator);
+  result_json.AddMember(
+      "epoch_us", static_cast<uint64_t>(config.epoch_duration_us), allocator);
+  result_json.AddMember("seed", workload.seed, allocator);
+  result_json.AddMember("hugepages", config.enable_huge_pages, allocator);
+  result_json.AddMember("arenas", config.enable_per_worker_arenas, allocator);
+  result_json.AddMember("nowait", config.enable_no_wait_reads, allocator);
+  result_json.AddMember("combining", config.enable_flat_combining, allocator);
+  if (dtlb_load_misses.IsAvailable()) {
+    result_json.AddMember("dtlb_load_misses", dtlb_load_misses.Read(),
+                          allocator);
+  }
+  if (dtlb_store_misses.IsAvailable()) {
+    result_json.AddMember("dtlb_store_misses", dtlb_store_misses.Read(),
+                          allocator);
+  }
 
   rapidjson::StringBuffer buffer;
   rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
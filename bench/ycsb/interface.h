@@ -19,6 +19,7 @@
 
 #include <lineairdb/transaction.h>
 
+#include <cstring>
 #include <string_view>
 
 namespace YCSB {
@@ -45,6 +46,17 @@ void ReadModifyWrite(LineairDB::Transaction& tx, std::string_view key,
   Update(tx, key, payload, size);
 }
 
+// The new value does not depend on the current one in YCSB; the update is
+// deferred until the commit, to be combined on hot records.
+void DeferredReadModifyWrite(LineairDB::Transaction& tx, std::string_view key,
+                             void* payload, size_t size) {
+  tx.Update(key,
+            [payload, size](std::byte* value, const size_t, const size_t) {
+              std::memcpy(value, payload, size);
+              return size;
+            });
+}
+
 }  // namespace Interface
 }  // namespace YCSB
 
@@ -0,0 +1,82 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LINEAIRDB_BENCH_YCSB_LATENCY_HISTOGRAM_H
+#define LINEAIRDB_BENCH_YCSB_LATENCY_HISTOGRAM_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace YCSB {
+
+/**
+ * @brief
+ * Log-linear histogram of latencies (in microseconds). Values below 32 are
+ * counted exactly; larger ones are counted in 32 sub-buckets per power of two,
+ * i.e., a reported percentile is lower than the actual one by at most 1/32.
+ */
+class LatencyHistogram {
+ public:
+  void Add(const uint64_t value) {
+    counts_[Index(value)]++;
+    total_++;
+  }
+  void Merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < counts_.size(); i++) counts_[i] += other.counts_[i];
+    total_ += other.total_;
+  }
+  uint64_t Total() const { return total_; }
+
+  /**
+   * @param percentile in [0, 100].
+   * @return the lower bound of the bucket containing the percentile.
+   */
+  uint64_t Percentile(const double percentile) const {
+    if (total_ == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(total_ * percentile / 100.0);
+    if (total_ <= rank) rank = total_ - 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); i++) {
+      seen += counts_[i];
+      if (rank < seen) return LowerBound(i);
+    }
+    return LowerBound(counts_.size() - 1);
+  }
+
+ private:
+  static constexpr size_t SubBuckets    = 32;
+  static constexpr size_t SubBucketBits = 5;
+
+  static size_t Index(const uint64_t value) {
+    if (value < SubBuckets) return value;
+    const size_t exponent = 63 - __builtin_clzll(value);
+    return (exponent - SubBucketBits + 1) * SubBuckets +
+           ((value >> (exponent - SubBucketBits)) & (SubBuckets - 1));
+  }
+  static uint64_t LowerBound(const size_t index) {
+    if (index < SubBuckets) return index;
+    const size_t exponent = index / SubBuckets + SubBucketBits - 1;
+    return (SubBuckets + index % SubBuckets) << (exponent - SubBucketBits);
+  }
+
+  std::array<uint64_t, 64 * SubBuckets> counts_ = {};
+  uint64_t total_                               = 0;
+};
+
+}  // namespace YCSB
+
+#endif /* LINEAIRDB_BENCH_YCSB_LATENCY_HISTOGRAM_H */
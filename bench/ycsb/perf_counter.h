@@ -0,0 +1,86 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LINEAIRDB_BENCH_YCSB_PERF_COUNTER_H
+#define LINEAIRDB_BENCH_YCSB_PERF_COUNTER_H
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace YCSB {
+
+/**
+ * @brief
+ * Hardware cache event counter (e.g., dTLB misses) of this process.
+ * The counter is inherited by the threads created after the construction;
+ * construct it before LineairDB::Database so that the thread pool is counted.
+ * Counting is unavailable (#IsAvailable returns false) if the kernel or the
+ * permission (perf_event_paranoid) does not allow it.
+ */
+class PerfCounter {
+ public:
+  static constexpr uint64_t DTLBLoadMisses =
+      PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  static constexpr uint64_t DTLBStoreMisses =
+      PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_WRITE << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+  explicit PerfCounter(const uint64_t cache_event) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HW_CACHE;
+    attr.config         = cache_event;
+    attr.disabled       = 1;
+    attr.inherit        = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+  ~PerfCounter() {
+    if (IsAvailable()) close(fd_);
+  }
+
+  bool IsAvailable() const { return 0 <= fd_; }
+  void Start() {
+    if (!IsAvailable()) return;
+    ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  void Stop() {
+    if (IsAvailable()) ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+  }
+  uint64_t Read() const {
+    uint64_t value = 0;
+    if (!IsAvailable() || read(fd_, &value, sizeof(value)) != sizeof(value)) {
+      return 0;
+    }
+    return value;
+  }
+
+ private:
+  int fd_;
+};
+
+}  // namespace YCSB
+
+#endif /* LINEAIRDB_BENCH_YCSB_PERF_COUNTER_H */
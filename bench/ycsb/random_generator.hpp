@@ -25,8 +25,11 @@ class RandomGenerator {
  public:
   RandomGenerator() : max_(0xdeadbeef) {}
 
-  void Init(uint64_t items, double theta) {
-    engine_  = std::mt19937(seeder_());
+  /**
+   * @param seed 0 seeds the engine with std::random_device.
+   */
+  void Init(uint64_t items, double theta, uint64_t seed = 0) {
+    engine_  = std::mt19937(seed == 0 ? seeder_() : seed);
     uniform_ = std::uniform_int_distribution<>(0, items);
     max_     = items - 1;
     theta_   = theta;
@@ -37,6 +37,9 @@ struct Workload {
   size_t payload_size;
   size_t client_thread_size;
   size_t measurement_duration;
+  uint64_t seed;                     // 0: random seeds
+  size_t max_inflight_transactions;  // per client. 0: unbounded
+  bool deferred_updates;             // RMW by Transaction::Update
 
   Workload(size_t r, size_t u, size_t i, size_t s, size_t m, Distribution d)
       : read_proportion(r),
@@ -44,7 +47,10 @@ struct Workload {
         insert_proportion(i),
         scan_proportion(s),
         rmw_proportion(m),
-        distribution(d) {
+        distribution(d),
+        seed(0),
+        max_inflight_transactions(0),
+        deferred_updates(false) {
     assert((r + u + i + s + m) == 100);
   }
 
@@ -18,6 +18,7 @@
 #define LINEAIRDB_CONFIG_H
 
 #include <cstddef>
+#include <string>
 #include <thread>
 
 namespace LineairDB {
@@ -73,12 +74,17 @@ struct Config {
    */
   Logger logger;
 
-  enum ConcurrentPointIndex { MPMCConcurrentHashSet };
+  enum ConcurrentPointIndex {
+    MPMCConcurrentHashSet,
+    MPMCInlineConcurrentHashSet
+  };
   /**
    * @brief
    * Set the type of concurrent point index.
    * See LineairDB::Config::ConcurrentPointIndex for the enum options of this
    * configuration.
+   * MPMCInlineConcurrentHashSet embeds keys and data items into the nodes of
+   * the hash table to reduce the dependent cache misses of each lookup.
    *
    * Default: MPMCConcurrentHashSet
    */
@@ -105,18 +111,207 @@ struct Config {
 
   /**
    * @brief
-   * If true, the db logs processed operations for recovery.
+   * If true, the db logs processed operations for recovery. Unless
+   * enable_recovery is also true, the log files and the durable epoch file
+   * of earlier instances in lineairdb_logs/ are deleted at the
+   * instantiation: record ids restart from 1, and a later recovery would mix
+   * up the records of both instances.
+   * The logs are never compacted; they grow with every committed write, and
+   * a recovery replays all of them. Compaction (i.e., checkpointing) is out
+   * of the scope of the current logger; see docs/roadmap.md.
    *
    * Default: true
    */
   bool enable_logging;
 
+  /**
+   * @brief
+   * The maximum number of committed writes which have become durable but not
+   * yet delivered to the subscribers of the change stream. See
+   * LineairDB::Database::Subscribe.
+   *
+   * Default: 65536
+   */
+  size_t change_stream_buffer_size;
+
+  /**
+   * @brief
+   * If true, the buckets of the index and the records (data items and index
+   * nodes) are placed on 2 MB huge pages to reduce dTLB misses of lookups on
+   * large tables. Explicitly reserved huge pages (MAP_HUGETLB) are used if
+   * available; otherwise transparent huge pages are requested by madvise.
+   * The setting applies to this instance only. Note that the huge pages of
+   * the records are never returned to the OS until the process exits; the
+   * records freed by an instance are reused by the later ones.
+   *
+   * Default: false
+   */
+  bool enable_huge_pages;
+
+  /**
+   * @brief
+   * If true, each thread of the thread pool allocates transaction-local data
+   * (read/write sets, snapshots and procedures) from a dedicated jemalloc
+   * arena. This has no effect if LineairDB is built without jemalloc headers.
+   *
+   * Default: false
+   */
+  bool enable_per_worker_arenas;
+
+  /**
+   * @brief
+   * If true, the keys, the operations and the boundaries of executed
+   * transactions are recorded into binary trace files in the directory
+   * `lineairdb_traces`, which is cleared at the instantiation. The traces can
+   * be replayed against any configuration by the `replay` benchmark.
+   *
+   * Default: false
+   */
+  bool enable_trace_recording;
+
+  /**
+   * @brief
+   * If true, a read of a data item locked by a committing writer does not
+   * wait for the writer (no-wait): it takes the last committed version, which
+   * stays readable until the writer installs its new value. It is not a
+   * multi-version read: the reader is never serialized before the writer,
+   * and the read fails its validation whenever the writer commits. Thus it
+   * trades aborts for latency: reads never wait on write locks (only during
+   * the copy of the new value), while the transactions reading contended
+   * keys abort more often, which may lower the throughput.
+   *
+   * Default: false
+   */
+  bool enable_no_wait_reads;
+
+  /**
+   * @brief
+   * If positive, a thread hands its buffered log records over to a background
+   * writer thread as soon as they exceed this size in bytes, instead of
+   * writing them at the end of the epoch. It spreads the writes over the
+   * epoch without blocking the transactions; the durability is still
+   * reported only at the end of each epoch, when each thread waits for its
+   * records handed over and flushes the files. Useful with long epochs or
+   * bursts of writes. 0 means the buffers are written only at the end of
+   * epochs.
+   *
+   * Default: 0
+   */
+  size_t log_flush_threshold;
+
+  /**
+   * @brief
+   * If positive, each thread writes its log records into this number of
+   * files, partitioned by the hash values of keys, instead of a single file.
+   * Since all the records of a data item are then in the same partition,
+   * recovery replays the partitions in parallel by the thread pool without
+   * merging them. Changing it between instances is allowed, but recovery
+   * then replays all the logs as a single partition.
+   *
+   * Default: 0
+   */
+  size_t log_partitions;
+
+  /**
+   * @brief
+   * If positive, the size of epoch duration in microseconds, which overrides
+   * #epoch_duration_ms. Epochs of a few hundred microseconds shorten the
+   * response time of committed transactions, at the cost of a spinning epoch
+   * thread and more frequent log flushes.
+   *
+   * Default: 0
+   */
+  size_t epoch_duration_us;
+
+  /**
+   * @brief
+   * If true, a transaction failing the validation is repaired instead of
+   * aborted, when all the reads it has failed to validate are the ones of
+   * Transaction::TrackedRead: those reads are refreshed, only the functions
+   * depending on them are executed again, and the transaction tries to
+   * commit again. Thus these functions must be idempotent; see
+   * Transaction::TrackedRead.
+   *
+   * Default: false
+   */
+  bool enable_abort_repair;
+
+  /**
+   * @brief
+   * If true, the deferred updates (see Transaction::Update) into a hot data
+   * item are combined: the transaction holding the lock of the data item
+   * applies the updates of the transactions which update only the data item,
+   * in a batch, after its own write. Each update is published with its own
+   * version; if the lock holder aborts, the transactions in its batch abort
+   * as well. Under an extremely skewed workload, these transactions then wait
+   * for one lock holder instead of taking the lock one after another. A data
+   * item is regarded as hot when transactions frequently wait for its lock.
+   *
+   * Default: false
+   */
+  bool enable_flat_combining;
+
+  /**
+   * @brief
+   * The interval, in milliseconds, of the reaper: a background thread which
+   * removes the expired data items (see Transaction::Write with a TTL) from
+   * the index in batches, and reclaims their memory once no transaction can
+   * refer them. The reaper is started by the first write with a TTL, visits
+   * only the keys written with TTLs once they have expired, and sleeps while
+   * no such key remains. It does not run as transactions; it only waits for
+   * the locks held by committing writers. 0 disables the reaper; expired data
+   * items are then still treated as absent, but never removed.
+   *
+   * Default: 1000
+   */
+  size_t expiration_reaper_interval_ms;
+
+  /**
+   * @brief
+   * If not empty, the name of a POSIX shared memory segment (e.g.,
+   * "/lineairdb") in which the index and the data items are placed instead
+   * of the heap of the process; #concurrent_point_index and
+   * #enable_huge_pages are then ignored. The segment is created with
+   * #shared_memory_size bytes unless it exists, and outlives the instance:
+   * an instance mapping an existing segment, in this process or another,
+   * finds the data items placed by the earlier ones, e.g., across restarts
+   * of a process without logging. Since each process maps the segment at a
+   * different address, the index refers to its nodes by offsets in the
+   * segment.
+   * Only one instance attaches a segment at a time; the construction of
+   * another instance on the same segment exits. The epochs, the record ids,
+   * the logs and the callbacks are local to the instance, so sharing a
+   * database among concurrent processes is not supported yet (see
+   * docs/roadmap.md). Flat combining is not supported either.
+   * An instance attaching the segment left by a crashed one releases the
+   * locks held by the crashed one; the values it was installing at the
+   * crash are lost, i.e., the keys are left absent.
+   *
+   * Default: "" (disabled)
+   */
+  std::string shared_memory_segment;
+
+  /**
+   * @brief
+   * The size in bytes of the segment created for #shared_memory_segment,
+   * which never grows.
+   *
+   * Default: 1 GiB
+   */
+  size_t shared_memory_size;
+
   Config(const size_t m = std::thread::hardware_concurrency(),
          const size_t e = 40, const ConcurrencyControl cc = SiloNWR,
          const Logger lg               = ThreadLocalLogger,
          const ConcurrentPointIndex in = MPMCConcurrentHashSet,
          const CallbackEngine cb = ThreadLocal, const bool r = true,
-         const bool l = true)
+         const bool l = true, const size_t cs = 65536,
+         const bool hp = false, const bool pa = false,
+         const bool tr = false, const bool nw = false,
+         const size_t lf = 0, const size_t lp = 0,
+         const size_t eu = 0, const bool ar = false,
+         const bool fc = false, const size_t ri = 1000,
+         const std::string& sm = "", const size_t ss = size_t{1} << 30)
       : max_thread(m),
         epoch_duration_ms(e),
         concurrency_control_protocol(cc),
@@ -124,7 +319,20 @@ struct Config {
         concurrent_point_index(in),
         callback_engine(cb),
         enable_recovery(r),
-        enable_logging(l){};
+        enable_logging(l),
+        change_stream_buffer_size(cs),
+        enable_huge_pages(hp),
+        enable_per_worker_arenas(pa),
+        enable_trace_recording(tr),
+        enable_no_wait_reads(nw),
+        log_flush_threshold(lf),
+        log_partitions(lp),
+        epoch_duration_us(eu),
+        enable_abort_repair(ar),
+        enable_flat_combining(fc),
+        expiration_reaper_interval_ms(ri),
+        shared_memory_segment(sm),
+        shared_memory_size(ss){};
 };
 }  // namespace LineairDB
 
@@ -0,0 +1,133 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LINEAIRDB_COROUTINE_H
+#define LINEAIRDB_COROUTINE_H
+
+/**
+ * Transaction procedures written as C++20 coroutines, on top of
+ * Database::ExecuteResumableTransaction. LineairDB itself is built as C++17;
+ * this header is available only to the applications compiled with coroutine
+ * support, which is indicated by LINEAIRDB_HAS_COROUTINES.
+ *
+ *   LineairDB::Procedure Transfer(LineairDB::Transaction& tx) {
+ *     auto balance = tx.Read<int>("alice");
+ *     co_await LineairDB::Suspend([&](LineairDB::Database::ResumeType resume) {
+ *       StartAsyncCheck(balance, std::move(resume));
+ *     });
+ *     tx.Write<int>("alice", ...);
+ *   }
+ *   db.ExecuteResumableTransaction(LineairDB::Resumable(Transfer), callback);
+ */
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define LINEAIRDB_HAS_COROUTINES
+
+#include <lineairdb/database.h>
+#include <lineairdb/transaction.h>
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <utility>
+
+namespace LineairDB {
+
+/**
+ * @brief
+ * The return type of coroutine transaction procedures. The coroutine starts
+ * suspended and runs in the steps of the resumable transaction.
+ */
+class Procedure {
+ public:
+  struct promise_type {
+    Database::ResumeType resume;
+
+    Procedure get_return_object() {
+      return Procedure(Handle::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+  using Handle = std::coroutine_handle<promise_type>;
+
+  Procedure(Procedure&& other) noexcept
+      : handle_(std::exchange(other.handle_, nullptr)) {}
+  Procedure(const Procedure&) = delete;
+  Procedure& operator=(const Procedure&) = delete;
+  Procedure& operator=(Procedure&&) = delete;
+  ~Procedure() {
+    if (handle_) handle_.destroy();
+  }
+
+  /**
+   * @brief
+   * Runs the coroutine until it suspends or finishes.
+   * @return true if the coroutine has finished.
+   */
+  bool Step(Database::ResumeType&& resume) {
+    handle_.promise().resume = std::move(resume);
+    handle_.resume();
+    return handle_.done();
+  }
+
+ private:
+  explicit Procedure(Handle handle) : handle_(handle) {}
+  Handle handle_;
+};
+
+/**
+ * @brief
+ * An awaitable which suspends the procedure. The given function is invoked
+ * with the resume function after the suspension; it (or anything it hands
+ * the resume function over to) must call it exactly once.
+ */
+template <typename StartFunction>
+class Suspend {
+ public:
+  explicit Suspend(StartFunction start) : start_(std::move(start)) {}
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(Procedure::Handle handle) {
+    start_(std::move(handle.promise().resume));
+  }
+  void await_resume() const noexcept {}
+
+ private:
+  StartFunction start_;
+};
+
+/**
+ * @brief
+ * Adapts a coroutine procedure to Database::ResumableProcedureType. The
+ * coroutine is created at the first step of each transaction.
+ */
+inline Database::ResumableProcedureType Resumable(
+    std::function<Procedure(Transaction&)> body) {
+  return [body, procedure = std::shared_ptr<Procedure>()](
+             Transaction& tx, Database::ResumeType resume) mutable {
+    if (procedure == nullptr) {
+      procedure = std::make_shared<Procedure>(body(tx));
+    }
+    return procedure->Step(std::move(resume));
+  };
+}
+
+}  // namespace LineairDB
+
+#endif /* __cpp_impl_coroutine */
+#endif /* LINEAIRDB_COROUTINE_H */
@@ -19,8 +19,15 @@
 
 #include <lineairdb/transaction.h>
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <iosfwd>
 #include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "config.h"
 #include "tx_status.h"
@@ -61,6 +68,8 @@ class Database {
    * @brief
    *  LineairDB processes a transaction given by a transaction procedure proc,
    * then returns the result typed TxStatus via the callback fucntion clbk.
+   * The callback of a committed transaction is invoked after its epoch has
+   * become durable.
    * Thread-safe.
    * @param[in] proc A transaction procedure processed by LineairDB.
    * @param[out] clbk A callback function accepts a result(Committed or
@@ -68,6 +77,110 @@ class Database {
    */
   void ExecuteTransaction(ProcedureType proc, CallbackType clbk);
 
+  using DeadlineType = std::chrono::steady_clock::time_point;
+  /**
+   * @brief
+   * Executes a transaction with a deadline. Transactions with deadlines are
+   * scheduled in the earliest-deadline-first order, prior to the transactions
+   * without deadlines. A transaction is aborted without running proc if the
+   * deadline has passed before it starts, and is aborted if it is still
+   * waiting for a locked data item at the deadline.
+   * Thread-safe.
+   * @param[in] proc A transaction procedure processed by LineairDB.
+   * @param[out] clbk A callback function accepts a result(Committed or
+   * Aborted).
+   * @param[in] deadline The deadline of the transaction.
+   */
+  void ExecuteTransaction(ProcedureType proc, CallbackType clbk,
+                          const DeadlineType deadline);
+
+  /**
+   * @brief
+   * The outcome of a transaction, passed to OutcomeCallbackType for tracing
+   * the performance of each transaction. Durations are in nanoseconds.
+   */
+  struct TxOutcome {
+    enum AbortReason {
+      NotAborted,
+      UserAbort,          // Transaction::Abort()
+      ValidationFailure,  // the concurrency control has aborted it
+      DeadlineExceeded
+    };
+    /**
+     * The result of the validation of NWR (non-visible write), which omits
+     * the writes of the transaction (Omitted), or tells why the transaction
+     * has been processed with locks instead. NotValidated if the protocol is
+     * not NWR-extended or the transaction has not tried to omit its writes,
+     * e.g., read-only transactions.
+     */
+    enum NWRResult {
+      NotValidated,
+      Omitted,
+      RWDependency,
+      WRDependency,
+      AntiDependency,
+      NotLinearizable
+    };
+
+    TxStatus status;
+    AbortReason abort_reason;
+    NWRResult nwr_result;
+    // From ExecuteTransaction() to the start of the procedure.
+    uint64_t queue_wait_ns;
+    // The procedure and the precommit.
+    uint64_t execution_ns;
+    size_t read_set_size;
+    size_t write_set_size;
+    uint32_t epoch;  // in which the transaction has committed; 0 if aborted
+    // True if the transaction has taken part in flat combining: either its
+    // update has been combined into the batch of the lock holder instead of
+    // taking the lock, or it has held the lock and applied such updates. See
+    // Config::enable_flat_combining.
+    bool combined;
+  };
+  using OutcomeCallbackType = std::function<void(const TxOutcome&)>;
+
+  /**
+   * @brief
+   * ExecuteTransaction() reporting the outcome of the transaction instead of
+   * the status only. The callback is invoked at the same time as
+   * CallbackType; the outcome is recorded only for the transactions executed
+   * by these overloads. Thread-safe.
+   * @param[in] proc A transaction procedure processed by LineairDB.
+   * @param[out] clbk A callback function accepts the outcome.
+   */
+  void ExecuteTransaction(ProcedureType proc, OutcomeCallbackType clbk);
+  void ExecuteTransaction(ProcedureType proc, OutcomeCallbackType clbk,
+                          const DeadlineType deadline);
+
+  using ResumeType = std::function<void()>;
+  /**
+   * @brief
+   * A resumable transaction procedure is invoked in steps, each of which
+   * returns true if the procedure has finished, or false if it suspends
+   * itself, e.g., to wait for an I/O or another transaction. A suspended step
+   * must arrange the given resume function to be called exactly once, from
+   * any thread; then the next step runs on a worker, which may differ from
+   * the previous one. The read and write sets are kept between the steps.
+   * See lineairdb/coroutine.h to write it as a C++20 coroutine.
+   */
+  using ResumableProcedureType = std::function<bool(Transaction&, ResumeType)>;
+
+  /**
+   * @brief
+   * Executes a transaction by a resumable procedure. A suspended transaction
+   * releases its worker and does not hold back the epoch, and it is
+   * validated at the commit as usual. The events of resumable transactions
+   * are not recorded into traces (Config::enable_trace_recording). Fence()
+   * and the destructor wait for all the resumable transactions to finish.
+   * Thread-safe.
+   * @param[in] proc A resumable transaction procedure processed by LineairDB.
+   * @param[out] clbk A callback function accepts a result(Committed or
+   * Aborted).
+   */
+  void ExecuteResumableTransaction(ResumableProcedureType proc,
+                                   CallbackType clbk);
+
   /**
    * @brief
    * Fence() waits termination of transactions which is currently in progress.
@@ -80,6 +193,111 @@ class Database {
    */
   void Fence() const noexcept;
 
+  using ScanCallbackType = std::function<void(
+      const std::string_view,
+      const std::pair<const std::byte* const, const size_t>)>;
+  /**
+   * @brief
+   * ParallelScan() visits all the data items stored in the database by using
+   * the given number of threads, e.g., for analytics or exporting. The scan
+   * runs outside of any transaction: it neither takes locks nor joins the
+   * concurrency control, and thus never aborts or blocks concurrent
+   * transactions. The scan is not a snapshot of the database: each visited
+   * value is a committed version of its own item, but the values of
+   * different items may be of different points in time, and thus may
+   * reflect only some of the writes of a transaction. Items inserted or
+   * updated during the scan may or may not be visited with their latest
+   * values. For a consistent copy, see Backup(). Thread-safe.
+   * @param[in] clbk A callback function invoked with the key and the value of
+   * each data item. Since it is called from multiple threads concurrently, it
+   * must be thread-safe.
+   * @param[in] threads The number of threads used for scanning.
+   */
+  void ParallelScan(ScanCallbackType clbk, const size_t threads);
+
+  /**
+   * @brief
+   * A committed write delivered by the change stream. The key and the value
+   * are valid only during the invocation of the callback.
+   */
+  struct Change {
+    std::string_view key;
+    const std::byte* value;
+    size_t size;
+    // The time (milliseconds since the Unix epoch) when the value expires,
+    // or 0 if it never expires; see Transaction::Write with a TTL.
+    uint64_t expires_at;
+  };
+  using ChangeStreamCallbackType =
+      std::function<void(const uint32_t, const std::vector<Change>&)>;
+  /**
+   * @brief
+   * Subscribe() registers a callback which receives the write sets of
+   * committed transactions, grouped by epoch. The callback is invoked once
+   * for each epoch which has become durable, in the order of epochs, from a
+   * single background thread. Writes of the same key in an epoch are
+   * delivered in the order of their versions. Transactions committed before
+   * the subscription may not be delivered, and neither are the writes of
+   * non-durable transactions (see Transaction::MarkAsNonDurable), which are
+   * not logged. Requires Config::enable_logging.
+   * When subscribers are slower than transaction processing, the undelivered
+   * changes are buffered up to Config::change_stream_buffer_size writes; then
+   * the group commit (and thus the commit acknowledgements) waits for the
+   * subscribers. Thread-safe; the callback may call Subscribe() and
+   * Unsubscribe().
+   * @param[in] clbk A callback function that accepts the epoch number and the
+   * committed writes in the epoch.
+   * @return a positive identifier of this subscription, or 0 if logging is
+   * disabled.
+   */
+  size_t Subscribe(ChangeStreamCallbackType clbk);
+
+  /**
+   * @brief
+   * Unsubscribe() removes the subscription; the callback is never invoked
+   * after this method returns. If called from a callback, the callbacks of
+   * the other subscriptions may still be running for the current epoch.
+   * Thread-safe.
+   * @param[in] subscription_id The return value of Subscribe().
+   */
+  void Unsubscribe(const size_t subscription_id);
+
+  /**
+   * @brief
+   * Backup() writes a consistent copy of the database into sink, concurrently
+   * with transactions. It scans the data items with a single thread, as
+   * ParallelScan() does, and then appends the writes committed during the
+   * scan (the log tail), so that the copy reflects exactly the transactions
+   * committed up to the returned epoch. The scanned items and the tail are
+   * spilled into temporary files, and copied into sink after the scan; the
+   * rate limit thus does not prolong the scan. Requires
+   * Config::enable_logging.
+   * Thread-safe.
+   * The values are restored with their expiration times (see
+   * Transaction::Write with a TTL). Writes of non-durable transactions
+   * committed during the scan may be missing since they are not logged.
+   * @param[out] sink A stream (e.g., a file or a pipe) to write the backup.
+   * @param[in] max_bytes_per_second The upper bound of the average rate of
+   * writing into sink, to protect the latency of transactions; 0 means
+   * unlimited.
+   * @return the epoch as of which the backup is consistent, or 0 if the backup
+   * has failed: logging is disabled, or sink (or a temporary file) cannot be
+   * written. A failed backup is incomplete and rejected by Restore().
+   */
+  uint32_t Backup(std::ostream& sink, const size_t max_bytes_per_second = 0);
+
+  /**
+   * @brief
+   * Restore() writes the data items in a backup taken by Backup() into this
+   * database, by transactions. Keys which are not in the backup are left
+   * untouched; restore into an empty database to reproduce the backup.
+   * Call it before executing other transactions. Thread-unsafe.
+   * @param[in] source A stream to read the backup.
+   * @return false if the backup is malformed or incomplete; the data items
+   * read before the failure have been written.
+   */
+  bool Restore(std::istream& source);
+
  private:
   class Impl;
   const std::unique_ptr<Impl> db_pimpl_;
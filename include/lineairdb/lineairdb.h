@@ -18,6 +18,7 @@
 #define LINEAIRDB_H
 
 #include <lineairdb/config.h>
+#include <lineairdb/coroutine.h>
 #include <lineairdb/database.h>
 #include <lineairdb/transaction.h>
 #include <lineairdb/tx_status.h>
@@ -16,8 +16,11 @@
 #ifndef LINEAIRDB_TRANSACTION_H
 #define LINEAIRDB_TRANSACTION_H
 
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
+#include <functional>
 #include <memory>
 #include <optional>
 #include <string_view>
@@ -55,6 +58,13 @@ class Transaction {
    * value.
    * If there does not exists the data item of given key, it returns the pair
    * (nullptr, 0).
+   * The returned pointer refers to the copy of the value held by this
+   * transaction, and is invalidated by the subsequent reads of this
+   * transaction; copy the value before reading another data item.
+   * Reading a missing key leaves the database unchanged only if this
+   * transaction is read-only; a transaction which also writes inserts an
+   * empty data item for the key at its commit, to validate that the key is
+   * still missing.
    *
    */
   const std::pair<const std::byte* const, const size_t> Read(
@@ -115,8 +125,252 @@ class Transaction {
     Write(key, buffer, sizeof(T));
   };
 
+  /**
+   * @brief
+   * Writes a value which expires after the given time to live (TTL), e.g.,
+   * sessions. An expired data item is treated as absent by the reads, and is
+   * removed from the database in the background by the reaper; see
+   * Config::expiration_reaper_interval_ms. The expiration is not validated:
+   * a transaction which has read the value before it expires may commit
+   * after. The value written by Write() without a TTL never expires; the
+   * one written by Update() keeps the expiration time of the value it is
+   * applied to. The removals by the reaper are not logged: the logs keep the
+   * expired values with their expiration times, and recovery skips them by
+   * comparing the times with the clock of the recovering instance.
+   * @param key
+   * @param value
+   * @param size
+   * @param ttl
+   */
+  void Write(const std::string_view key, const std::byte value[],
+             const size_t size, const std::chrono::milliseconds ttl);
+
+  /**
+   * @brief
+   * Write() with a TTL for an user-defined value. T must be Trivially
+   * Copyable.
+   */
+  template <typename T>
+  void Write(const std::string_view key, const T& value,
+             const std::chrono::milliseconds ttl) {
+    static_assert(std::is_trivially_copyable<T>::value == true,
+                  "LineairDB expects to read/write trivially copyable types.");
+    std::byte buffer[sizeof(T)];
+    std::memcpy(buffer, &value, sizeof(T));
+    Write(key, buffer, sizeof(T), ttl);
+  }
+
+  /**
+   * @brief
+   * The version of a data item, which changes whenever a transaction writes
+   * it. Version 0 means that the data item has never been written.
+   */
+  using Version = uint64_t;
+
+  /**
+   * @brief
+   * The result of ReadIfChanged(). If the data item has not been changed,
+   * the value is nullptr.
+   */
+  struct VersionedValue {
+    bool changed;
+    Version version;
+    const std::byte* value;
+    size_t size;
+  };
+
+  /**
+   * @brief
+   * Reads a data item only if its version differs from the given one, e.g.,
+   * to revalidate a value cached by the client. An unchanged data item is
+   * not copied; its version is validated at the commit, as the other reads.
+   * @param key
+   * @param known_version
+   * @return VersionedValue
+   * The current version; the value and the size are the ones of Read() if
+   * the version differs from the given one.
+   * The data items written by this transaction are returned as changed, with
+   * version 0, since their versions are determined at the commit.
+   */
+  VersionedValue ReadIfChanged(const std::string_view key,
+                               const Version known_version);
+
+  /**
+   * @brief
+   * Writes a value only if the version of the data item equals the given
+   * one, i.e., nobody has written it since the caller saw the version.
+   * Otherwise, this transaction is aborted. It is equivalent to Write() after
+   * ReadIfChanged(), and thus never copies the current value; the version is
+   * validated again at the commit, under the lock of the data item.
+   * @param key
+   * @param expected_version
+   * @param value
+   * @param size
+   */
+  void WriteIfVersion(const std::string_view key,
+                      const Version expected_version, const std::byte value[],
+                      const size_t size);
+
+  /**
+   * @brief
+   * WriteIfVersion() for an user-defined value. T must be Trivially Copyable.
+   */
+  template <typename T>
+  void WriteIfVersion(const std::string_view key,
+                      const Version expected_version, const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value == true,
+                  "LineairDB expects to read/write trivially copyable types.");
+    std::byte buffer[sizeof(T)];
+    std::memcpy(buffer, &value, sizeof(T));
+    WriteIfVersion(key, expected_version, buffer, sizeof(T));
+  }
+
+  using DependentType =
+      std::function<void(const std::byte* const value, const size_t size)>;
+
+  /**
+   * @brief
+   * Reads a data item and passes its value to the given function, which
+   * computes the part of this transaction depending on the value (e.g., the
+   * writes derived from it). It is the same as calling the function with the
+   * result of Read(), except that the reads and writes of the function are
+   * recorded as depending on this read.
+   * If Config::enable_abort_repair is set and this transaction fails the
+   * validation only because of the reads of such functions, the transaction
+   * is repaired instead of aborted: the invalidated data items are read
+   * again, and only the functions depending on them are executed again, after
+   * their previous writes are discarded.
+   * @note A function is not repaired, and its transaction aborts as usual, if
+   * the rest of the transaction reads its writes, writes the same keys, or
+   * reads the same keys after it. Calls of TrackedRead() within a function
+   * are not tracked separately.
+   * @note Since a repaired function is executed again, it must be idempotent
+   * apart from its operations on this transaction: its side effects outside
+   * the transaction (e.g., I/O or updates of shared variables) are repeated
+   * by each repair.
+   * @param key
+   * @param dependent
+   * A function which is invoked with the value and the size of the data item;
+   * (nullptr, 0) if there does not exist.
+   */
+  void TrackedRead(const std::string_view key, DependentType dependent);
+
+  /**
+   * @brief
+   * TrackedRead() for an user-defined value. T must be same as one on writing
+   * with Write().
+   */
+  template <typename T>
+  void TrackedRead(const std::string_view key,
+                   std::function<void(const std::optional<T>)> dependent) {
+    static_assert(std::is_trivially_copyable<T>::value == true,
+                  "LineairDB expects to read/write trivially copyable types.");
+    TrackedRead(key, [dependent = std::move(dependent)](
+                         const std::byte* const value, const size_t size) {
+      if (size != 0) {
+        const T copy_constructed_value = *reinterpret_cast<const T*>(value);
+        dependent(copy_constructed_value);
+      } else {
+        dependent(std::nullopt);
+      }
+    });
+  }
+
+  using UpdateType = std::function<size_t(
+      std::byte* value, const size_t size, const size_t capacity)>;
+
+  /**
+   * @brief
+   * Updates a data item by the given function, which is deferred until the
+   * commit: it is invoked with the last committed value under the lock of the
+   * data item, instead of reading the value now. Thus this transaction never
+   * aborts by the writes of the others into the data item, e.g., counters.
+   * If this transaction reads or writes the data item before or after, the
+   * update is applied at that time, as Read() and Write().
+   * If Config::enable_flat_combining is set, the function may be invoked by
+   * another thread, which applies the updates into a hot data item in a batch.
+   * @param key
+   * @param update
+   * A function which overwrites the given value (size 0 if there does not
+   * exist) by the new one, up to the capacity, and returns its size.
+   */
+  void Update(const std::string_view key, UpdateType update);
+
+  /**
+   * @brief
+   * Update() for an user-defined value. T must be Trivially Copyable.
+   */
+  template <typename T>
+  void Update(const std::string_view key,
+              std::function<T(const std::optional<T>)> update) {
+    static_assert(std::is_trivially_copyable<T>::value == true,
+                  "LineairDB expects to read/write trivially copyable types.");
+    Update(key, [update = std::move(update)](std::byte* value,
+                                             const size_t size, const size_t) {
+      std::optional<T> current;
+      if (size != 0) {
+        T copy_constructed_value;
+        std::memcpy(&copy_constructed_value, value, sizeof(T));
+        current = copy_constructed_value;
+      }
+      const T updated = update(current);
+      std::memcpy(value, &updated, sizeof(T));
+      return sizeof(T);
+    });
+  }
+
+  using BlobProducerType =
+      std::function<size_t(std::byte* buffer, const size_t capacity)>;
+  using BlobConsumerType =
+      std::function<void(const std::byte* chunk, const size_t size)>;
+
+  /**
+   * @brief
+   * Writes a large object (blob) with a given key, by streaming. The blob is
+   * split into chunks, each of which is stored and logged as a data item.
+   * Note that blobs are stored in a key space separated from the one of
+   * Write(); Read() does not return blobs. The keys prefixed by "\0bm:" or
+   * "\0bc:" are reserved for the key space of blobs; the other methods abort
+   * the transaction if such a key is given. Calling WriteBlob() twice with
+   * the same key in a transaction replaces the former blob.
+   * @param key
+   * @param producer
+   * A function which fills the given buffer with the next part of the blob
+   * and returns the number of bytes filled, up to the capacity. Returning 0
+   * means the end of the blob.
+   */
+  void WriteBlob(const std::string_view key, BlobProducerType producer);
+
+  /**
+   * @brief
+   * Reads a blob written by WriteBlob(), by streaming. Only the version of the
+   * blob is validated at the commit, instead of the versions of all chunks.
+   * If the blob has been overwritten during the read, this transaction is
+   * aborted and 0 is returned.
+   * @param key
+   * @param consumer
+   * A function which is invoked with each chunk of the blob, in order.
+   * @return the size of the blob; 0 if there does not exist.
+   */
+  size_t ReadBlob(const std::string_view key, BlobConsumerType consumer);
+
   void Abort();
 
+  /**
+   * @brief
+   * Marks this transaction as non-durable.
+   * The write set of a non-durable transaction is not recorded into the
+   * recovery logs. It is useful for the data items such as caches or
+   * ephemeral session states; note that their writes may be lost on a crash,
+   * while the other transactions processed concurrently stay fully durable.
+   * The callback is invoked at the end of the epoch as well as the durable
+   * transactions, so that the commit order is the same as theirs.
+   * Durable transactions may read the values written by non-durable ones;
+   * after a crash, they are recovered while the values they have read are
+   * lost.
+   */
+  void MarkAsNonDurable();
+
  private:
   Transaction(void*) noexcept;
   ~Transaction() noexcept;
@@ -17,11 +17,14 @@
 #ifndef LINEAIRDB_CONCURRENCY_CONTROL_BASE_H
 #define LINEAIRDB_CONCURRENCY_CONTROL_BASE_H
 
+#include <lineairdb/config.h>
 #include <lineairdb/tx_status.h>
 
+#include <chrono>
 #include <cstddef>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include "index/concurrent_table.h"
 #include "types.h"
@@ -32,23 +35,91 @@ struct TransactionReferences {
   ReadSetType& read_set_ref_;
   WriteSetType& write_set_ref_;
   const EpochNumber& my_epoch_ref_;
+  const std::chrono::steady_clock::time_point& deadline_ref_;
+  const Config& config_ref_;
 };
 class ConcurrencyControlBase {
  public:
   ConcurrencyControlBase(TransactionReferences&& tx) : tx_ref_(tx) {}
   virtual ~ConcurrencyControlBase(){};
+  // Never equal to the version of any data item.
+  static constexpr uint64_t UnknownVersion = ~0llu;
+
   virtual const Snapshot Read(std::string_view) = 0;
+  /**
+   * @brief
+   * Reads a data item as #Read, but does not copy the value if its version
+   * equals the given one (see Snapshot::has_value_copy).
+   */
+  virtual const Snapshot ReadIfChanged(std::string_view,
+                                       const uint64_t known_version) = 0;
+  /**
+   * @brief
+   * Reads a data item only for the validation if its version equals the
+   * given one: the data item and the version are recorded, but no snapshot
+   * is made. Returns false and records nothing otherwise (e.g., the key is
+   * missing); then the caller reads it by #ReadIfChanged.
+   */
+  virtual bool ReadIfUnchanged(std::string_view,
+                               const uint64_t known_version) = 0;
   virtual void Write(const std::string_view key, const std::byte* const value,
                      const size_t size)         = 0;
   virtual void Abort()                          = 0;
   virtual bool Precommit()                      = 0;
   virtual void PostProcessing(TxStatus)         = 0;
+  /**
+   * @brief
+   * Prepares another #Precommit after a failed one, for the abort repair (see
+   * Config::enable_abort_repair). The reads at the given positions in the
+   * read set are forgotten; the caller reads them again by #Read.
+   */
+  virtual void PrepareRepair(const std::vector<size_t>& refreshed_reads) = 0;
+
+  /**
+   * @brief
+   * Returns the result of the NWR validation in the last #Precommit;
+   * NOT_YET_VALIDATED if the protocol is not NWR-extended or the transaction
+   * has not tried to omit its writes.
+   */
+  virtual NWRValidationResult GetNWRValidationResult() const {
+    return NWRValidationResult::NOT_YET_VALIDATED;
+  }
+
+  /**
+   * @brief
+   * Returns true if the last #Precommit has joined the combining batch of
+   * another lock holder; see Config::enable_flat_combining.
+   */
+  virtual bool HasJoinedBatch() const { return false; }
 
   bool IsReadOnly() { return (0 == tx_ref_.write_set_ref_.size()); }
   bool IsWriteOnly() { return (0 == tx_ref_.read_set_ref_.size()); }
+  /**
+   * @brief
+   * Returns true if the protocol has stopped waiting for a locked data item
+   * because of the deadline of the transaction; the transaction must abort.
+   */
+  bool IsTimedOut() const { return timed_out_; }
+  /**
+   * @brief
+   * Returns the positions in the read set of the reads which have failed the
+   * validation in the last #Precommit. Collected only if
+   * Config::enable_abort_repair is set.
+   */
+  const std::vector<size_t>& GetInvalidatedReads() const {
+    return invalidated_reads_;
+  }
 
  protected:
+  bool IsDeadlineExceeded() const {
+    return tx_ref_.deadline_ref_ !=
+               std::chrono::steady_clock::time_point::max() &&
+           tx_ref_.deadline_ref_ < std::chrono::steady_clock::now();
+  }
+
   TransactionReferences tx_ref_;
+  bool timed_out_ = false;
+  std::vector<size_t> invalidated_reads_;
 };
 }  // namespace LineairDB
 
@@ -19,15 +19,19 @@
 
 #include <lineairdb/tx_status.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cstddef>
 #include <cstring>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "concurrency_control/concurrency_control_base.h"
 #include "concurrency_control/pivot_object.hpp"
 #include "index/concurrent_table.h"
 #include "types.h"
+#include "util/hash.h"
 
 namespace LineairDB {
 
@@ -48,49 +52,142 @@ class SiloNWRTyped final : public ConcurrencyControlBase {
   };
 
   std::vector<ValidationItem> validation_set_;
+  // The reads by #ReadIfUnchanged, which are not in the read set.
+  std::vector<ValidationItem> unchanged_reads_;
   NWRValidationResult nwr_validation_result_;
   NWRPivotObject my_pivot_object_;
   std::vector<PivotObjectSnapshot> pivot_object_snapshots_;
+  bool repairing_;
+
+  // Flat combining; see Config::enable_flat_combining.
+  static constexpr uint32_t HotLockContention = 4;
+  std::vector<DataItem*> opened_batches_;
+  std::vector<const DataItem*> combined_items_;
+  CombiningBatch::Request request_;
+  CombiningBatch* joined_batch_;  // non-null while this transaction has joined
 
  public:
   SiloNWRTyped(TransactionReferences&& tx)
       : ConcurrencyControlBase(std::forward<TransactionReferences&&>(tx)),
-        nwr_validation_result_(NWRValidationResult::NOT_YET_VALIDATED){};
+        nwr_validation_result_(NWRValidationResult::NOT_YET_VALIDATED),
+        repairing_(false),
+        joined_batch_(nullptr){};
   ~SiloNWRTyped() final override{};
 
   const Snapshot Read(const std::string_view key) final override {
-    auto* item = tx_ref_.table_ref_.GetOrInsert(key);
-    assert(item != nullptr);
+    return ReadIfChanged(key, UnknownVersion);
+  }
+  const Snapshot ReadIfChanged(const std::string_view key,
+                               const uint64_t known_version) final override {
+    // Reading a missing key does not insert it into the index until the commit
+    // of an update transaction; read-only ones validate the absence without
+    // inserting it. See #ResolveAbsentReads.
+    const size_t key_hash = Util::HashKey(key);
+    auto* item            = tx_ref_.table_ref_.Get(key, key_hash);
+    if (item == nullptr) {
+      return LineairDB::Snapshot(key, key_hash, nullptr, 0, nullptr);
+    }
 
-    LineairDB::Snapshot snapshot(key, nullptr, 0, item);
+    LineairDB::Snapshot snapshot(key, key_hash, nullptr, 0, item);
+    if (tx_ref_.config_ref_.enable_no_wait_reads) {
+      // The last committed version is read even if a writer holds the lock;
+      // if the writer commits, the validation of this read fails.
+      auto tx_id            = item->transaction_id.load() & ~1llu;
+      const auto expires_at = item->expires_at;
+      if (tx_id == known_version && !DataItem::IsExpired(expires_at)) {
+        // The value is copied later if needed (e.g., by an update), but its
+        // expiration time is kept from now.
+        snapshot.has_value_copy = false;
+        snapshot.expires_at     = expires_at;
+      } else {
+        tx_id = item->CopyStableVersion(snapshot.value_copy, snapshot.size,
+                                        &snapshot.expires_at);
+      }
+      // A reaped data item is no longer in the index; look up the key again.
+      // Reads before the reaper are invalidated by the version it changes.
+      if (item->reaped.load()) return ReadIfChanged(key, known_version);
+      snapshot.read_version = tx_id;
+      validation_set_.push_back({item, tx_id});
+      return snapshot;
+    }
     for (;;) {
       auto tx_id = item->transaction_id.load();
 
       if (tx_id & 1llu) {  // locked
                            // WANTFIX user-space adaptive mutex locking may
                            // improve the performance
+        if (IsDeadlineExceeded()) {
+          timed_out_ = true;
+          return snapshot;
+        }
         std::this_thread::yield();
         continue;
       }
 
-      snapshot.Reset(item->value, item->size);
+      // An expired value is read as absent; see DataItem::expires_at.
+      const auto expires_at   = item->expires_at;
+      const bool expired      = DataItem::IsExpired(expires_at);
+      snapshot.has_value_copy = tx_id != known_version || expired;
+      snapshot.expires_at     = expired ? 0 : expires_at;
+      if (expired) {
+        snapshot.size = 0;
+      } else if (snapshot.has_value_copy) {
+        snapshot.Reset(item->value, item->size);
+      }
 
       if (item->transaction_id.load() == tx_id) {
+        if (item->reaped.load()) return ReadIfChanged(key, known_version);
+        snapshot.read_version = tx_id;
         validation_set_.push_back({item, tx_id});
         return snapshot;
       }
     }
   };
+  bool ReadIfUnchanged(const std::string_view key,
+                       const uint64_t known_version) final override {
+    auto* item = tx_ref_.table_ref_.Get(key, Util::HashKey(key));
+    if (item == nullptr) return false;
+    for (;;) {
+      auto tx_id = item->transaction_id.load();
+      if (tx_id & 1llu) {  // locked
+        if (tx_ref_.config_ref_.enable_no_wait_reads) {
+          tx_id &= ~1llu;
+        } else if (IsDeadlineExceeded()) {
+          timed_out_ = true;
+          return false;
+        } else {
+          std::this_thread::yield();
+          continue;
+        }
+      }
+      // An expired value and a reaped data item are read by #ReadIfChanged.
+      if (tx_id != known_version || item->IsExpired() ||
+          item->reaped.load()) {
+        return false;
+      }
+      validation_set_.push_back({item, tx_id});
+      unchanged_reads_.push_back({item, tx_id});
+      return true;
+    }
+  }
   void Write(const std::string_view, const std::byte* const,
              const size_t) final override{};
   void Abort() final override{};
   bool Precommit() final override {
-    /** Sorting write set to prevent deadlock **/
-    std::sort(tx_ref_.write_set_ref_.begin(), tx_ref_.write_set_ref_.end(),
-              Snapshot::Compare);
+    combined_items_.clear();
+    if (!IsReadOnly()) ResolveAbsentReads();
 
     if constexpr (EnableNWR) {
-      if (!IsReadOnly() && IsOmittable()) {
+      if (repairing_ || HasDeferredUpdates()) {
+        // The pivot objects may hold the versions of the failed precommit of
+        // this transaction, by which its writes must not be omitted. Deferred
+        // updates must not be omitted either, since they read the data items
+        // under the locks.
+        if (!IsReadOnly()) {
+          ResolveWriteSet();
+          SnapshotPivotObjects();
+        }
+      } else if (!IsReadOnly() && IsOmittable()) {
         // we can safely clear writeset since all versions x_j in writeset_j are
         // omittable.
         tx_ref_.write_set_ref_.clear();
@@ -106,17 +203,40 @@ class SiloNWRTyped final : public ConcurrencyControlBase {
       }
     }
 
-    /** Acquire Lock **/
-    for (auto& snapshot : tx_ref_.write_set_ref_) {
-      auto* item = snapshot.index_cache;
-      if (item == nullptr) {
-        item                 = tx_ref_.table_ref_.GetOrInsert(snapshot.key);
-        snapshot.index_cache = item;
-      }
+    /** Sorting write set by record ids to prevent deadlock **/
+    ResolveWriteSet();
+    std::sort(tx_ref_.write_set_ref_.begin(), tx_ref_.write_set_ref_.end(),
+              Snapshot::Compare);
 
+    /** Acquire Lock **/
+    const bool combining = tx_ref_.config_ref_.enable_flat_combining;
+    // A transaction updating only one data item never holds the other locks,
+    // and thus the lock holder can wait for it without deadlocks.
+    const bool joinable = combining && tx_ref_.write_set_ref_.size() == 1 &&
+                          tx_ref_.write_set_ref_.front().update;
+    for (size_t i = 0; i < tx_ref_.write_set_ref_.size(); i++) {
+      auto& snapshot = tx_ref_.write_set_ref_[i];
+      auto* item     = snapshot.index_cache;
+      assert(item != nullptr);
+
+      bool waited = false;
       for (;;) {
         auto current = item->transaction_id.load();
         if (current & 1) {
+          if (joinable && JoinBatch(item, snapshot)) {
+            // The version locked by the holder, until #Publish.
+            snapshot.version_in_epoch = current;
+            break;
+          }
+          if (combining && !waited) {
+            item->lock_contention.fetch_add(1);
+            waited = true;
+          }
+          if (IsDeadlineExceeded()) {
+            ReleaseLocks(i);
+            timed_out_ = true;
+            return false;
+          }
           // WANTFIX user-space adaptive mutex locking may
           // improve the performance
           std::this_thread::yield();
@@ -125,14 +245,23 @@ class SiloNWRTyped final : public ConcurrencyControlBase {
         bool lock_acquired =
             item->transaction_id.compare_exchange_weak(current, current | 1llu);
         if (lock_acquired) {
-          snapshot.version_in_epoch += 1;
+          if (item->reaped.load()) {
+            // The data item has expired and been removed from the index
+            // since this transaction looked it up; the write would be lost.
+            ReleaseLocks(i + 1);
+            return false;
+          }
+          // The write publishes a version after the one just locked; see
+          // #Unlock.
+          snapshot.version_in_epoch = current | 1llu;
           // If this item is in readset, add 1 (lockflag) into snapshot for
           // validation
+          // An item read by #ReadIfUnchanged may be read again by #Read.
           for (auto& read_item : validation_set_) {
-            if (read_item.item_p_cache == item) {
-              read_item.transaction_id += 1;
-              break;
-            }
+            if (read_item.item_p_cache == item) read_item.transaction_id += 1;
+          }
+          if (combining && HotLockContention <= item->lock_contention.load()) {
+            OpenBatch(item);
           }
           break;
         }
@@ -144,9 +273,18 @@ class SiloNWRTyped final : public ConcurrencyControlBase {
 
     /** Validation Phase **/
     if (!AntiDependencyValidation()) {
+      CloseCombining(false);
       // if validation failed, unlock all objects
       for (auto& snapshot : tx_ref_.write_set_ref_) {
+        // Joined items have been neither locked by this transaction nor
+        // added the lock flag in the validation set.
+        if (IsCombined(snapshot.index_cache)) continue;
         snapshot.index_cache->transaction_id.fetch_sub(1llu);
+        for (auto& read_item : validation_set_) {
+          if (read_item.item_p_cache == snapshot.index_cache) {
+            read_item.transaction_id -= 1;
+          }
+        }
       }
       return false;
     }
@@ -154,71 +292,353 @@ class SiloNWRTyped final : public ConcurrencyControlBase {
     /** Buffer Update (Copy to index from user defined function **/
     for (auto& snapshot : tx_ref_.write_set_ref_) {
       auto* item = snapshot.index_cache;
+      if (joined_batch_ != nullptr) continue;  // applied by the lock holder
+      item->install_counter.fetch_add(1);  // until unlocked
+      if (snapshot.update) {
+        // A deferred update is applied to the last committed value, and
+        // keeps its expiration time.
+        const size_t size   = item->IsExpired() ? 0 : item->size;
+        snapshot.expires_at = size == 0 ? 0 : item->expires_at;
+        std::memcpy(snapshot.value_copy, item->value, size);
+        snapshot.size =
+            snapshot.update(snapshot.value_copy, size, ValueBufferSize);
+      }
       item->Reset(snapshot.value_copy, snapshot.size);
+      item->expires_at = snapshot.expires_at;
     }
-
-    return true;
+    // A joined transaction aborts if the lock holder has aborted.
+    return CloseCombining(true);
   };
 
+  void PrepareRepair(
+      const std::vector<size_t>& refreshed_reads) final override {
+    for (auto position : refreshed_reads) {
+      const auto* item = tx_ref_.read_set_ref_[position].index_cache;
+      if (item == nullptr) continue;  // absent read of a read-only transaction
+      validation_set_.erase(
+          std::remove_if(validation_set_.begin(), validation_set_.end(),
+                         [&](const ValidationItem& validation_item) {
+                           return validation_item.item_p_cache == item;
+                         }),
+          validation_set_.end());
+      // The unchanged reads are not repaired, and thus still validated.
+      for (auto& unchanged : unchanged_reads_) {
+        if (unchanged.item_p_cache != item) continue;
+        validation_set_.push_back(unchanged);
+      }
+    }
+    invalidated_reads_.clear();
+    repairing_             = true;
+    nwr_validation_result_ = NWRValidationResult::NOT_YET_VALIDATED;
+    my_pivot_object_       = NWRPivotObject();
+    pivot_object_snapshots_.clear();
+  }
+
+  NWRValidationResult GetNWRValidationResult() const final override {
+    return nwr_validation_result_;
+  }
+
+  bool HasJoinedBatch() const final override {
+    return !combined_items_.empty();
+  }
+
   void PostProcessing(TxStatus status) final override {
     if (status == TxStatus::Committed) {
       if constexpr (EnableNWR) {
         if (nwr_validation_result_ == NWRValidationResult::ACYCLIC) { return; }
       }
 
-      auto current_epoch = tx_ref_.my_epoch_ref_;
-
       /** Unlock **/
       for (auto& snapshot : tx_ref_.write_set_ref_) {
-        auto* item                   = snapshot.index_cache;
-        EpochNumber written_in_epoch = snapshot.version_in_epoch >> 32;
-
-        if (current_epoch != written_in_epoch) {
-          const auto rotated_id =
-              (static_cast<uint64_t>(current_epoch) << 32) | 2;
-          item->transaction_id.store(rotated_id);
-          snapshot.version_in_epoch = rotated_id;
-        } else {
-          [[maybe_unused]] const auto id = item->transaction_id.fetch_add(1llu);
-          // Modify the version in snapshot, for logging and updating the pivot
-          // objects
-
-          assert(id == snapshot.version_in_epoch);
-          snapshot.version_in_epoch++;
-        }
+        if (IsCombined(snapshot.index_cache)) continue;  // already unlocked
+        // Modify the version in snapshot, for logging and updating the pivot
+        // objects
+        snapshot.version_in_epoch =
+            Unlock(snapshot.index_cache, snapshot.version_in_epoch);
       }
     }
   }
 
  private:
+  // Pivot objects hash data items by their record ids; dense ids spread over
+  // the slots of HalfWordSet better than heap addresses.
+  static uint32_t PivotSeed(const DataItem* item) {
+    return static_cast<uint32_t>(item->record_id);
+  }
+
+  /**
+   * @brief
+   * Unlocks a data item locked by this transaction with its new version.
+   * @param version the version of the write snapshot, with the lock bit.
+   * @return the new version.
+   */
+  uint64_t Unlock(DataItem* item, const uint64_t version) {
+    assert(item->transaction_id.load() == version);
+    const auto new_version =
+        DataItem::NextVersion(version, tx_ref_.my_epoch_ref_);
+    item->transaction_id.store(new_version);
+    item->install_counter.fetch_add(1);
+    return new_version;
+  }
+
+  /**
+   * @brief
+   * Releases the locks of the first given number of data items in the write
+   * set, on an abort in the middle of the lock acquisition.
+   */
+  void ReleaseLocks(const size_t acquired) {
+    CloseCombining(false);
+    for (size_t j = 0; j < acquired; j++) {
+      auto* item = tx_ref_.write_set_ref_[j].index_cache;
+      if (IsCombined(item)) continue;
+      item->transaction_id.fetch_sub(1llu);
+    }
+  }
+
+  bool HasDeferredUpdates() {
+    for (auto& snapshot : tx_ref_.write_set_ref_) {
+      if (snapshot.update) return true;
+    }
+    return false;
+  }
+
+  bool IsCombined(const DataItem* item) {
+    return std::find(combined_items_.begin(), combined_items_.end(), item) !=
+           combined_items_.end();
+  }
+
+  /**
+   * @brief
+   * Opens the batch of a hot data item, just locked by this transaction.
+   */
+  void OpenBatch(DataItem* item) {
+    auto* batch = item->combining_batch.load();
+    if (batch == nullptr) {
+      auto* allocated = new CombiningBatch();
+      if (item->combining_batch.compare_exchange_strong(batch, allocated)) {
+        batch = allocated;
+      } else {
+        delete allocated;
+      }
+    }
+    std::lock_guard<std::mutex> guard(batch->lock);
+    batch->open  = true;
+    batch->epoch = tx_ref_.my_epoch_ref_;
+    batch->requests.clear();
+    opened_batches_.push_back(item);
+  }
+
+  /**
+   * @brief
+   * Joins the open batch of a data item locked by another transaction, if
+   * any. Since the versions of the batch are published in the epoch of the
+   * lock holder, only the transactions in the same epoch can join.
+   */
+  bool JoinBatch(DataItem* item, Snapshot& snapshot) {
+    auto* batch = item->combining_batch.load();
+    if (batch == nullptr) return false;
+    std::lock_guard<std::mutex> guard(batch->lock);
+    if (!batch->open || batch->epoch != tx_ref_.my_epoch_ref_) return false;
+    request_.snapshot = &snapshot;
+    request_.state.store(CombiningBatch::Joined);
+    batch->requests.push_back(&request_);
+    combined_items_.push_back(item);
+    joined_batch_ = batch;
+    return true;
+  }
+
+  /**
+   * @brief
+   * Tells the lock holder the result of the validation and waits for the
+   * publication, if this transaction has joined a batch. Otherwise, publishes
+   * the batches which this transaction has opened.
+   * @return false if the update of this joined transaction has been discarded
+   * by the lock holder.
+   */
+  bool CloseCombining(const bool committed) {
+    if (joined_batch_ != nullptr) {
+      // The lock holder may be validating a large transaction; block rather
+      // than spin.
+      std::unique_lock<std::mutex> guard(joined_batch_->lock);
+      request_.state.store(committed ? CombiningBatch::Committed
+                                     : CombiningBatch::Aborted);
+      joined_batch_->validated.notify_all();
+      joined_batch_->closed.wait(guard, [&]() {
+        const auto state = request_.state.load();
+        return state == CombiningBatch::Published ||
+               state == CombiningBatch::Discarded;
+      });
+      joined_batch_ = nullptr;
+      return request_.state.load() == CombiningBatch::Published;
+    }
+    for (auto* item : opened_batches_) Publish(item, committed);
+    opened_batches_.clear();
+    return true;
+  }
+
+  /**
+   * @brief
+   * Closes the batch of a data item locked by this transaction and waits for
+   * the validation of the joined transactions, which hold no locks. The
+   * updates of the committed ones are serialized after the write of this
+   * transaction: they are applied and published with their own versions if
+   * this transaction has committed, and discarded otherwise (the joined
+   * transactions abort). Then the data item is unlocked.
+   */
+  void Publish(DataItem* item, const bool committed) {
+    auto* batch = item->combining_batch.load();
+    {
+      // Likewise, the joined transactions may be validating large read sets.
+      std::unique_lock<std::mutex> guard(batch->lock);
+      batch->open = false;
+      batch->validated.wait(guard, [&]() {
+        return std::none_of(
+            batch->requests.begin(), batch->requests.end(),
+            [](const CombiningBatch::Request* request) {
+              return request->state.load() == CombiningBatch::Joined;
+            });
+      });
+    }
+    std::vector<CombiningBatch::Request*> updates;
+    for (auto* request : batch->requests) {
+      if (committed && request->state.load() == CombiningBatch::Committed) {
+        updates.push_back(request);
+      }
+    }
+
+    if (!updates.empty()) {
+      auto& write_set = tx_ref_.write_set_ref_;
+      auto& own       = *std::find_if(
+          write_set.begin(), write_set.end(),
+          [&](const Snapshot& written) { return written.index_cache == item; });
+      // The updates keep the expiration time of the value they are applied
+      // to, as #Precommit does.
+      std::byte value[ValueBufferSize];
+      size_t size = item->IsExpired() ? 0 : item->size;
+      if (size == 0) item->expires_at = 0;
+      std::memcpy(value, item->value, size);
+      const auto epoch      = tx_ref_.my_epoch_ref_;
+      const auto expires_at = item->expires_at;
+      // Each update is published with its own version, which follows the one
+      // of this transaction.
+      auto version         = DataItem::NextVersion(own.version_in_epoch, epoch);
+      own.version_in_epoch = version;
+      for (auto* request : updates) {
+        size    = request->snapshot->update(value, size, ValueBufferSize);
+        version = DataItem::NextVersion(version | 1llu, epoch);
+        request->snapshot->Reset(value, size);
+        request->snapshot->version_in_epoch = version;
+        request->snapshot->expires_at       = expires_at;
+      }
+      item->Reset(value, size);
+      item->transaction_id.store(version);
+      item->install_counter.fetch_add(1);
+      combined_items_.push_back(item);
+    }
+    {
+      std::lock_guard<std::mutex> guard(batch->lock);
+      for (auto* request : batch->requests) {
+        request->state.store(committed ? CombiningBatch::Published
+                                       : CombiningBatch::Discarded);
+      }
+    }
+    batch->closed.notify_all();
+    item->lock_contention.store(item->lock_contention.load() / 2);
+  }
+
   bool AntiDependencyValidation() {
     for (auto& validation_item : validation_set_) {
       auto* item       = validation_item.item_p_cache;
       const auto tx_id = item->transaction_id.load();
-      if (tx_id != validation_item.transaction_id) { return false; }
+      if (tx_id != validation_item.transaction_id) {
+        CollectInvalidatedReads();
+        return false;
+      }
+    }
+
+    // Absent reads of read-only transactions: a missing key is equivalent to
+    // a data item which has never been written (i.e., transaction id is 0).
+    for (auto& snapshot : tx_ref_.read_set_ref_) {
+      if (snapshot.index_cache != nullptr) continue;
+      if (!IsAbsentReadValid(snapshot)) {
+        CollectInvalidatedReads();
+        return false;
+      }
     }
     return true;
   }
 
-  bool IsOmittable() {
-    // Brief: we now just collect and snapshot the pivot version objects.
-    // Explanation: we first generate a version order << from the pivot
-    // version objects for each data item. Let t_j be this transaction. A
-    // pivot version object for x holds the pivot version x_pv, which is the
-    // landmark for ordering x_j in the version order for x: for all x_j in
-    // writeset_j, x_j < x_pv and there does not exist x_k such that x_j < x_k
-    // < x_pv. In other words, the pivot version x_pv is just after version of
-    // x_j, __in the generated version order <<__. When << fails to validate
-    // the correctness, Silo generate the another version order which includes
-    // x_pv < x_j by using exclusive locking.
+  bool IsAbsentReadValid(const Snapshot& snapshot) {
+    auto* item = tx_ref_.table_ref_.Get(snapshot.key, snapshot.key_hash);
+    return item == nullptr || item->transaction_id.load() == 0;
+  }
+
+  /**
+   * @brief
+   * Finds all the reads failing the validation, for the abort repair. Called
+   * on the failure of the validation, under the same locks.
+   */
+  void CollectInvalidatedReads() {
+    invalidated_reads_.clear();
+    if (!tx_ref_.config_ref_.enable_abort_repair) return;
+    auto& read_set = tx_ref_.read_set_ref_;
+    for (size_t position = 0; position < read_set.size(); position++) {
+      const auto* item = read_set[position].index_cache;
+      bool valid       = true;
+      if (item == nullptr) {
+        valid = IsAbsentReadValid(read_set[position]);
+      } else {
+        for (auto& validation_item : validation_set_) {
+          if (validation_item.item_p_cache != item) continue;
+          valid = item->transaction_id.load() == validation_item.transaction_id;
+          break;
+        }
+      }
+      if (!valid) invalidated_reads_.push_back(position);
+    }
+  }
+
+  /**
+   * @brief
+   * Update transactions need data items of all keys in the read set to update
+   * their pivot objects and to validate them under exclusive locks. Thus we
+   * materialize each missing key that this transaction has read, and validate
+   * that no one has written it since the read. The absent read must be in the
+   * pivot object of the key, for the omission of a later blind write into
+   * the key to detect the anti-dependency; thus it cannot be validated by
+   * probing the index as read-only transactions do.
+   * Read-only transactions never call this method and thus leave the index
+   * unchanged for missing keys.
+   */
+  void ResolveAbsentReads() {
+    for (auto& snapshot : tx_ref_.read_set_ref_) {
+      if (snapshot.index_cache != nullptr) continue;
+      auto* item =
+          tx_ref_.table_ref_.GetOrInsert(snapshot.key, snapshot.key_hash);
+      snapshot.index_cache = item;
+      validation_set_.push_back({item, 0});
+    }
+  }
+
+  /**
+   * @brief
+   * Inserts the missing keys of the write set into the index. Only the
+   * transactions acquiring the locks call this method, so that a blind write
+   * omitted by NWR neither inserts a data item nor consumes a record id.
+   */
+  void ResolveWriteSet() {
+    for (auto& snapshot : tx_ref_.write_set_ref_) {
+      if (snapshot.index_cache != nullptr) continue;
+      snapshot.index_cache =
+          tx_ref_.table_ref_.GetOrInsert(snapshot.key, snapshot.key_hash);
+    }
+  }
 
+  void SnapshotPivotObjects() {
     {  // snapshot the pivot version objects from write_set
       for (auto& snapshot : tx_ref_.write_set_ref_) {
         auto* value_ptr = snapshot.index_cache;
-        if (value_ptr == nullptr) {
-          value_ptr            = tx_ref_.table_ref_.GetOrInsert(snapshot.key);
-          snapshot.index_cache = value_ptr;
-        }
+        assert(value_ptr != nullptr);
 
         const auto pivot_object               = value_ptr->pivot_object.load();
         const PivotObjectSnapshot pv_snapshot = {value_ptr, pivot_object,
@@ -236,7 +656,40 @@ class SiloNWRTyped final : public ConcurrencyControlBase {
                                                  PivotObjectSnapshot::READSET};
         pivot_object_snapshots_.emplace_back(pv_snapshot);
       }
+      for (auto& unchanged : unchanged_reads_) {
+        auto* value_ptr                       = unchanged.item_p_cache;
+        const auto pivot_object               = value_ptr->pivot_object.load();
+        const PivotObjectSnapshot pv_snapshot = {value_ptr, pivot_object,
+                                                 PivotObjectSnapshot::READSET};
+        pivot_object_snapshots_.emplace_back(pv_snapshot);
+      }
     }
+  }
+
+  bool IsOmittable() {
+    // Brief: we now just collect and snapshot the pivot version objects.
+    // Explanation: we first generate a version order << from the pivot
+    // version objects for each data item. Let t_j be this transaction. A
+    // pivot version object for x holds the pivot version x_pv, which is the
+    // landmark for ordering x_j in the version order for x: for all x_j in
+    // writeset_j, x_j < x_pv and there does not exist x_k such that x_j < x_k
+    // < x_pv. In other words, the pivot version x_pv is just after version of
+    // x_j, __in the generated version order <<__. When << fails to validate
+    // the correctness, Silo generate the another version order which includes
+    // x_pv < x_j by using exclusive locking.
+
+    // A missing key has never been written in this epoch, and thus has no
+    // pivot version: a write into it is never omittable.
+    for (auto& snapshot : tx_ref_.write_set_ref_) {
+      if (snapshot.index_cache != nullptr) continue;
+      snapshot.index_cache =
+          tx_ref_.table_ref_.Get(snapshot.key, snapshot.key_hash);
+      if (snapshot.index_cache == nullptr) {
+        nwr_validation_result_ = NWRValidationResult::LINEARIZABILITY;
+        return false;
+      }
+    }
+    SnapshotPivotObjects();
 
     // We now validate Linearizability.
     // In short, linearizability prohibits the ordering of version orders
@@ -275,12 +728,18 @@ class SiloNWRTyped final : public ConcurrencyControlBase {
         // version for all epochs, instead of actual value of 64-bits version
         // representation.
         if (version >> 32 == current_epoch) {
-          my_pivot_object_.msets.rset.PutHigherside(value_ptr,
+          my_pivot_object_.msets.rset.PutHigherside(PivotSeed(value_ptr),
                                                     version & (~0llu >> 32));
         } else {
-          my_pivot_object_.msets.rset.PutHigherside(value_ptr, 1);
+          my_pivot_object_.msets.rset.PutHigherside(PivotSeed(value_ptr), 1);
         }
       }
+      for (auto& unchanged : unchanged_reads_) {
+        const auto version = unchanged.transaction_id;
+        my_pivot_object_.msets.rset.PutHigherside(
+            PivotSeed(unchanged.item_p_cache),
+            version >> 32 == current_epoch ? version & (~0llu >> 32) : 1);
+      }
 
       // MergedWS
       for (auto& pivot_object : pivot_object_snapshots_) {
@@ -289,7 +748,7 @@ class SiloNWRTyped final : public ConcurrencyControlBase {
         uint32_t tk           = pivot_object.pv_snapshot.versions.target_id;
         assert(pivot_object.pv_snapshot.versions.epoch == current_epoch);
 
-        my_pivot_object_.msets.wset.PutHigherside(value_ptr, tk);
+        my_pivot_object_.msets.wset.PutHigherside(PivotSeed(value_ptr), tk);
       }
     }
 
@@ -411,14 +870,31 @@ class SiloNWRTyped final : public ConcurrencyControlBase {
       for (auto& snapshot : tx_ref_.read_set_ref_) {
         const auto* value_ptr = snapshot.index_cache;
         auto version          = snapshot.version_in_epoch;
-        assert(value_ptr != nullptr);
+        if (value_ptr == nullptr) {
+          // absent read of a read-only transaction
+          assert(IsReadOnly());
+          continue;
+        }
         if (version >> 32 == current_epoch) {
-          my_pivot_object_.msets.rset.PutLowerside(value_ptr,
+          my_pivot_object_.msets.rset.PutLowerside(PivotSeed(value_ptr),
                                                    version & (~0llu >> 32));
         } else {
-          my_pivot_object_.msets.rset.PutLowerside(value_ptr, 1);
+          my_pivot_object_.msets.rset.PutLowerside(PivotSeed(value_ptr), 1);
         }
       }
+      for (auto& unchanged : unchanged_reads_) {
+        const auto version = unchanged.transaction_id;
+        my_pivot_object_.msets.rset.PutLowerside(
+            PivotSeed(unchanged.item_p_cache),
+            version >> 32 == current_epoch ? version & (~0llu >> 32) : 1);
+      }
+      // A deferred update reads the last committed version under the lock;
+      // it is regarded as the oldest one, as the versions of the other epochs.
+      for (auto& snapshot : tx_ref_.write_set_ref_) {
+        if (!snapshot.update) continue;
+        my_pivot_object_.msets.rset.PutLowerside(
+            PivotSeed(snapshot.index_cache), 1);
+      }
 
       // MergedWS
       for (auto& snapshot : tx_ref_.write_set_ref_) {
@@ -427,15 +903,14 @@ class SiloNWRTyped final : public ConcurrencyControlBase {
         auto version = snapshot.version_in_epoch;
         assert(version & 1llu);  // is locked
 
-        uint32_t new_version = version & (~0llu >> 32);
-        if (version >> 32 == current_epoch) {
-          new_version += 1;  // unlocked version
-        } else {
-          assert((version >> 32) < current_epoch);  // This tx writes new epoch
-          new_version = 2;  // the first unlocked version in this epoch
-        }
+        // The version published by #Unlock; a version of a later epoch,
+        // written by a transaction which has begun after this one, is
+        // regarded as of this epoch.
+        const uint32_t new_version =
+            DataItem::NextVersion(version, current_epoch) & (~0llu >> 32);
 
-        my_pivot_object_.msets.wset.PutHigherside(value_ptr, new_version);
+        my_pivot_object_.msets.wset.PutHigherside(PivotSeed(value_ptr),
+                                                   new_version);
       }
     }
 
@@ -448,18 +923,22 @@ class SiloNWRTyped final : public ConcurrencyControlBase {
       // in this epoch, update the pivot version.
       if (old_snapshot.versions.epoch != current_epoch &&
           snapshot.set_type == PivotObjectSnapshot::WRITESET) {
-        Snapshot* ws_entry_for_this_snapshot;
+        Snapshot* ws_entry_for_this_snapshot = nullptr;
         for (auto& ws_entry : tx_ref_.write_set_ref_) {
           if (ws_entry.index_cache != snapshot.item_p_cache) continue;
-          if (ws_entry.is_read_modify_write) break;
           ws_entry_for_this_snapshot = &ws_entry;
+          break;
         }
+        assert(ws_entry_for_this_snapshot != nullptr);
 
-        // It is the first blind write into the data item in this epoch
+        // It is the first blind write into the data item in this epoch; the
+        // pivot is the version published by #Unlock.
         auto new_snapshot = my_pivot_object_;
         assert(new_snapshot.versions.epoch == current_epoch);
         new_snapshot.versions.target_id =
-            ws_entry_for_this_snapshot->version_in_epoch & (~0llu >> 32);
+            DataItem::NextVersion(ws_entry_for_this_snapshot->version_in_epoch,
+                                  current_epoch) &
+            (~0llu >> 32);
         data_item_p->pivot_object.store(new_snapshot);
         continue;
       }
@@ -44,6 +44,39 @@ void Database::ExecuteTransaction(
     std::function<void(TxStatus)> callback) {
   db_pimpl_->ExecuteTransaction(transaction_procedure, callback);
 }
+void Database::ExecuteTransaction(
+    std::function<void(Transaction&)> transaction_procedure,
+    std::function<void(TxStatus)> callback, const DeadlineType deadline) {
+  db_pimpl_->ExecuteTransaction(transaction_procedure, callback, deadline);
+}
+void Database::ExecuteTransaction(ProcedureType proc,
+                                  OutcomeCallbackType clbk) {
+  db_pimpl_->ExecuteTransaction(proc, clbk);
+}
+void Database::ExecuteTransaction(ProcedureType proc, OutcomeCallbackType clbk,
+                                  const DeadlineType deadline) {
+  db_pimpl_->ExecuteTransaction(proc, clbk, deadline);
+}
+void Database::ExecuteResumableTransaction(ResumableProcedureType proc,
+                                           CallbackType clbk) {
+  db_pimpl_->ExecuteResumableTransaction(proc, clbk);
+}
 void Database::Fence() const noexcept { db_pimpl_->Fence(); }
+void Database::ParallelScan(ScanCallbackType clbk, const size_t threads) {
+  db_pimpl_->ParallelScan(clbk, threads);
+}
+size_t Database::Subscribe(ChangeStreamCallbackType clbk) {
+  return db_pimpl_->Subscribe(clbk);
+}
+void Database::Unsubscribe(const size_t subscription_id) {
+  db_pimpl_->Unsubscribe(subscription_id);
+}
+uint32_t Database::Backup(std::ostream& sink,
+                          const size_t max_bytes_per_second) {
+  return db_pimpl_->Backup(sink, max_bytes_per_second);
+}
+bool Database::Restore(std::istream& source) {
+  return db_pimpl_->Restore(source);
+}
 
 }  // namespace LineairDB
@@ -21,28 +21,57 @@
 #include <lineairdb/transaction.h>
 #include <lineairdb/tx_status.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
 #include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "callback/callback_manager.h"
 #include "index/concurrent_table.h"
+#include "recovery/backup_format.h"
 #include "recovery/logger.h"
 #include "thread_pool/thread_pool.h"
+#include "trace/recorder.h"
 #include "transaction_impl.h"
 #include "util/epoch_framework.hpp"
 #include "util/logger.hpp"
+#include "util/memory_placement.h"
 
 namespace LineairDB {
 class Database::Impl {
  public:
   inline static Database::Impl* CurrentDBInstance;
+  static constexpr DeadlineType NoDeadline = DeadlineType::max();
 
   Impl(const Config& c = Config())
       : config_(c),
+        trace_recorder_(c),
         thread_pool_(c.max_thread),
         logger_(c),
         callback_manager_(c),
         point_index_(c),
-        epoch_framework_(c.epoch_duration_ms, DispatchEpochIsUpdated()) {
+        epoch_framework_(EpochDuration(c), DispatchEpochIsUpdated()),
+        running_resumables_(0),
+        flush_epoch_(0),
+        stable_epoch_(0),
+        reaper_startable_(false),
+        reaper_stopped_(false),
+        reclaim_pending_(false),
+        reaped_epoch_(0),
+        reaped_generation_(0),
+        resumable_generation_(0),
+        resumables_in_generation_{0, 0} {
     if (Database::Impl::CurrentDBInstance == nullptr) {
       Database::Impl::CurrentDBInstance = this;
     } else {
@@ -51,11 +80,35 @@ class Database::Impl {
           "the same time.");
       exit(1);
     }
+    if (config_.enable_per_worker_arenas) { BindWorkersToArenas(); }
     if (config_.enable_recovery) { Recovery(); }
+    if (!config_.shared_memory_segment.empty()) {
+      // The segment may hold the expiring data items of earlier instances.
+      point_index_.ForEachInParallel(
+          [&](const std::string_view key, const DataItem* item) {
+            if (item->expires_at != 0) {
+              NotifyExpiringWrite(key, item->expires_at);
+            }
+          },
+          1);
+    }
+    thread_pool_.SetNotificationHandler([&]() { ProcessEpochUpdates(); });
     epoch_framework_.Start();
+    // The reaper refers the epochs; the recovered data items are reaped now.
+    std::lock_guard<std::mutex> lock(reaper_lock_);
+    reaper_startable_ = true;
+    if (!expiring_writes_.empty()) StartReaper();
   };
 
   ~Impl() {
+    {
+      std::lock_guard<std::mutex> lock(reaper_lock_);
+      reaper_stopped_ = true;
+    }
+    reaper_wakeup_.notify_one();
+    if (reaper_.joinable()) reaper_.join();
+    // Suspended transactions need the workers to resume.
+    while (running_resumables_.load() != 0) { std::this_thread::yield(); }
     thread_pool_.StopAcceptingTransactions();
     epoch_framework_.Sync();
     epoch_framework_.Stop();
@@ -69,64 +122,660 @@ class Database::Impl {
     Database::Impl::CurrentDBInstance = nullptr;
   };
 
-  void ExecuteTransaction(ProcedureType proc, CallbackType clbk) {
-    for (;;) {
-      bool success = thread_pool_.Enqueue([&, transaction_procedure = proc,
-                                           callback = clbk]() {
-        epoch_framework_.MakeMeOnline();
-
-        Transaction tx(this);
+  void ExecuteTransaction(ProcedureType proc, CallbackType clbk,
+                          const DeadlineType deadline = NoDeadline) {
+    EnqueueTransaction(std::move(proc), std::move(clbk), deadline, nullptr);
+  }
 
-        transaction_procedure(tx);
-        bool committed = tx.Precommit();
-
-        if (committed) {
-          if (!config_.enable_logging) { tx.tx_pimpl_->write_set_.clear(); }
-          const auto current_epoch = epoch_framework_.GetMyThreadLocalEpoch();
-          logger_.Enqueue(tx.tx_pimpl_->write_set_, current_epoch);
-          callback_manager_.Enqueue(std::move(callback), current_epoch);
-        } else {
-          callback(LineairDB::TxStatus::Aborted);
-        }
+  void ExecuteTransaction(ProcedureType proc, OutcomeCallbackType clbk,
+                          const DeadlineType deadline = NoDeadline) {
+    auto record          = std::make_shared<OutcomeRecord>();
+    record->submitted_at = std::chrono::steady_clock::now();
+    EnqueueTransaction(
+        std::move(proc),
+        [record, callback = std::move(clbk)](const TxStatus status) {
+          record->outcome.status = status;
+          callback(record->outcome);
+        },
+        deadline, record);
+  }
 
-        epoch_framework_.MakeMeOffline();
-      });
-      if (success) break;
-    }
+  void ExecuteResumableTransaction(ResumableProcedureType proc,
+                                   CallbackType clbk) {
+    running_resumables_++;
+    const size_t generation = resumable_generation_.load() % 2;
+    resumables_in_generation_[generation]++;
+    ScheduleStep(std::make_shared<ResumableTransaction>(
+        std::move(proc), std::move(clbk), generation));
   }
 
   const EpochNumber& GetMyThreadLocalEpoch() {
     return epoch_framework_.GetMyThreadLocalEpoch();
   }
 
+  // Called on the writes with TTLs, which the reaper visits once they have
+  // expired; the first one starts the reaper.
+  void NotifyExpiringWrite(const std::string_view key,
+                           const uint64_t expires_at) {
+    if (config_.expiration_reaper_interval_ms == 0) return;
+    std::lock_guard<std::mutex> lock(reaper_lock_);
+    if (reaper_stopped_) return;
+    if (reaper_startable_ && !reaper_.joinable()) StartReaper();
+    if (expiring_writes_.empty()) reaper_wakeup_.notify_one();
+    expiring_writes_.emplace_back(expires_at, key);
+  }
+
   void Fence() {
+    while (running_resumables_.load() != 0) { std::this_thread::yield(); }
     epoch_framework_.Sync();
     thread_pool_.WaitForQueuesToBecomeEmpty();
     callback_manager_.WaitForAllCallbacksToBeExecuted();
   }
+  void ParallelScan(Database::ScanCallbackType clbk, const size_t threads) {
+    point_index_.ForEachInParallel(
+        [&](const std::string_view key, const DataItem* item) {
+          std::byte buffer[ValueBufferSize];
+          size_t size = 0;
+          item->CopyStableVersion(buffer, size);
+          if (size == 0) return;  // inserted but not yet written
+          clbk(key, {buffer, size});
+        },
+        threads);
+  }
+  size_t Subscribe(Database::ChangeStreamCallbackType clbk) {
+    if (!config_.enable_logging) {
+      SPDLOG_ERROR(
+          "The change stream is provided by the logger. Please enable logging "
+          "to subscribe it.");
+      return 0;
+    }
+    // Writes in the current epoch may have been logged without keys.
+    return logger_.Subscribe(std::move(clbk),
+                             epoch_framework_.GetGlobalEpoch() + 1);
+  }
+  void Unsubscribe(const size_t subscription_id) {
+    logger_.Unsubscribe(subscription_id);
+  }
+  EpochNumber Backup(std::ostream& sink, const size_t max_bytes_per_second) {
+    namespace Format = Recovery::Backup;
+    if (!config_.enable_logging) {
+      SPDLOG_ERROR(
+          "The log tail of a backup is provided by the logger. Please enable "
+          "logging to take backups.");
+      return 0;
+    }
+
+    // The log tail: changes of the epochs which may be committed during the
+    // snapshot. It is spilled into a temporary file, since the snapshot of a
+    // large database takes long. Epochs delivered before from_epoch is set
+    // are ignored since the snapshot covers them.
+    std::unique_ptr<std::FILE, decltype(&std::fclose)> tail(std::tmpfile(),
+                                                            &std::fclose);
+    if (tail == nullptr) {
+      SPDLOG_ERROR("Backup Error: fail to create the log tail. errno: {0}",
+                   errno);
+      return 0;
+    }
+    std::mutex tail_lock;
+    std::vector<std::pair<EpochNumber, long>> tail_ends;  // offset per epoch
+    bool tail_failed = false;
+    std::atomic<EpochNumber> from_epoch(EpochFramework::THREAD_OFFLINE);
+    const size_t subscription = logger_.Subscribe(
+        [&](const EpochNumber epoch,
+            const std::vector<Database::Change>& changes) {
+          if (epoch < from_epoch.load()) return;
+          std::string record;
+          Format::Append(record, Format::RecordType::Epoch);
+          Format::Append<uint32_t>(record, epoch);
+          Format::Append<uint32_t>(record, changes.size());
+          for (auto& change : changes) {
+            Format::AppendKeyValue(record, change.key, change.value,
+                                   change.size, change.expires_at);
+          }
+          std::lock_guard<std::mutex> lock(tail_lock);
+          if (std::fwrite(record.data(), 1, record.size(), tail.get()) !=
+              record.size()) {
+            tail_failed = true;
+          }
+          tail_ends.emplace_back(epoch, std::ftell(tail.get()));
+        },
+        0);
+    // Writes are captured with their keys since the next epoch; the snapshot
+    // starts after all transactions of the earlier epochs have finished.
+    from_epoch.store(epoch_framework_.GetGlobalEpoch() + 1);
+    while (epoch_framework_.GetGlobalEpoch() <= from_epoch.load()) {
+      epoch_framework_.Sync();
+    }
+
+    // The snapshot is spilled into a temporary file as well, and copied into
+    // the sink after the scan: the scan keeps the old tables and the erased
+    // nodes of the index alive until it finishes, and thus is not throttled.
+    std::unique_ptr<std::FILE, decltype(&std::fclose)> snapshot(
+        std::tmpfile(), &std::fclose);
+    if (snapshot == nullptr) {
+      logger_.Unsubscribe(subscription);
+      SPDLOG_ERROR("Backup Error: fail to create the snapshot. errno: {0}",
+                   errno);
+      return 0;
+    }
+    std::string buffer;
+    bool snapshot_failed = false;
+    auto spill           = [&]() {
+      if (std::fwrite(buffer.data(), 1, buffer.size(), snapshot.get()) !=
+          buffer.size()) {
+        snapshot_failed = true;
+      }
+      buffer.clear();
+    };
+    point_index_.ForEachInParallel(
+        [&](const std::string_view key, const DataItem* item) {
+          std::byte value[ValueBufferSize];
+          size_t size         = 0;
+          uint64_t expires_at = 0;
+          item->CopyStableVersion(value, size, &expires_at);
+          if (size == 0) return;  // inserted but not yet written, or expired
+          Format::Append(buffer, Format::RecordType::Item);
+          Format::AppendKeyValue(buffer, key, value, size, expires_at);
+          if (BackupChunkSize <= buffer.size()) spill();
+        },
+        1);
+    spill();
+    const long snapshot_size = std::ftell(snapshot.get());
+
+    // Every item visited by the scan has been written in this epoch or
+    // earlier.
+    const EpochNumber backup_epoch = epoch_framework_.GetGlobalEpoch();
+    logger_.WaitForChangeDelivery(backup_epoch);
+    logger_.Unsubscribe(subscription);
+    long tail_size = 0;
+    for (auto& [epoch, end] : tail_ends) {
+      if (backup_epoch < epoch) break;
+      tail_size = end;
+    }
+
+    size_t written        = 0;
+    const auto started_at = std::chrono::steady_clock::now();
+    auto flush            = [&]() {
+      sink.write(buffer.data(), buffer.size());
+      written += buffer.size();
+      buffer.clear();
+      if (max_bytes_per_second == 0) return;
+      const std::chrono::duration<double> expected(
+          static_cast<double>(written) / max_bytes_per_second);
+      std::this_thread::sleep_until(
+          started_at +
+          std::chrono::duration_cast<std::chrono::nanoseconds>(expected));
+    };
+    // Copies the first given bytes of a temporary file into the sink.
+    auto copy = [&](std::FILE* file, long size) {
+      std::rewind(file);
+      while (0 < size) {
+        buffer.resize(std::min<long>(size, BackupChunkSize));
+        if (std::fread(buffer.data(), 1, buffer.size(), file) !=
+            buffer.size()) {
+          return false;
+        }
+        size -= buffer.size();
+        flush();
+      }
+      return true;
+    };
+
+    Format::AppendHeader(buffer);
+    flush();
+    if (snapshot_failed || !copy(snapshot.get(), snapshot_size)) {
+      SPDLOG_ERROR("Backup Error: fail to buffer the snapshot. errno: {0}",
+                   errno);
+      return 0;
+    }
+    if (tail_failed || !copy(tail.get(), tail_size)) {
+      SPDLOG_ERROR("Backup Error: fail to buffer the log tail. errno: {0}",
+                   errno);
+      return 0;
+    }
+    Format::Append(buffer, Format::RecordType::End);
+    Format::Append<uint32_t>(buffer, backup_epoch);
+    flush();
+    sink.flush();
+    return sink.good() ? backup_epoch : 0;
+  }
+  bool Restore(std::istream& source) {
+    namespace Format = Recovery::Backup;
+    if (!Format::ReadHeader(source)) return false;
+
+    std::vector<BackupItem> items;
+    std::string key;
+    std::vector<std::byte> value;
+    uint64_t expires_at;
+    for (;;) {
+      Format::RecordType type;
+      if (!Format::Read(source, type)) break;
+      if (type == Format::RecordType::Item) {
+        if (!Format::ReadKeyValue(source, key, value, expires_at)) break;
+        // Values which have expired since the backup are not restored.
+        if (DataItem::IsExpired(expires_at)) continue;
+        items.push_back({key, value, expires_at});
+        if (RestoreChunkSize <= items.size()) ApplyWrites(items);
+        continue;
+      }
+      // Changes in the log tail overwrite the items.
+      ApplyWrites(items);
+      uint32_t epoch, changes;
+      if (!Format::Read(source, epoch)) return false;
+      if (type == Format::RecordType::End) return true;
+      if (type != Format::RecordType::Epoch) return false;
+      if (!Format::Read(source, changes)) return false;
+      // Changes of each key are in the order of the commits; only the last
+      // one is applied. An expired one still overwrites the item.
+      std::unordered_map<std::string, BackupItem> coalesced;
+      for (uint32_t i = 0; i < changes; i++) {
+        if (!Format::ReadKeyValue(source, key, value, expires_at)) {
+          return false;
+        }
+        coalesced[key] = {key, value, expires_at};
+      }
+      for (auto& entry : coalesced) items.push_back(std::move(entry.second));
+      ApplyWrites(items);
+    }
+    ApplyWrites(items);
+    return false;
+  }
   const Config& GetConfig() const { return config_; }
   Index::ConcurrentTable& GetPointIndex() { return point_index_; }
+  Trace::Recorder& GetTraceRecorder() { return trace_recorder_; }
 
   /**
    * NOTE: Called by a special thread managed by EpochFramework.
    */
   std::function<void(EpochNumber)> DispatchEpochIsUpdated() {
     return [&](EpochNumber old_epoch) {
-      // Logging
+      // Workers flush their logs and execute their callbacks by themselves
+      // when they are notified; see #ProcessEpochUpdates.
       if (config_.enable_logging) {
-        thread_pool_.EnqueueForAllThreads(
-            [&, old_epoch]() { logger_.FlushLogs(old_epoch); });
-
+        flush_epoch_.store(old_epoch);
         EpochNumber durable_epoch = logger_.FlushDurableEpoch();
-        if (durable_epoch == Recovery::Logger::NumberIsNotUpdated) { return; }
+        if (durable_epoch == Recovery::Logger::NumberIsNotUpdated) {
+          thread_pool_.NotifyAllThreads();
+          return;
+        }
       }
-      // Execute Callbacks
-      thread_pool_.EnqueueForAllThreads(
-          [&, old_epoch]() { callback_manager_.ExecuteCallbacks(old_epoch); });
+      stable_epoch_.store(old_epoch);
+      thread_pool_.NotifyAllThreads();
     };
   }
 
+  /**
+   * NOTE: Called by each worker thread, between its jobs, after the epoch is
+   * updated. Both steps are idempotent and thus the updates a worker has
+   * missed are covered by the latest one.
+   */
+  void ProcessEpochUpdates() {
+    if (config_.enable_logging) {
+      const EpochNumber flush_epoch = flush_epoch_.load();
+      if (flush_epoch != 0) logger_.FlushLogs(flush_epoch);
+    }
+    const EpochNumber stable_epoch = stable_epoch_.load();
+    if (stable_epoch != 0) callback_manager_.ExecuteCallbacks(stable_epoch);
+  }
+
+  static EpochFramework::Duration EpochDuration(const Config& c) {
+    if (0 < c.epoch_duration_us) {
+      return std::chrono::microseconds(c.epoch_duration_us);
+    }
+    return std::chrono::milliseconds(c.epoch_duration_ms);
+  }
+
  private:
+  // A data item read from a backup; see Recovery::Backup.
+  struct BackupItem {
+    std::string key;
+    std::vector<std::byte> value;
+    uint64_t expires_at;
+  };
+  static constexpr size_t BackupChunkSize  = 64 * 1024;
+  static constexpr size_t RestoreChunkSize = 64 * 1024;
+  static constexpr size_t RestoreBatchSize = 256;
+  static constexpr size_t ReapBatchSize    = 65536;
+
+  /**
+   * Writes the given items by transactions of RestoreBatchSize writes, retries
+   * the aborted ones, and clears the items.
+   */
+  void ApplyWrites(std::vector<BackupItem>& writes) {
+    std::vector<size_t> pending;
+    for (size_t from = 0; from < writes.size(); from += RestoreBatchSize) {
+      pending.push_back(from);
+    }
+    while (!pending.empty()) {
+      std::mutex aborted_lock;
+      std::vector<size_t> aborted;
+      for (auto from : pending) {
+        ExecuteTransaction(
+            [&, from](Transaction& tx) {
+              const size_t to =
+                  std::min(writes.size(), from + RestoreBatchSize);
+              for (size_t i = from; i < to; i++) {
+                // NOTE: the backup may contain the keys of blobs, which
+                // Transaction::Write rejects.
+                tx.tx_pimpl_->Write(writes[i].key, writes[i].value.data(),
+                                    writes[i].value.size(),
+                                    writes[i].expires_at);
+              }
+            },
+            [&, from](const TxStatus status) {
+              if (status == TxStatus::Committed) return;
+              std::lock_guard<std::mutex> lock(aborted_lock);
+              aborted.push_back(from);
+            });
+      }
+      Fence();
+      pending = std::move(aborted);
+    }
+    writes.clear();
+  }
+
+  /**
+   * The outcome of a transaction executed with OutcomeCallbackType, filled
+   * while it runs.
+   */
+  struct OutcomeRecord {
+    TxOutcome outcome{};
+    std::chrono::steady_clock::time_point submitted_at;
+    std::chrono::steady_clock::time_point started_at;
+  };
+
+  void EnqueueTransaction(ProcedureType&& proc, CallbackType&& clbk,
+                          const DeadlineType deadline,
+                          std::shared_ptr<OutcomeRecord> record) {
+    const uint64_t submitted_ns =
+        trace_recorder_.IsEnabled() ? trace_recorder_.Now() : 0;
+    for (;;) {
+      auto job = [&, transaction_procedure = proc, callback = clbk, deadline,
+                  submitted_ns, record]() {
+        trace_recorder_.Begin(submitted_ns);
+        if (record != nullptr) {
+          record->started_at = std::chrono::steady_clock::now();
+          record->outcome.queue_wait_ns =
+              ElapsedNanoseconds(record->submitted_at, record->started_at);
+        }
+        if (deadline != NoDeadline &&
+            deadline < std::chrono::steady_clock::now()) {
+          if (record != nullptr) {
+            record->outcome.abort_reason = TxOutcome::DeadlineExceeded;
+          }
+          trace_recorder_.End(LineairDB::TxStatus::Aborted);
+          callback(LineairDB::TxStatus::Aborted);
+          return;
+        }
+        epoch_framework_.MakeMeOnline();
+
+        Transaction tx(this);
+        tx.tx_pimpl_->deadline_ = deadline;
+
+        transaction_procedure(tx);
+        CompleteTransaction(tx, callback, record.get());
+
+        epoch_framework_.MakeMeOffline();
+      };
+      bool success = deadline == NoDeadline
+                         ? thread_pool_.Enqueue(job)
+                         : thread_pool_.Enqueue(job, deadline);
+      if (success) break;
+    }
+  }
+
+  static uint64_t ElapsedNanoseconds(
+      const std::chrono::steady_clock::time_point from,
+      const std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from)
+        .count();
+  }
+
+  /**
+   * Precommits the transaction of which the procedure has finished, and
+   * dispatches the callback. Called by an online worker.
+   * @param record The outcome to be filled; nullptr if not recorded.
+   */
+  void CompleteTransaction(Transaction& tx, const CallbackType& callback,
+                           OutcomeRecord* record = nullptr) {
+    if (record != nullptr) {
+      // The write set of an omitted transaction is cleared by the precommit.
+      record->outcome.read_set_size  = tx.tx_pimpl_->read_set_.size();
+      record->outcome.write_set_size = tx.tx_pimpl_->write_set_.size();
+    }
+    bool committed = tx.Precommit();
+    if (record != nullptr) RecordOutcome(*record, tx, committed);
+    if (tx.tx_pimpl_->traced_) {
+      trace_recorder_.End(committed ? LineairDB::TxStatus::Committed
+                                    : LineairDB::TxStatus::Aborted);
+    }
+
+    if (committed) {
+      // Non-durable transactions skip only the logger. Their commits are
+      // still acknowledged at the end of the epoch: with NWR, a transaction
+      // may be serialized before the others of the same epoch.
+      if (!config_.enable_logging || !tx.tx_pimpl_->durable_) {
+        tx.tx_pimpl_->write_set_.clear();
+      }
+      const auto current_epoch = epoch_framework_.GetMyThreadLocalEpoch();
+      logger_.Enqueue(tx.tx_pimpl_->write_set_, current_epoch);
+      callback_manager_.Enqueue(callback, current_epoch);
+    } else {
+      callback(LineairDB::TxStatus::Aborted);
+    }
+  }
+
+  void RecordOutcome(OutcomeRecord& record, Transaction& tx,
+                     const bool committed) {
+    auto& outcome  = record.outcome;
+    auto& tx_pimpl = *tx.tx_pimpl_;
+    auto& protocol = *tx_pimpl.concurrency_control_;
+
+    outcome.execution_ns = ElapsedNanoseconds(
+        record.started_at, std::chrono::steady_clock::now());
+
+    switch (protocol.GetNWRValidationResult()) {
+      case NWRValidationResult::ACYCLIC:
+        outcome.nwr_result = TxOutcome::Omitted;
+        break;
+      case NWRValidationResult::RW:
+        outcome.nwr_result = TxOutcome::RWDependency;
+        break;
+      case NWRValidationResult::WR:
+        outcome.nwr_result = TxOutcome::WRDependency;
+        break;
+      case NWRValidationResult::ANTI_DEPENDENCY:
+        outcome.nwr_result = TxOutcome::AntiDependency;
+        break;
+      case NWRValidationResult::LINEARIZABILITY:
+        outcome.nwr_result = TxOutcome::NotLinearizable;
+        break;
+      default:
+        outcome.nwr_result = TxOutcome::NotValidated;
+        break;
+    }
+
+    outcome.combined = protocol.HasJoinedBatch();
+    if (committed) {
+      outcome.abort_reason = TxOutcome::NotAborted;
+      outcome.epoch        = epoch_framework_.GetMyThreadLocalEpoch();
+    } else if (tx_pimpl.user_aborted_) {
+      outcome.abort_reason = TxOutcome::UserAbort;
+    } else if (protocol.IsTimedOut()) {
+      outcome.abort_reason = TxOutcome::DeadlineExceeded;
+    } else {
+      outcome.abort_reason = TxOutcome::ValidationFailure;
+    }
+  }
+
+  /**
+   * A resumable transaction lives on the heap across its steps. Each step
+   * runs on an online worker; between the steps the transaction is offline
+   * and holds no locks (Silo acquires them only in the precommit), and
+   * thus it never stalls the epoch. The read set is validated at the
+   * precommit as usual, in the epoch of the last step.
+   */
+  struct ResumableTransaction {
+    // Constructed by the first step, on a worker thread, since it refers the
+    // epoch of the thread; see #RunStep.
+    std::unique_ptr<Transaction, void (*)(Transaction*)> tx;
+    ResumableProcedureType procedure;
+    CallbackType callback;
+    // Incremented by both the suspended step and the resume function; the
+    // later one schedules the next step, so that a step never runs while the
+    // previous one is still returning.
+    std::atomic<size_t> handoff;
+    // See #resumables_in_generation_.
+    const size_t generation;
+
+    ResumableTransaction(ResumableProcedureType&& proc, CallbackType&& clbk,
+                         const size_t gen)
+        : tx(nullptr, [](Transaction* t) { delete t; }),
+          procedure(std::move(proc)),
+          callback(std::move(clbk)),
+          handoff(0),
+          generation(gen) {}
+  };
+
+  void ScheduleStep(std::shared_ptr<ResumableTransaction> rtx) {
+    while (!thread_pool_.Enqueue([&, rtx]() { RunStep(rtx); })) {}
+  }
+
+  void RunStep(const std::shared_ptr<ResumableTransaction>& rtx) {
+    epoch_framework_.MakeMeOnline();
+    if (rtx->tx == nullptr) rtx->tx.reset(new Transaction(this));
+    auto& tx_pimpl   = *rtx->tx->tx_pimpl_;
+    tx_pimpl.epoch_  = epoch_framework_.GetMyThreadLocalEpoch();
+    tx_pimpl.traced_ = false;
+    rtx->handoff.store(0);
+
+    const bool finished = rtx->procedure(*rtx->tx, [&, rtx]() {
+      if (rtx->handoff.fetch_add(1) == 1) ScheduleStep(rtx);
+    });
+    if (!finished) {
+      epoch_framework_.MakeMeOffline();
+      if (rtx->handoff.fetch_add(1) == 1) ScheduleStep(rtx);
+      return;
+    }
+
+    CompleteTransaction(*rtx->tx, rtx->callback);
+    epoch_framework_.MakeMeOffline();
+    resumables_in_generation_[rtx->generation]--;
+    running_resumables_--;
+  }
+
+  // The caller must hold reaper_lock_.
+  void StartReaper() {
+    reaper_ = std::thread([&]() { ReaperJob(); });
+  }
+
+  /**
+   * NOTE: Called by the reaper thread, which reaps every
+   * Config::expiration_reaper_interval_ms while it has any key to visit or
+   * any data item to reclaim, and otherwise sleeps until a write with a TTL.
+   */
+  void ReaperJob() {
+    const auto interval =
+        std::chrono::milliseconds(config_.expiration_reaper_interval_ms);
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(reaper_lock_);
+        if (expiring_keys_.empty() && !reclaim_pending_) {
+          reaper_wakeup_.wait(lock, [&]() {
+            return reaper_stopped_ || !expiring_writes_.empty();
+          });
+        }
+        reaper_wakeup_.wait_for(lock, interval,
+                                [&]() { return reaper_stopped_; });
+        if (reaper_stopped_) return;
+        for (auto& write : expiring_writes_) {
+          expiring_keys_.push(std::move(write));
+        }
+        expiring_writes_.clear();
+      }
+      Reap();
+    }
+  }
+
+  /**
+   * Reclaims the data items removed by the previous call, if no transaction
+   * can refer them anymore, and then removes a batch of expired data items
+   * from the index, visiting the keys whose writes have expired by now.
+   * Each one is locked as a writer does, to exclude the committing writers,
+   * and unlocked with a new version of the current epoch, as a commit does,
+   * so that the reads and the expected versions of the expired value fail
+   * the validation and look up the key again. The removal changes no value
+   * visible to transactions and thus is not logged; recovery skips the
+   * expired values by their logged expiration times.
+   */
+  void Reap() {
+    if (reclaim_pending_) {
+      // Transactions may refer the removed data items until the epoch has
+      // advanced twice; suspended resumable transactions, until they finish.
+      if (epoch_framework_.GetGlobalEpoch() < reaped_epoch_ + 2 ||
+          resumables_in_generation_[reaped_generation_].load() != 0) {
+        return;
+      }
+      point_index_.ReclaimErased();
+      reclaim_pending_ = false;
+    }
+
+    const auto now = DataItem::Now();
+    std::vector<ExpiringKey> locked;
+    size_t reaped = 0;
+    for (size_t i = 0; i < ReapBatchSize && !expiring_keys_.empty() &&
+                       expiring_keys_.top().first <= now;
+         i++) {
+      auto expiring = expiring_keys_.top();
+      expiring_keys_.pop();
+      const auto& key   = expiring.second;
+      const size_t hash = Util::HashKey(key);
+      auto* item        = point_index_.Get(key, hash);
+      if (item == nullptr) continue;
+      // A locked data item is left to the next batch.
+      auto current = item->transaction_id.load();
+      if ((current & 1llu) || !item->transaction_id.compare_exchange_strong(
+                                  current, current | 1llu)) {
+        locked.push_back(std::move(expiring));
+        continue;
+      }
+      // Rewritten since the write (or aborted): a later write with a TTL is
+      // visited by itself.
+      if (!item->IsExpired()) {
+        item->transaction_id.store(current);
+        continue;
+      }
+      item->reaped.store(true);
+      point_index_.Erase(key, hash, item);
+      item->transaction_id.store(DataItem::NextVersion(
+          current | 1llu, epoch_framework_.GetGlobalEpoch()));
+      reaped++;
+    }
+    for (auto& expiring : locked) expiring_keys_.push(std::move(expiring));
+    if (reaped == 0) return;
+
+    // Resumable transactions starting from now on are counted separately,
+    // since they never refer the removed data items.
+    reaped_epoch_      = epoch_framework_.GetGlobalEpoch();
+    reaped_generation_ = resumable_generation_.fetch_add(1) % 2;
+    reclaim_pending_   = true;
+  }
+
+  void BindWorkersToArenas() {
+    std::atomic<size_t> worker_id(0);
+    std::atomic<bool> bound(true);
+    thread_pool_.EnqueueForAllThreads([&]() {
+      if (!Util::BindThisThreadToArena(worker_id.fetch_add(1))) {
+        bound.store(false);
+      }
+    });
+    thread_pool_.WaitForQueuesToBecomeEmpty();
+    if (!bound.load()) {
+      SPDLOG_WARN(
+          "Per-worker arenas are not available; the default arenas are used.");
+    }
+  }
+
   void Recovery() {
     SPDLOG_INFO("Start recovery process");
     // Start recovery from logfiles
@@ -141,14 +790,38 @@ class Database::Impl {
     thread_pool_.WaitForQueuesToBecomeEmpty();
 
     highest_epoch = std::max(highest_epoch, durable_epoch);
-    auto&& recovery_set =
-        Recovery::Logger::GetRecoverySetFromLogs(durable_epoch);
-    for (auto& entry : recovery_set) {
-      highest_epoch =
-          std::max(highest_epoch,
-                   static_cast<EpochNumber>(entry.version_in_epoch >> 32));
+    // Each group of log files is replayed into the index by a worker,
+    // without coordination with the others.
+    const auto groups = Recovery::Logger::GetLogFileGroups();
+    std::vector<EpochNumber> highest_epochs(groups.size(), highest_epoch);
+    std::atomic<size_t> replayed_groups(0);
+    for (size_t i = 0; i < groups.size(); i++) {
+      while (!thread_pool_.Enqueue([&, i]() {
+        uint64_t highest_record_id;
+        auto&& recovery_set = Recovery::Logger::GetRecoverySetFromLogs(
+            durable_epoch, groups[i], highest_record_id);
+        // The ids of the records dropped by the recovery (e.g., expired ones)
+        // remain in the logs, and must not be given to new data items.
+        point_index_.ReserveRecordIds(highest_record_id);
+        for (auto& entry : recovery_set) {
+          highest_epochs[i] = std::max(
+              highest_epochs[i],
+              static_cast<EpochNumber>(entry.version_in_epoch >> 32));
 
-      point_index_.Put(entry.key, entry.index_cache);
+          if (entry.index_cache->expires_at != 0) {
+            NotifyExpiringWrite(entry.key, entry.index_cache->expires_at);
+          }
+          point_index_.Put(entry.key, entry.key_hash, entry.index_cache);
+        }
+        replayed_groups++;
+      })) {}
+    }
+    // NOTE: empty queues do not mean that the jobs have finished.
+    while (replayed_groups.load() != groups.size()) {
+      std::this_thread::yield();
+    }
+    for (auto epoch : highest_epochs) {
+      highest_epoch = std::max(highest_epoch, epoch);
     }
     SPDLOG_DEBUG("  Global epoch is resumed from {0}", highest_epoch);
     epoch_framework_.SetGlobalEpoch(highest_epoch);
@@ -157,11 +830,39 @@ class Database::Impl {
 
  private:
   Config config_;
+  // NOTE: declared before (i.e., destroyed after) the thread pool.
+  Trace::Recorder trace_recorder_;
   ThreadPool thread_pool_;
   Recovery::Logger logger_;
   Callback::CallbackManager callback_manager_;
   Index::ConcurrentTable point_index_;
   EpochFramework epoch_framework_;
+  std::atomic<size_t> running_resumables_;
+  // The epochs published to the workers by #DispatchEpochIsUpdated.
+  std::atomic<EpochNumber> flush_epoch_;
+  std::atomic<EpochNumber> stable_epoch_;
+
+  // The reaper; see #Reap. The keys written with TTLs are handed over from
+  // the writers to the reaper, which orders them by the expiration times.
+  using ExpiringKey = std::pair<uint64_t, std::string>;
+  std::thread reaper_;  // started by #NotifyExpiringWrite
+  std::mutex reaper_lock_;
+  std::condition_variable reaper_wakeup_;
+  bool reaper_startable_;                     // guarded by reaper_lock_
+  bool reaper_stopped_;                       // guarded by reaper_lock_
+  std::vector<ExpiringKey> expiring_writes_;  // guarded by reaper_lock_
+  // Used by only the reaper thread.
+  std::priority_queue<ExpiringKey, std::vector<ExpiringKey>,
+                      std::greater<ExpiringKey>>
+      expiring_keys_;
+  bool reclaim_pending_;
+  EpochNumber reaped_epoch_;
+  size_t reaped_generation_;
+  // Resumable transactions are counted by the generations, which the reaper
+  // advances whenever it removes data items; the ones in the older
+  // generation may refer the removed data items.
+  std::atomic<size_t> resumable_generation_;
+  std::atomic<size_t> resumables_in_generation_[2];
 
 };  // namespace LineairDB
 
@@ -18,6 +18,7 @@
 #define LINEAIRDB_CONCURRENT_POINT_INDEX_BASE_H
 
 #include <functional>
+#include <memory>
 #include <string_view>
 
 #include "types.h"
@@ -25,14 +26,55 @@
 namespace LineairDB {
 namespace Index {
 
+/**
+ * @brief
+ * Interface of concurrent point indexes. An index owns the data items stored
+ * in it: #Put takes the ownership of the given item and #Clear deletes them.
+ */
 class ConcurrentPointIndexBase {
  public:
   virtual ~ConcurrentPointIndexBase() {}
-  virtual DataItem* Get(const std::string_view key)                     = 0;
-  virtual bool Put(const std::string_view key, const DataItem* const v) = 0;
+  /**
+   * @param hash Util::HashKey(key), which the caller has computed once.
+   */
+  virtual DataItem* Get(const std::string_view key, const size_t hash) = 0;
+  /**
+   * @return the data item stored in the index for the key, which may differ
+   * from the given one when the index embeds data items into its nodes;
+   * nullptr if an entry already exists (the given item is deleted).
+   */
+  virtual DataItem* Put(const std::string_view key, const size_t hash,
+                        std::unique_ptr<DataItem> v) = 0;
+  /**
+   * @brief
+   * Inserts a new data item, which has never been written, with the given
+   * record id. An index embedding data items builds it in the node.
+   * @return the inserted data item; nullptr if an entry already exists.
+   */
+  virtual DataItem* Emplace(const std::string_view key, const size_t hash,
+                            const uint64_t record_id) = 0;
   virtual void ForAllWithExclusiveLock(
-      std::function<void(const std::string_view, const DataItem*)> f) = 0;
-  virtual void Clear()                                                = 0;
+      std::function<void(const std::string_view, DataItem*)> f) = 0;
+  virtual void ForEachInParallel(
+      std::function<void(const std::string_view, const DataItem*)> f,
+      const size_t concurrency) = 0;
+  /**
+   * @brief
+   * Removes the entry of the key if it refers the given item. The item is
+   * not deleted until #ReclaimErased, since concurrent threads may still
+   * refer it.
+   * @return false if the key does not refer the item.
+   */
+  virtual bool Erase(const std::string_view key, const size_t hash,
+                     const DataItem* const v) = 0;
+  /**
+   * @brief
+   * Deletes the items erased so far, after the lookups and the parallel
+   * scans which may have found them have finished. The caller must ensure
+   * that nobody else refers them.
+   */
+  virtual void ReclaimErased() = 0;
+  virtual void Clear()         = 0;
 };
 }  // namespace Index
 }  // namespace LineairDB
@@ -19,64 +19,128 @@
 #include <lineairdb/config.h>
 
 #include <functional>
+#include <memory>
 
 #include "impl/mpmc_concurrent_set_impl.h"
+#include "impl/mpmc_shared_concurrent_set_impl.h"
 #include "types.h"
+#include "util/hash.h"
+#include "util/logger.hpp"
 
 namespace LineairDB {
 namespace Index {
 
-ConcurrentTable::ConcurrentTable(Config config, WriteSetType recovery_set) {
-  switch (config.concurrent_point_index) {
-    case Config::ConcurrentPointIndex::MPMCConcurrentHashSet:
-      container_ = std::make_unique<MPMCConcurrentSetImpl>();
-      break;
-    default:
-      container_ = std::make_unique<MPMCConcurrentSetImpl>();
-      break;
+ConcurrentTable::ConcurrentTable(Config config, WriteSetType recovery_set)
+    : next_record_id_(1), shared_(!config.shared_memory_segment.empty()) {
+  if (shared_) {
+    if (config.enable_flat_combining) {
+      SPDLOG_ERROR(
+          "Flat combining is not supported with a shared memory segment.");
+      exit(EXIT_FAILURE);
+    }
+    container_ = std::make_unique<MPMCSharedConcurrentSetImpl>(
+        config.shared_memory_segment, config.shared_memory_size);
+    // The segment may hold the data items of earlier instances. Their keys
+    // must be logged again if Recovery::Logger removes the earlier logs.
+    const bool logs_removed = config.enable_logging && !config.enable_recovery;
+    container_->ForAllWithExclusiveLock(
+        [&](const std::string_view, DataItem* item) {
+          if (next_record_id_.load() <= item->record_id) {
+            next_record_id_.store(item->record_id + 1);
+          }
+          if (logs_removed) {
+            item->key_logged_epoch.store(DataItem::KeyIsNotLogged);
+          }
+        });
+  } else {
+    switch (config.concurrent_point_index) {
+      case Config::ConcurrentPointIndex::MPMCConcurrentHashSet:
+        container_ =
+            std::make_unique<MPMCConcurrentSetImpl>(config.enable_huge_pages);
+        break;
+      case Config::ConcurrentPointIndex::MPMCInlineConcurrentHashSet:
+        container_ = std::make_unique<MPMCInlineConcurrentSetImpl>(
+            config.enable_huge_pages);
+        break;
+      default:
+        container_ =
+            std::make_unique<MPMCConcurrentSetImpl>(config.enable_huge_pages);
+        break;
+    }
   }
 
   if (recovery_set.empty()) return;
   for (auto& entry : recovery_set) {
-    container_->Put(entry.key, entry.index_cache);
+    Put(entry.key, entry.key_hash, entry.index_cache);
   }
 }
 
 ConcurrentTable::~ConcurrentTable() {
-  container_->ForAllWithExclusiveLock(
-      [](const std::string_view, const DataItem* i) {
-        assert(i != nullptr);
-        delete i;
-      });
-  container_->Clear();
+  if (!shared_) container_->Clear();
 }
 
 DataItem* ConcurrentTable::Get(const std::string_view key) {
-  return container_->Get(key);
+  return Get(key, Util::HashKey(key));
+}
+DataItem* ConcurrentTable::Get(const std::string_view key, const size_t hash) {
+  return container_->Get(key, hash);
 }
 
 DataItem* ConcurrentTable::GetOrInsert(const std::string_view key) {
-  auto* item = container_->Get(key);
-  if (item == nullptr) { return InsertIfNotExist(key); }
+  return GetOrInsert(key, Util::HashKey(key));
+}
+DataItem* ConcurrentTable::GetOrInsert(const std::string_view key,
+                                       const size_t hash) {
+  auto* item = container_->Get(key, hash);
+  if (item == nullptr) { return InsertIfNotExist(key, hash); }
   return item;
 }
 
-// return false if a corresponding entry already exists
 bool ConcurrentTable::Put(const std::string_view key, DataItem* value) {
-  bool success = container_->Put(key, value);
-  if (!success) delete value;
-  return success;
+  return Put(key, Util::HashKey(key), value);
+}
+// return false if a corresponding entry already exists. The table takes the
+// ownership of the given item in any case.
+// The record id of the given item is preserved (e.g., for recovery) and the
+// subsequent insertions never reuse it.
+bool ConcurrentTable::Put(const std::string_view key, const size_t hash,
+                          DataItem* value) {
+  ReserveRecordIds(value->record_id);
+  return container_->Put(key, hash, std::unique_ptr<DataItem>(value)) !=
+         nullptr;
 }
 
-DataItem* ConcurrentTable::InsertIfNotExist(const std::string_view key) {
-  auto new_item = new DataItem();
-  if (Put(key, new_item)) {
-    return new_item;
-  } else {
-    auto* current = Get(key);
-    assert(current != nullptr);
-    return current;
+void ConcurrentTable::ReserveRecordIds(const uint64_t record_id) {
+  auto next = next_record_id_.load();
+  while (next <= record_id &&
+         !next_record_id_.compare_exchange_weak(next, record_id + 1)) {}
+}
+
+DataItem* ConcurrentTable::InsertIfNotExist(const std::string_view key,
+                                            const size_t hash) {
+  // NOTE: the id is lost if another thread has inserted the same key
+  // concurrently; ids are dense except for such races.
+  for (;;) {
+    auto* inserted =
+        container_->Emplace(key, hash, next_record_id_.fetch_add(1));
+    if (inserted != nullptr) return inserted;
+    // The existing entry may have been erased since.
+    auto* current = Get(key, hash);
+    if (current != nullptr) return current;
   }
 }
+
+void ConcurrentTable::ForEachInParallel(
+    std::function<void(const std::string_view, const DataItem*)> f,
+    const size_t concurrency) {
+  container_->ForEachInParallel(f, concurrency);
+}
+
+bool ConcurrentTable::Erase(const std::string_view key, const size_t hash,
+                            const DataItem* item) {
+  return container_->Erase(key, hash, item);
+}
+
+void ConcurrentTable::ReclaimErased() { container_->ReclaimErased(); }
 }  // namespace Index
 }  // namespace LineairDB
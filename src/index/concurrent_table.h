@@ -19,6 +19,7 @@
 
 #include <lineairdb/config.h>
 
+#include <atomic>
 #include <functional>
 #include <string>
 #include <string_view>
@@ -35,13 +36,29 @@ class ConcurrentTable {
                   WriteSetType recovery_set = WriteSetType());
   ~ConcurrentTable();
 
+  // The overloads taking a hash value expect Util::HashKey(key).
   DataItem* Get(const std::string_view key);
+  DataItem* Get(const std::string_view key, const size_t hash);
   DataItem* GetOrInsert(const std::string_view key);
+  DataItem* GetOrInsert(const std::string_view key, const size_t hash);
   bool Put(const std::string_view key, DataItem* value);
-  DataItem* InsertIfNotExist(const std::string_view key);
+  bool Put(const std::string_view key, const size_t hash, DataItem* value);
+  DataItem* InsertIfNotExist(const std::string_view key, const size_t hash);
+  // The subsequent insertions never use the record ids up to the given one.
+  void ReserveRecordIds(const uint64_t record_id);
+  void ForEachInParallel(
+      std::function<void(const std::string_view, const DataItem*)> f,
+      const size_t concurrency);
+  // See ConcurrentPointIndexBase::Erase and #ReclaimErased.
+  bool Erase(const std::string_view key, const size_t hash,
+             const DataItem* item);
+  void ReclaimErased();
 
  private:
   std::unique_ptr<ConcurrentPointIndexBase> container_;
+  std::atomic<uint64_t> next_record_id_;
+  // The index is in a shared memory segment and outlives this table.
+  bool shared_;
 };
 }  // namespace Index
 }  // namespace LineairDB
@@ -16,44 +16,49 @@
 
 #include "mpmc_concurrent_set_impl.h"
 
+#include <algorithm>
 #include <cassert>
 #include <functional>
 #include <mutex>
 #include <string_view>
+#include <thread>
 
 #include "types.h"
 
 namespace LineairDB {
 namespace Index {
 
-MPMCConcurrentSetImpl::~MPMCConcurrentSetImpl() {
-  delete RedirectedPtr;
+template <bool InlineDataItem>
+MPMCConcurrentSetTyped<InlineDataItem>::~MPMCConcurrentSetTyped() {
   Clear();
   delete table_.load();
+  for (auto* table : retired_tables_) { delete table; }
 }
 
 // WANTFIX
 // Replace linear-probing with hopscotch-hashing or cuckoo-hashing to reduce the
 // computational costs of find operation.
-DataItem* MPMCConcurrentSetImpl::Get(const std::string_view key) {
+template <bool InlineDataItem>
+DataItem* MPMCConcurrentSetTyped<InlineDataItem>::Get(
+    const std::string_view key, const size_t hashed) {
   epoch_framework_.MakeMeOnline();
   auto* table              = table_.load();
-  size_t hash              = Hash(key, table);
+  size_t hash              = Hash(hashed, table);
   auto* bucket_p           = table->at(hash).load();
   DataItem* return_value_p = nullptr;
 
   // lineair probing
   for (;;) {
     // redirected
-    if (bucket_p == RedirectedPtr) {
+    if (IsRedirected(bucket_p)) {
       table    = table_.load();
-      hash     = Hash(key, table);
+      hash     = Hash(hashed, table);
       bucket_p = table->at(hash).load();
       continue;
     }
     if (bucket_p == nullptr) { break; }
-    if (bucket_p->key == key) {
-      return_value_p = const_cast<DataItem*>(bucket_p->value);
+    if (bucket_p != Tombstone() && bucket_p->Matches(key, hashed)) {
+      return_value_p = bucket_p->Item();
       break;
     }
 
@@ -66,12 +71,28 @@ DataItem* MPMCConcurrentSetImpl::Get(const std::string_view key) {
   return return_value_p;
 }
 
-bool MPMCConcurrentSetImpl::Put(const std::string_view key,
-                                const DataItem* const value_p) {
+template <bool InlineDataItem>
+DataItem* MPMCConcurrentSetTyped<InlineDataItem>::Put(
+    const std::string_view key, const size_t hashed,
+    std::unique_ptr<DataItem> value_p) {
+  return Insert(key, hashed,
+                new (placement_)
+                    TableNode(key, hashed, std::move(value_p), placement_));
+}
+
+template <bool InlineDataItem>
+DataItem* MPMCConcurrentSetTyped<InlineDataItem>::Emplace(
+    const std::string_view key, const size_t hashed, const uint64_t record_id) {
+  return Insert(key, hashed,
+                new (placement_) TableNode(key, hashed, record_id, placement_));
+}
+
+template <bool InlineDataItem>
+DataItem* MPMCConcurrentSetTyped<InlineDataItem>::Insert(
+    const std::string_view key, const size_t hashed, TableNode* new_node) {
   epoch_framework_.MakeMeOnline();
-  auto* table         = table_.load();
-  size_t hash         = Hash(key, table);
-  TableNode* new_node = new TableNode(key, value_p);
+  auto* table = table_.load();
+  size_t hash = Hash(hashed, table);
 
   // lineair probing
   for (;;) {
@@ -79,10 +100,10 @@ bool MPMCConcurrentSetImpl::Put(const std::string_view key,
     auto* node       = bucket_atm.load();
 
     // redirected
-    if (node == RedirectedPtr) {
+    if (IsRedirected(node)) {
       table = table_.load();
-      hash  = Hash(key, table);
-      node  = table->at(hash).load();
+      hash  = Hash(hashed, table);
+      continue;
     }
 
     // empty bucket has found. insert
@@ -98,17 +119,24 @@ bool MPMCConcurrentSetImpl::Put(const std::string_view key,
         } else {
           epoch_framework_.MakeMeOffline();
         }
-        return true;
+        return new_node->Item();
       } else {
         continue;
       }
     }
 
+    // tombstones are never reused, since the same key may follow them
+    if (node == Tombstone()) {
+      hash++;
+      if (hash == table->size()) { hash = 0; }
+      continue;
+    }
+
     // update
-    if (node->key == key) {
+    if (node->Matches(key, hashed)) {
       delete new_node;
       epoch_framework_.MakeMeOffline();
-      return false;
+      return nullptr;
     }
 
     hash++;
@@ -117,9 +145,10 @@ bool MPMCConcurrentSetImpl::Put(const std::string_view key,
 }
 
 // FYI: https://preshing.com/20160222/a-resizable-concurrent-map/
-bool MPMCConcurrentSetImpl::Rehash() {
+template <bool InlineDataItem>
+bool MPMCConcurrentSetTyped<InlineDataItem>::Rehash() {
   epoch_framework_.MakeMeOffline();
-  std::lock_guard<std::mutex> lock(table_lock_);
+  std::unique_lock<std::mutex> lock(table_lock_);
   auto* table = table_.load();
   if ((populated_count_.load() / static_cast<double>(table->size())) <
       RehashThreshold) {
@@ -127,23 +156,33 @@ bool MPMCConcurrentSetImpl::Rehash() {
     return false;
   }
 
+  // Tombstones are dropped by rehashing; the table keeps its size if they
+  // have filled most of it, so that erasures bound its memory.
   // NOTE changing the table size also changes the results of #Hash,
-  // since it is used as the salt.
-  TableType* new_table = new TableType(table->size() * 2);
+  // since it is used as the mask.
+  const size_t live_count = populated_count_.load() - tombstone_count_;
+  const bool grow =
+      RehashThreshold / 2 <= live_count / static_cast<double>(table->size());
+  TableType* new_table = new TableType(table->size() * (grow ? 2 : 1),
+                                       table->get_allocator());
 
   // copy and rehashing all nodes
   for (auto& bucket_atm : *table_.load()) {
     auto* node = bucket_atm.load();
 
     if (node == nullptr) {
-      if (bucket_atm.compare_exchange_strong(node, RedirectedPtr)) {
+      if (bucket_atm.compare_exchange_strong(node, Redirect(nullptr))) {
         continue;
       } else {
         node = bucket_atm.load();
       }
     }
+    if (node == Tombstone()) {  // NOTE: #Erase holds table_lock_.
+      bucket_atm.store(Redirect(node));
+      continue;
+    }
 
-    size_t rehashed = Hash(node->key, new_table);
+    size_t rehashed = Hash(node->Hash(), new_table);
 
     // lineair probing
     for (;;) {
@@ -157,53 +196,161 @@ bool MPMCConcurrentSetImpl::Rehash() {
     }
 
     [[maybe_unused]] bool exchanged =
-        bucket_atm.compare_exchange_strong(node, RedirectedPtr);
+        bucket_atm.compare_exchange_strong(node, Redirect(node));
     assert(exchanged);  // NOTE: This class provides concurrent `set` of
                         // `pointer`; we assume that pointer entries are never
                         // be deleted and updated.
   }
 
-  for (;;) {
-    if (table_.compare_exchange_strong(table, new_table)) {
-      // QSBR-based garbage collection
-      epoch_framework_.Sync();
-      delete table;
-      return true;
-    }
+  populated_count_.fetch_sub(tombstone_count_);
+  tombstone_count_ = 0;
+
+  table_.store(new_table);
+  lock.unlock();
+
+  // QSBR-based garbage collection, without table_lock_ so that the
+  // insertions which fill the new table never wait for it.
+  // NOTE: a thread which has been online at the current epoch may still
+  // refer the old table after the first increment of the epoch; two
+  // increments ensure that all such threads have gone offline.
+  epoch_framework_.Sync();
+  epoch_framework_.Sync();
+  std::lock_guard<std::mutex> retired_lock(retired_tables_lock_);
+  if (running_scans_.load() == 0) {
+    delete table;
+  } else {
+    retired_tables_.push_back(table);
   }
+  return true;
 }
 
-void MPMCConcurrentSetImpl::ForAllWithExclusiveLock(
-    std::function<void(const std::string_view, const DataItem*)> f) {
+template <bool InlineDataItem>
+void MPMCConcurrentSetTyped<InlineDataItem>::ForAllWithExclusiveLock(
+    std::function<void(const std::string_view, DataItem*)> f) {
   std::lock_guard<std::mutex> lock(table_lock_);
   epoch_framework_.MakeMeOnline();
   for (auto& bucket_atm : *table_.load()) {
     auto* node = bucket_atm.load();
-    if (node == nullptr) continue;
+    if (node == nullptr || node == Tombstone()) continue;
 
-    f(node->key, node->value);
+    f(node->key, node->Item());
   }
   epoch_framework_.MakeMeOffline();
 }
 
-size_t MPMCConcurrentSetImpl::Hash(std::string_view key, TableType* table) {
-  auto capacity = table->size();
-  auto hashed   = std::hash<std::string_view>()(key);
-  hashed        = hashed ^ capacity;
-  return hashed % capacity;
+// Parallel scans do not take table_lock_ and thus never block rehashing,
+// insertions and the other scans. Each thread visits a disjoint range of the
+// buckets in the table observed at the beginning of the scan; since rehashing
+// marks (not overwrites) the buckets of the old table and the nodes are not
+// deleted while scans are running, every node inserted before the scan (and
+// not erased) is visited exactly once.
+template <bool InlineDataItem>
+void MPMCConcurrentSetTyped<InlineDataItem>::ForEachInParallel(
+    std::function<void(const std::string_view, const DataItem*)> f,
+    const size_t concurrency) {
+  running_scans_.fetch_add(1);
+  auto* table              = table_.load();
+  const size_t bucket_size = table->size();
+  const size_t threads     = std::max<size_t>(1, concurrency);
+
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < threads; i++) {
+    const size_t from = bucket_size * i / threads;
+    const size_t to   = bucket_size * (i + 1) / threads;
+    workers.emplace_back([&, from, to]() {
+      for (size_t idx = from; idx < to; idx++) {
+        auto* node = Unredirect(table->at(idx).load());
+        if (node == nullptr || node == Tombstone()) continue;
+        f(node->key, node->Item());
+      }
+    });
+  }
+  for (auto& worker : workers) { worker.join(); }
+
+  std::lock_guard<std::mutex> retired_lock(retired_tables_lock_);
+  if (running_scans_.fetch_sub(1) == 1) {
+    for (auto* retired : retired_tables_) { delete retired; }
+    retired_tables_.clear();
+    for (auto* retired : retired_nodes_) { delete retired; }
+    retired_nodes_.clear();
+  }
 }
 
-void MPMCConcurrentSetImpl::Clear() {
+template <bool InlineDataItem>
+bool MPMCConcurrentSetTyped<InlineDataItem>::Erase(const std::string_view key,
+                                                   const size_t hashed,
+                                                   const DataItem* const item) {
+  // Erasures are serialized with rehashing, and thus never meet redirected
+  // buckets. Insertions only fill empty buckets and never conflict with them.
+  std::lock_guard<std::mutex> lock(table_lock_);
+  auto* table = table_.load();
+  size_t hash = Hash(hashed, table);
+
+  // lineair probing
+  for (;;) {
+    auto& bucket_atm = table->at(hash);
+    auto* node       = bucket_atm.load();
+    if (node == nullptr) return false;
+    if (node != Tombstone() && node->Matches(key, hashed)) {
+      if (node->Item() != item) return false;
+      bucket_atm.store(Tombstone());
+      tombstone_count_++;
+      erased_nodes_.push_back(node);
+      return true;
+    }
+
+    hash++;
+    if (hash == table->size()) { hash = 0; }
+  }
+}
+
+template <bool InlineDataItem>
+void MPMCConcurrentSetTyped<InlineDataItem>::ReclaimErased() {
+  std::vector<TableNode*> erased;
+  {
+    std::lock_guard<std::mutex> lock(table_lock_);
+    erased.swap(erased_nodes_);
+  }
+  if (erased.empty()) return;
+
+  // QSBR-based garbage collection, as #Rehash does.
+  epoch_framework_.Sync();
+  epoch_framework_.Sync();
+  std::lock_guard<std::mutex> retired_lock(retired_tables_lock_);
+  if (running_scans_.load() == 0) {
+    for (auto* node : erased) { delete node; }
+  } else {
+    retired_nodes_.insert(retired_nodes_.end(), erased.begin(), erased.end());
+  }
+}
+
+template <bool InlineDataItem>
+size_t MPMCConcurrentSetTyped<InlineDataItem>::Hash(size_t hashed,
+                                                    TableType* table) {
+  // the table size is always a power of two and the low bits of
+  // Util::HashKey are well mixed.
+  return hashed & (table->size() - 1);
+}
+
+template <bool InlineDataItem>
+void MPMCConcurrentSetTyped<InlineDataItem>::Clear() {
   std::lock_guard<std::mutex> lock(table_lock_);
   auto* table = table_.load();
   for (auto& bucket_atm : *table) {
     auto* node = bucket_atm.load();
-    if (node == nullptr) continue;
+    if (node == nullptr || node == Tombstone()) continue;
 
     delete node;
   }
   table->clear();
+  for (auto* node : erased_nodes_) { delete node; }
+  erased_nodes_.clear();
+  for (auto* node : retired_nodes_) { delete node; }
+  retired_nodes_.clear();
 }
 
+template class MPMCConcurrentSetTyped<false>;
+template class MPMCConcurrentSetTyped<true>;
+
 }  // namespace Index
 }  // namespace LineairDB
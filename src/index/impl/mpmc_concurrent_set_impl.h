@@ -21,13 +21,17 @@
 #include <cassert>
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <string_view>
+#include <type_traits>
 #include <vector>
 
 #include "index/concurrent_point_index_base.h"
 #include "types.h"
 #include "util/epoch_framework.hpp"
+#include "util/memory_placement.h"
 
 namespace LineairDB {
 namespace Index {
@@ -41,46 +45,170 @@ namespace Index {
  * This is because LineairDB requires that point-indexes have to
  * hold only indirection pointer to each data item; once an indirection is
  * created and stored into the index, it will not be changed by #puts.
+ * Nodes hold the hash values of their keys (see Util::HashKey), which are
+ * compared before the keys and reused by rehashing.
+ * #Erase replaces the bucket of a node with a tombstone, which lookups probe
+ * over and rehashing drops; the erased nodes are deleted by #ReclaimErased.
+ * @tparam InlineDataItem If true, each node embeds the key and
+ * the data item in a single allocation. A lookup then follows only the bucket
+ * pointer, instead of the bucket, the node, the heap buffer of a long key and
+ * the data item. Keys up to the small string optimization capacity of
+ * std::string are stored inline.
  */
-class MPMCConcurrentSetImpl final : public ConcurrentPointIndexBase {
-  struct TableNode {
+template <bool InlineDataItem = false>
+class MPMCConcurrentSetTyped final : public ConcurrentPointIndexBase {
+  struct IndirectTableNode {
+    const size_t hash;
     std::string key;
-    const DataItem* value;
-    TableNode() : value(nullptr) { assert(key.empty()); };
-    TableNode(std::string_view k, const DataItem* const v) : key(k), value(v) {}
+    DataItem* value;
+    IndirectTableNode(std::string_view k, size_t h, std::unique_ptr<DataItem> v,
+                      const Util::Placement)
+        : hash(h), key(k), value(v.release()) {}
+    IndirectTableNode(std::string_view k, size_t h, const uint64_t record_id,
+                      const Util::Placement placement)
+        : hash(h), key(k), value(new (placement) DataItem) {
+      value->record_id = record_id;
+    }
+    ~IndirectTableNode() { delete value; }
+    static void* operator new(size_t size, const Util::Placement placement) {
+      return Util::AllocateRecord<IndirectTableNode>(size, placement);
+    }
+    static void operator delete(void* p) {
+      Util::DeallocateRecord<IndirectTableNode>(p);
+    }
+    static void operator delete(void* p, const Util::Placement) {
+      Util::DeallocateRecord<IndirectTableNode>(p);
+    }
+    DataItem* Item() { return value; }
+    bool Matches(std::string_view k, size_t h) const {
+      return hash == h && key == k;
+    }
+    size_t Hash() const { return hash; }
   };
+  struct InlineTableNode {
+    const size_t hash;
+    std::string key;
+    DataItem value;
+    // The given item (e.g., a recovered one) is copied into the node.
+    InlineTableNode(std::string_view k, size_t h, std::unique_ptr<DataItem> v,
+                    const Util::Placement)
+        : hash(h), key(k), value(v->value, v->size, v->transaction_id.load()) {
+      value.record_id  = v->record_id;
+      value.expires_at = v->expires_at;
+      value.key_logged_epoch.store(v->key_logged_epoch.load());
+    }
+    InlineTableNode(std::string_view k, size_t h, const uint64_t record_id,
+                    const Util::Placement)
+        : hash(h), key(k) {
+      value.record_id = record_id;
+    }
+    static void* operator new(size_t size, const Util::Placement placement) {
+      return Util::AllocateRecord<InlineTableNode>(size, placement);
+    }
+    static void operator delete(void* p) {
+      Util::DeallocateRecord<InlineTableNode>(p);
+    }
+    static void operator delete(void* p, const Util::Placement) {
+      Util::DeallocateRecord<InlineTableNode>(p);
+    }
+    DataItem* Item() { return &value; }
+    bool Matches(std::string_view k, size_t h) const {
+      return hash == h && key == k;
+    }
+    size_t Hash() const { return hash; }
+  };
+  typedef typename std::conditional<InlineDataItem, InlineTableNode,
+                                    IndirectTableNode>::type TableNode;
 
   static constexpr size_t InitialTableSize = 1024;
   static constexpr double RehashThreshold  = 0.75;
 
-  typedef std::vector<std::atomic<TableNode*>> TableType;
+  typedef Util::HugePageAllocator<std::atomic<TableNode*>> BucketAllocator;
+  typedef std::vector<std::atomic<TableNode*>, BucketAllocator> TableType;
 
  public:
-  MPMCConcurrentSetImpl()
-      : RedirectedPtr(new TableNode),
-        table_(new TableType(InitialTableSize)),
-        populated_count_(0) {
+  /**
+   * @param huge_pages If true, the nodes and the data items of this table are
+   * placed on huge pages, and so are the buckets once the table grows larger
+   * than a huge page.
+   */
+  MPMCConcurrentSetTyped(const bool huge_pages = false)
+      : placement_(huge_pages ? Util::Placement::HugePages
+                              : Util::Placement::Heap),
+        table_(new TableType(InitialTableSize, BucketAllocator(huge_pages))),
+        populated_count_(0),
+        tombstone_count_(0),
+        running_scans_(0) {
     epoch_framework_.Start();
   }
-  ~MPMCConcurrentSetImpl() final override;
-  DataItem* Get(const std::string_view) final override;
-  bool Put(const std::string_view, const DataItem* const) final override;
+  ~MPMCConcurrentSetTyped() final override;
+  DataItem* Get(const std::string_view, const size_t) final override;
+  DataItem* Put(const std::string_view, const size_t,
+                std::unique_ptr<DataItem>) final override;
+  DataItem* Emplace(const std::string_view, const size_t,
+                    const uint64_t) final override;
   void ForAllWithExclusiveLock(
-      std::function<void(const std::string_view, const DataItem*)>)
-      final override;
+      std::function<void(const std::string_view, DataItem*)>) final override;
+  void ForEachInParallel(
+      std::function<void(const std::string_view, const DataItem*)>,
+      const size_t) final override;
+  bool Erase(const std::string_view, const size_t,
+             const DataItem* const) final override;
+  void ReclaimErased() final override;
   void Clear() final override;  // thread-unsafe
 
  private:
-  size_t Hash(std::string_view, TableType*);
+  size_t Hash(size_t hashed, TableType*);
   bool Rehash();
+  DataItem* Insert(const std::string_view, const size_t, TableNode*);
+
+  /**
+   * @brief
+   * A bucket of the old table is marked as "redirected" while rehashing, by
+   * setting the lowest bit of the pointer. The marked pointer still refers the
+   * moved node (or nullptr) and thus parallel scans running on the old table
+   * can continue to visit the nodes.
+   */
+  static TableNode* Redirect(TableNode* node) {
+    return reinterpret_cast<TableNode*>(reinterpret_cast<uintptr_t>(node) |
+                                        1llu);
+  }
+  static bool IsRedirected(TableNode* node) {
+    return reinterpret_cast<uintptr_t>(node) & 1llu;
+  }
+  static TableNode* Unredirect(TableNode* node) {
+    return reinterpret_cast<TableNode*>(reinterpret_cast<uintptr_t>(node) &
+                                        ~1llu);
+  }
+  /**
+   * @brief
+   * The bucket of an erased node. It is never a valid pointer of a node,
+   * since nodes are aligned; the lowest bit is left for #Redirect.
+   */
+  static TableNode* Tombstone() {
+    return reinterpret_cast<TableNode*>(uintptr_t{2});
+  }
 
  private:
-  TableNode* RedirectedPtr;
+  const Util::Placement placement_;
   std::atomic<TableType*> table_;
-  std::atomic<size_t> populated_count_;
+  std::atomic<size_t> populated_count_;   // including tombstones
+  size_t tombstone_count_;                // guarded by table_lock_
+  std::vector<TableNode*> erased_nodes_;  // guarded by table_lock_
   std::mutex table_lock_;
   EpochFramework epoch_framework_;
+
+  // Old tables and erased nodes are kept alive while any parallel scan is
+  // running on them.
+  std::atomic<size_t> running_scans_;
+  std::vector<TableType*> retired_tables_;
+  std::vector<TableNode*> retired_nodes_;
+  std::mutex retired_tables_lock_;
 };
+
+typedef MPMCConcurrentSetTyped<false> MPMCConcurrentSetImpl;
+typedef MPMCConcurrentSetTyped<true> MPMCInlineConcurrentSetImpl;
+
 }  // namespace Index
 }  // namespace LineairDB
 
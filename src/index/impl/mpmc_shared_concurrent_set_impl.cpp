@@ -0,0 +1,417 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "mpmc_shared_concurrent_set_impl.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <thread>
+
+#include "types.h"
+#include "util/logger.hpp"
+
+namespace LineairDB {
+namespace Index {
+
+MPMCSharedConcurrentSetImpl::MPMCSharedConcurrentSetImpl(
+    const std::string& segment, const size_t size)
+    : arena_(segment, size), root_(nullptr), running_scans_(0) {
+  // The epochs and the record ids are local to the instance; see
+  // Config::shared_memory_segment.
+  if (!arena_.LockExclusively()) {
+    SPDLOG_ERROR("The shared memory segment {0} is attached by another "
+                 "instance.",
+                 segment);
+    exit(EXIT_FAILURE);
+  }
+  auto& root_offset = arena_.Root();
+  uint64_t offset   = root_offset.load();
+  if (offset == 0) {
+    // The first instance mapping the segment creates the table.
+    auto* root = new (arena_.Allocate(sizeof(Root))) Root();
+    root->table.store(arena_.OffsetOf(NewTable(InitialTableSize)));
+    if (root_offset.compare_exchange_strong(offset, arena_.OffsetOf(root))) {
+      offset = arena_.OffsetOf(root);
+    } else {
+      auto* table = arena_.At<Table>(root->table.load());
+      arena_.Deallocate(table, Table::SizeOf(table->size));
+      arena_.Deallocate(root, sizeof(Root));
+    }
+  }
+  root_ = arena_.At<Root>(offset);
+  if (arena_.HolderHasCrashed()) Repair();
+  epoch_framework_.Start();
+}
+
+// The crashed instance may have died while holding the table lock (e.g., in
+// the middle of rehashing) or the locks of data items; no thread of it
+// releases them. The data items being installed have half-written values,
+// which are lost: they are left absent with a new version. The tables and
+// nodes retired by the crashed instance are leaked.
+void MPMCSharedConcurrentSetImpl::Repair() {
+  SPDLOG_WARN("The shared memory segment was left by a crashed instance.");
+  root_->table_lock.unlock();
+  // A table is published after all of its buckets are filled, and thus the
+  // current one holds all the entries even if some of its buckets have been
+  // redirected to a half-filled table.
+  auto* table = CurrentTable();
+  for (size_t i = 0; i < table->size; i++) {
+    auto& bucket_atm = table->at(i);
+    auto bucket      = Unredirect(bucket_atm.load());
+    bucket_atm.store(bucket);
+    if (bucket == 0 || bucket == Tombstone) continue;
+
+    auto& item  = *arena_.At<TableNode>(bucket)->Item();
+    auto tx_id  = item.transaction_id.load();
+    auto locked = tx_id & 1llu;
+    if (item.install_counter.load() & 1) {
+      item.size       = 0;
+      item.expires_at = 0;
+      item.install_counter.fetch_add(1);
+      item.transaction_id.store(tx_id + locked);  // the next version
+    } else if (locked) {
+      item.transaction_id.store(tx_id & ~1llu);
+    }
+  }
+}
+
+MPMCSharedConcurrentSetImpl::~MPMCSharedConcurrentSetImpl() {
+  std::lock_guard<std::mutex> retired_lock(retired_lock_);
+  retired_nodes_.insert(retired_nodes_.end(), erased_nodes_.begin(),
+                        erased_nodes_.end());
+  ReclaimRetired();
+}
+
+MPMCSharedConcurrentSetImpl::Table* MPMCSharedConcurrentSetImpl::NewTable(
+    const size_t size) {
+  auto* table = static_cast<Table*>(arena_.Allocate(Table::SizeOf(size)));
+  std::memset(static_cast<void*>(table), 0, Table::SizeOf(size));
+  table->size = size;
+  return table;
+}
+
+void MPMCSharedConcurrentSetImpl::DeleteNode(TableNode* node) {
+  const size_t size = TableNode::SizeOf(node->Key());
+  node->~TableNode();
+  arena_.Deallocate(node, size);
+}
+
+DataItem* MPMCSharedConcurrentSetImpl::Get(const std::string_view key,
+                                           const size_t hashed) {
+  epoch_framework_.MakeMeOnline();
+  auto* table              = CurrentTable();
+  size_t hash              = Hash(hashed, table);
+  auto bucket              = table->at(hash).load();
+  DataItem* return_value_p = nullptr;
+
+  // lineair probing
+  for (;;) {
+    // redirected
+    if (IsRedirected(bucket)) {
+      table  = CurrentTable();
+      hash   = Hash(hashed, table);
+      bucket = table->at(hash).load();
+      continue;
+    }
+    if (bucket == 0) { break; }
+    if (bucket != Tombstone) {
+      auto* node = arena_.At<TableNode>(bucket);
+      if (node->Matches(key, hashed)) {
+        return_value_p = node->Item();
+        break;
+      }
+    }
+
+    hash++;
+    if (hash == table->size) { hash = 0; }
+    bucket = table->at(hash).load();
+  }
+
+  epoch_framework_.MakeMeOffline();
+  return return_value_p;
+}
+
+DataItem* MPMCSharedConcurrentSetImpl::Put(const std::string_view key,
+                                           const size_t hashed,
+                                           std::unique_ptr<DataItem> v) {
+  // The given item (e.g., a recovered one) is copied into the node.
+  auto* node = new (arena_.Allocate(TableNode::SizeOf(key)))
+      TableNode(key, hashed);
+  node->value.Reset(v->value, v->size);
+  node->value.transaction_id.store(v->transaction_id.load());
+  node->value.record_id  = v->record_id;
+  node->value.expires_at = v->expires_at;
+  node->value.key_logged_epoch.store(v->key_logged_epoch.load());
+  return Insert(key, hashed, node);
+}
+
+DataItem* MPMCSharedConcurrentSetImpl::Emplace(const std::string_view key,
+                                               const size_t hashed,
+                                               const uint64_t record_id) {
+  auto* node = new (arena_.Allocate(TableNode::SizeOf(key)))
+      TableNode(key, hashed);
+  node->value.record_id = record_id;
+  return Insert(key, hashed, node);
+}
+
+DataItem* MPMCSharedConcurrentSetImpl::Insert(const std::string_view key,
+                                              const size_t hashed,
+                                              TableNode* new_node) {
+  const uint64_t new_offset = arena_.OffsetOf(new_node);
+  epoch_framework_.MakeMeOnline();
+  auto* table = CurrentTable();
+  size_t hash = Hash(hashed, table);
+
+  // lineair probing
+  for (;;) {
+    auto& bucket_atm = table->at(hash);
+    auto bucket      = bucket_atm.load();
+
+    // redirected
+    if (IsRedirected(bucket)) {
+      table = CurrentTable();
+      hash  = Hash(hashed, table);
+      continue;
+    }
+
+    // empty bucket has found. insert
+    if (bucket == 0) {
+      bool succ = bucket_atm.compare_exchange_weak(bucket, new_offset);
+      if (succ) {
+        const size_t current_stored = root_->populated_count.fetch_add(1);
+        const double current_fill_rate =
+            (current_stored / static_cast<double>(table->size));
+        if (RehashThreshold < current_fill_rate) {
+          // NOTE MakeMeOffline() was invoked in #Rehash.
+          Rehash();
+        } else {
+          epoch_framework_.MakeMeOffline();
+        }
+        return new_node->Item();
+      } else {
+        continue;
+      }
+    }
+
+    // tombstones are never reused, since the same key may follow them
+    if (bucket != Tombstone &&
+        arena_.At<TableNode>(bucket)->Matches(key, hashed)) {
+      DeleteNode(new_node);
+      epoch_framework_.MakeMeOffline();
+      return nullptr;
+    }
+
+    hash++;
+    if (hash == table->size) { hash = 0; }
+  }
+}
+
+bool MPMCSharedConcurrentSetImpl::Rehash() {
+  epoch_framework_.MakeMeOffline();
+  std::unique_lock<Util::SharedSpinLock> lock(root_->table_lock);
+  auto* table = CurrentTable();
+  if ((root_->populated_count.load() / static_cast<double>(table->size)) <
+      RehashThreshold) {
+    // someone else, maybe in another process, has rehashed the table.
+    return false;
+  }
+
+  const size_t live_count =
+      root_->populated_count.load() - root_->tombstone_count;
+  const bool grow =
+      RehashThreshold / 2 <= live_count / static_cast<double>(table->size);
+  Table* new_table = NewTable(table->size * (grow ? 2 : 1));
+
+  // copy and rehashing all nodes
+  for (size_t i = 0; i < table->size; i++) {
+    auto& bucket_atm = table->at(i);
+    auto bucket      = bucket_atm.load();
+
+    if (bucket == 0) {
+      if (bucket_atm.compare_exchange_strong(bucket, Redirect(0))) {
+        continue;
+      } else {
+        bucket = bucket_atm.load();
+      }
+    }
+    if (bucket == Tombstone) {  // NOTE: #Erase holds the table lock.
+      bucket_atm.store(Redirect(bucket));
+      continue;
+    }
+
+    size_t rehashed = Hash(arena_.At<TableNode>(bucket)->hash, new_table);
+
+    // lineair probing
+    for (;;) {
+      auto& target_bucket = new_table->at(rehashed);
+      if (target_bucket.load() == 0) {
+        target_bucket.store(bucket);
+        break;
+      }
+      rehashed++;
+      if (rehashed == new_table->size) rehashed = 0;
+    }
+
+    [[maybe_unused]] bool exchanged =
+        bucket_atm.compare_exchange_strong(bucket, Redirect(bucket));
+    assert(exchanged);
+  }
+
+  root_->populated_count.fetch_sub(root_->tombstone_count);
+  root_->tombstone_count = 0;
+
+  root_->table.store(arena_.OffsetOf(new_table));
+  lock.unlock();
+
+  // QSBR-based garbage collection of this process; see
+  // MPMCConcurrentSetTyped::Rehash.
+  epoch_framework_.Sync();
+  epoch_framework_.Sync();
+  std::lock_guard<std::mutex> retired_lock(retired_lock_);
+  retired_tables_.push_back(table);
+  if (running_scans_.load() == 0) ReclaimRetired();
+  return true;
+}
+
+void MPMCSharedConcurrentSetImpl::ForAllWithExclusiveLock(
+    std::function<void(const std::string_view, DataItem*)> f) {
+  std::lock_guard<Util::SharedSpinLock> lock(root_->table_lock);
+  epoch_framework_.MakeMeOnline();
+  auto* table = CurrentTable();
+  for (size_t i = 0; i < table->size; i++) {
+    auto bucket = table->at(i).load();
+    if (bucket == 0 || bucket == Tombstone) continue;
+
+    auto* node = arena_.At<TableNode>(bucket);
+    f(node->Key(), node->Item());
+  }
+  epoch_framework_.MakeMeOffline();
+}
+
+// See MPMCConcurrentSetTyped::ForEachInParallel.
+void MPMCSharedConcurrentSetImpl::ForEachInParallel(
+    std::function<void(const std::string_view, const DataItem*)> f,
+    const size_t concurrency) {
+  running_scans_.fetch_add(1);
+  auto* table              = CurrentTable();
+  const size_t bucket_size = table->size;
+  const size_t threads     = std::max<size_t>(1, concurrency);
+
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < threads; i++) {
+    const size_t from = bucket_size * i / threads;
+    const size_t to   = bucket_size * (i + 1) / threads;
+    workers.emplace_back([&, from, to]() {
+      for (size_t idx = from; idx < to; idx++) {
+        auto bucket = Unredirect(table->at(idx).load());
+        if (bucket == 0 || bucket == Tombstone) continue;
+        auto* node = arena_.At<TableNode>(bucket);
+        f(node->Key(), node->Item());
+      }
+    });
+  }
+  for (auto& worker : workers) { worker.join(); }
+
+  std::lock_guard<std::mutex> retired_lock(retired_lock_);
+  if (running_scans_.fetch_sub(1) == 1) ReclaimRetired();
+}
+
+bool MPMCSharedConcurrentSetImpl::Erase(const std::string_view key,
+                                        const size_t hashed,
+                                        const DataItem* const item) {
+  // Erasures are serialized with rehashing, and thus never meet redirected
+  // buckets. Insertions only fill empty buckets and never conflict with them.
+  std::lock_guard<Util::SharedSpinLock> lock(root_->table_lock);
+  auto* table = CurrentTable();
+  size_t hash = Hash(hashed, table);
+
+  // lineair probing
+  for (;;) {
+    auto& bucket_atm = table->at(hash);
+    auto bucket      = bucket_atm.load();
+    if (bucket == 0) return false;
+    if (bucket != Tombstone) {
+      auto* node = arena_.At<TableNode>(bucket);
+      if (node->Matches(key, hashed)) {
+        if (node->Item() != item) return false;
+        bucket_atm.store(Tombstone);
+        root_->tombstone_count++;
+        erased_nodes_.push_back(node);
+        return true;
+      }
+    }
+
+    hash++;
+    if (hash == table->size) { hash = 0; }
+  }
+}
+
+void MPMCSharedConcurrentSetImpl::ReclaimErased() {
+  std::vector<TableNode*> erased;
+  {
+    std::lock_guard<Util::SharedSpinLock> lock(root_->table_lock);
+    erased.swap(erased_nodes_);
+  }
+  if (erased.empty()) return;
+
+  // QSBR-based garbage collection of this process, as #Rehash does.
+  epoch_framework_.Sync();
+  epoch_framework_.Sync();
+  std::lock_guard<std::mutex> retired_lock(retired_lock_);
+  retired_nodes_.insert(retired_nodes_.end(), erased.begin(), erased.end());
+  if (running_scans_.load() == 0) ReclaimRetired();
+}
+
+void MPMCSharedConcurrentSetImpl::ReclaimRetired() {
+  for (auto* table : retired_tables_) {
+    arena_.Deallocate(table, Table::SizeOf(table->size));
+  }
+  retired_tables_.clear();
+  for (auto* node : retired_nodes_) { DeleteNode(node); }
+  retired_nodes_.clear();
+}
+
+size_t MPMCSharedConcurrentSetImpl::Hash(size_t hashed, Table* table) {
+  return hashed & (table->size - 1);
+}
+
+void MPMCSharedConcurrentSetImpl::Clear() {
+  std::lock_guard<Util::SharedSpinLock> lock(root_->table_lock);
+  auto* table = CurrentTable();
+  for (size_t i = 0; i < table->size; i++) {
+    auto bucket = table->at(i).load();
+    if (bucket != 0 && bucket != Tombstone) {
+      DeleteNode(arena_.At<TableNode>(bucket));
+    }
+    table->at(i).store(0);
+  }
+  root_->populated_count.store(0);
+  root_->tombstone_count = 0;
+  for (auto* node : erased_nodes_) { DeleteNode(node); }
+  erased_nodes_.clear();
+  std::lock_guard<std::mutex> retired_lock(retired_lock_);
+  for (auto* node : retired_nodes_) { DeleteNode(node); }
+  retired_nodes_.clear();
+}
+
+}  // namespace Index
+}  // namespace LineairDB
@@ -0,0 +1,157 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LINEAIRDB_MPMC_SHARED_CONCURRENT_SET_IMPL_H
+#define LINEAIRDB_MPMC_SHARED_CONCURRENT_SET_IMPL_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "index/concurrent_point_index_base.h"
+#include "types.h"
+#include "util/epoch_framework.hpp"
+#include "util/shared_arena.h"
+
+namespace LineairDB {
+namespace Index {
+
+/**
+ * @brief
+ * The MPMC hash-table of MPMCConcurrentSetTyped, placed in a shared memory
+ * segment (see Util::SharedArena) so that the index and the data items
+ * outlive the process. Each node embeds its key and its data item, and the
+ * buckets hold the offsets of the nodes in the segment instead of pointers.
+ * The table, its size and the lock serializing rehashing and erasures are in
+ * the segment as well; an instance attaching an existing segment finds the
+ * entries inserted by the earlier ones.
+ *
+ * Only one instance attaches the segment at a time, and the constructor exits
+ * if another one (in this process or another) has attached it: the threads
+ * reading a table or a node are tracked only by the epoch framework of the
+ * instance, which reclaims old tables and erased nodes. An instance attaching
+ * the segment left by a crashed one releases the locks the crashed one held;
+ * the values it was installing are lost (see #Repair).
+ * @note The destructor unmaps the segment without removing the entries; see
+ * #Clear.
+ */
+class MPMCSharedConcurrentSetImpl final : public ConcurrentPointIndexBase {
+  // The key follows the node in the same block.
+  struct TableNode {
+    const size_t hash;
+    const size_t key_size;
+    DataItem value;
+    TableNode(std::string_view k, size_t h) : hash(h), key_size(k.size()) {
+      std::memcpy(reinterpret_cast<char*>(this + 1), k.data(), k.size());
+    }
+    static size_t SizeOf(std::string_view k) {
+      return sizeof(TableNode) + k.size();
+    }
+    std::string_view Key() const {
+      return {reinterpret_cast<const char*>(this + 1), key_size};
+    }
+    DataItem* Item() { return &value; }
+    bool Matches(std::string_view k, size_t h) const {
+      return hash == h && Key() == k;
+    }
+  };
+  // The buckets follow the table in the same block.
+  struct Table {
+    size_t size;
+    std::atomic<uint64_t>& at(const size_t i) {
+      return reinterpret_cast<std::atomic<uint64_t>*>(this + 1)[i];
+    }
+    static size_t SizeOf(const size_t size) {
+      return sizeof(Table) + size * sizeof(std::atomic<uint64_t>);
+    }
+  };
+  struct Root {
+    std::atomic<uint64_t> table;
+    std::atomic<size_t> populated_count;  // including tombstones
+    size_t tombstone_count;               // guarded by table_lock
+    Util::SharedSpinLock table_lock;
+  };
+
+  static constexpr size_t InitialTableSize = 1024;
+  static constexpr double RehashThreshold  = 0.75;
+
+ public:
+  /**
+   * @param segment The name of the POSIX shared memory segment, which is
+   * created with the given size unless it exists.
+   */
+  MPMCSharedConcurrentSetImpl(const std::string& segment, const size_t size);
+  ~MPMCSharedConcurrentSetImpl() final override;
+  DataItem* Get(const std::string_view, const size_t) final override;
+  DataItem* Put(const std::string_view, const size_t,
+                std::unique_ptr<DataItem>) final override;
+  DataItem* Emplace(const std::string_view, const size_t,
+                    const uint64_t) final override;
+  void ForAllWithExclusiveLock(
+      std::function<void(const std::string_view, DataItem*)>) final override;
+  void ForEachInParallel(
+      std::function<void(const std::string_view, const DataItem*)>,
+      const size_t) final override;
+  bool Erase(const std::string_view, const size_t,
+             const DataItem* const) final override;
+  void ReclaimErased() final override;
+  // Removes the entries of the segment; thread-unsafe and process-unsafe.
+  void Clear() final override;
+
+ private:
+  Table* CurrentTable() { return arena_.At<Table>(root_->table.load()); }
+  Table* NewTable(const size_t size);
+  void DeleteNode(TableNode* node);
+  size_t Hash(size_t hashed, Table*);
+  bool Rehash();
+  DataItem* Insert(const std::string_view, const size_t, TableNode*);
+  // Releases the locks left by a crashed instance; see
+  // Util::SharedArena::HolderHasCrashed.
+  void Repair();
+  // Deletes the retired tables and nodes unless another process may refer
+  // them; the caller must hold retired_lock_ and ensure that no thread of
+  // this process refers them.
+  void ReclaimRetired();
+
+  // The lowest bit of a bucket marks it as redirected; see
+  // MPMCConcurrentSetTyped::Redirect. Offsets of nodes are aligned.
+  static uint64_t Redirect(uint64_t node) { return node | 1llu; }
+  static bool IsRedirected(uint64_t node) { return node & 1llu; }
+  static uint64_t Unredirect(uint64_t node) { return node & ~1llu; }
+  static constexpr uint64_t Tombstone = 2;
+
+ private:
+  Util::SharedArena arena_;
+  Root* root_;
+  EpochFramework epoch_framework_;
+
+  std::vector<TableNode*> erased_nodes_;  // guarded by root_->table_lock
+  std::atomic<size_t> running_scans_;
+  std::vector<Table*> retired_tables_;
+  std::vector<TableNode*> retired_nodes_;
+  std::mutex retired_lock_;
+};
+
+}  // namespace Index
+}  // namespace LineairDB
+
+#endif /* LINEAIRDB_MPMC_SHARED_CONCURRENT_SET_IMPL_H */
@@ -0,0 +1,116 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LINEAIRDB_RECOVERY_BACKUP_FORMAT_H
+#define LINEAIRDB_RECOVERY_BACKUP_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace LineairDB {
+namespace Recovery {
+namespace Backup {
+
+/**
+ * Binary format of online backups (see Database::Backup).
+ * A backup starts with #Magic and #FormatVersion, followed by a fuzzy
+ * snapshot of the data items, the changes of the epochs committed during the
+ * snapshot (the log tail) in the order of epochs, and the end mark.
+ * Integers are written in the native byte order.
+ *
+ *   Item : type(u8) key_size(u32) key value_size(u32) value expires_at(u64)
+ *   Epoch: type(u8) epoch(u32) changes(u32)
+ *          { key_size(u32) key value_size(u32) value expires_at(u64) }
+ *          * changes
+ *   End  : type(u8) epoch(u32)
+ *
+ * Applying the items and then the changes in this order yields the database
+ * as of the epoch in the end mark; a backup without the end mark is
+ * incomplete.
+ * The log tail is captured from the change stream of the logger, which does
+ * not include the writes of non-durable transactions (see
+ * Transaction::MarkAsNonDurable); such writes committed during the snapshot
+ * are missing unless the snapshot has visited them.
+ * expires_at is the expiration time of the value (see DataItem::expires_at),
+ * or 0 if it never expires; a change of an expired value makes the key
+ * absent.
+ */
+constexpr char Magic[8]          = {'L', 'D', 'B', 'B', 'A', 'C', 'K', 'P'};
+constexpr uint32_t FormatVersion = 2;
+
+enum class RecordType : uint8_t { Item, Epoch, End };
+
+template <typename T>
+void Append(std::string& buffer, const T value) {
+  buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+inline void AppendKeyValue(std::string& buffer, const std::string_view key,
+                           const std::byte* value, const size_t size,
+                           const uint64_t expires_at) {
+  Append<uint32_t>(buffer, static_cast<uint32_t>(key.size()));
+  buffer.append(key.data(), key.size());
+  Append<uint32_t>(buffer, static_cast<uint32_t>(size));
+  buffer.append(reinterpret_cast<const char*>(value), size);
+  Append<uint64_t>(buffer, expires_at);
+}
+inline void AppendHeader(std::string& buffer) {
+  buffer.append(Magic, sizeof(Magic));
+  Append(buffer, FormatVersion);
+}
+
+/**
+ * @return false if the stream does not begin with a backup header.
+ */
+inline bool ReadHeader(std::istream& in) {
+  char magic[sizeof(Magic)];
+  uint32_t version = 0;
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char*>(&version), sizeof(version));
+  return in.good() && std::memcmp(magic, Magic, sizeof(Magic)) == 0 &&
+         version == FormatVersion;
+}
+
+template <typename T>
+bool Read(std::istream& in, T& value) {
+  in.read(reinterpret_cast<char*>(&value), sizeof(value));
+  return in.good();
+}
+
+/**
+ * @return false at the end of the stream or on a truncated pair.
+ */
+inline bool ReadKeyValue(std::istream& in, std::string& key,
+                         std::vector<std::byte>& value, uint64_t& expires_at) {
+  uint32_t size;
+  if (!Read(in, size)) return false;
+  key.resize(size);
+  in.read(key.data(), size);
+  if (!Read(in, size)) return false;
+  value.resize(size);
+  in.read(reinterpret_cast<char*>(value.data()), size);
+  return Read(in, expires_at);
+}
+
+}  // namespace Backup
+}  // namespace Recovery
+}  // namespace LineairDB
+
+#endif /* LINEAIRDB_RECOVERY_BACKUP_FORMAT_H */
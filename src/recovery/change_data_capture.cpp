@@ -0,0 +1,190 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "change_data_capture.h"
+
+#include <lineairdb/database.h>
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "types.h"
+
+namespace LineairDB {
+namespace Recovery {
+
+ChangeDataCapture::ChangeDataCapture(const size_t buffer_size)
+    : buffer_size_(buffer_size),
+      active_(false),
+      stop_(false),
+      published_epoch_(0),
+      delivering_(false),
+      next_subscription_id_(1),
+      delivery_thread_([&]() { DeliveryJob(); }) {}
+
+ChangeDataCapture::~ChangeDataCapture() {
+  {
+    std::lock_guard<std::mutex> lock(staged_lock_);
+    stop_ = true;
+  }
+  staged_cv_.notify_all();
+  delivery_thread_.join();
+}
+
+size_t ChangeDataCapture::Subscribe(
+    Database::ChangeStreamCallbackType callback, const EpochNumber from_epoch) {
+  std::lock_guard<std::mutex> lock(subscribers_lock_);
+  const size_t id = next_subscription_id_++;
+  subscribers_.push_back({id, from_epoch, std::move(callback)});
+  active_.store(true);
+  return id;
+}
+
+void ChangeDataCapture::Unsubscribe(const size_t subscription_id) {
+  {
+    std::lock_guard<std::mutex> lock(subscribers_lock_);
+    subscribers_.erase(
+        std::remove_if(subscribers_.begin(), subscribers_.end(),
+                       [&](const Subscriber& subscriber) {
+                         return subscriber.id == subscription_id;
+                       }),
+        subscribers_.end());
+    if (subscribers_.empty()) active_.store(false);
+  }
+  // The delivery in progress may have copied the subscription.
+  if (std::this_thread::get_id() != delivery_thread_.get_id()) {
+    std::lock_guard<std::mutex> delivery(delivery_lock_);
+  }
+}
+
+void ChangeDataCapture::Stage(Logger::LogRecords& records) {
+  std::lock_guard<std::mutex> lock(staged_lock_);
+  for (auto& record : records) {
+    auto& batch = staged_[record.epoch];
+    batch.changes += record.key_value_pairs.size();
+    batch.records.emplace_back(std::move(record));
+  }
+}
+
+void ChangeDataCapture::WaitForCapacity() {
+  // Backpressure: wait for slow subscribers. Only changes in durable epochs
+  // are counted, since the other ones can not be delivered until the workers
+  // report the flush.
+  std::unique_lock<std::mutex> lock(staged_lock_);
+  staged_cv_.wait(lock, [&]() {
+    return stop_ || GetDeliverableChanges() < buffer_size_;
+  });
+}
+
+void ChangeDataCapture::Publish(const EpochNumber durable_epoch) {
+  {
+    std::lock_guard<std::mutex> lock(staged_lock_);
+    published_epoch_ = durable_epoch;
+  }
+  staged_cv_.notify_all();
+}
+
+void ChangeDataCapture::WaitForDelivery(const EpochNumber epoch) {
+  std::unique_lock<std::mutex> lock(staged_lock_);
+  staged_cv_.wait(lock, [&]() {
+    return stop_ || (epoch <= published_epoch_ && !delivering_ &&
+                     (staged_.empty() || epoch < staged_.begin()->first));
+  });
+}
+
+bool ChangeDataCapture::IsDeliverable() {
+  return !staged_.empty() && staged_.begin()->first <= published_epoch_;
+}
+
+size_t ChangeDataCapture::GetDeliverableChanges() {
+  size_t changes = 0;
+  for (auto& [epoch, batch] : staged_) {
+    if (published_epoch_ < epoch) break;
+    changes += batch.changes;
+  }
+  return changes;
+}
+
+void ChangeDataCapture::DeliveryJob() {
+  for (;;) {
+    EpochNumber epoch;
+    Batch batch;
+    {
+      std::unique_lock<std::mutex> lock(staged_lock_);
+      staged_cv_.wait(lock, [&]() { return stop_ || IsDeliverable(); });
+      // NOTE: all durable epochs are delivered before stopping.
+      if (!IsDeliverable()) return;
+      auto it = staged_.begin();
+      epoch   = it->first;
+      batch   = std::move(it->second);
+      staged_.erase(it);
+      delivering_ = true;
+    }
+    Deliver(epoch, batch);
+    {
+      std::lock_guard<std::mutex> lock(staged_lock_);
+      delivering_ = false;
+    }
+    staged_cv_.notify_all();
+  }
+}
+
+void ChangeDataCapture::Deliver(const EpochNumber epoch, Batch& batch) {
+  std::vector<const Logger::LogRecord::KeyValuePair*> kvps;
+  kvps.reserve(batch.changes);
+  for (auto& record : batch.records) {
+    for (auto& kvp : record.key_value_pairs) { kvps.push_back(&kvp); }
+  }
+  // Each commit publishes a new version of a data item (see
+  // DataItem::NextVersion), and thus the writes of a key are delivered in
+  // the order of the commits, whichever threads have logged them.
+  std::stable_sort(kvps.begin(), kvps.end(), [](auto* left, auto* right) {
+    return left->version_with_epoch < right->version_with_epoch;
+  });
+
+  std::vector<Database::Change> changes;
+  changes.reserve(kvps.size());
+  for (auto* kvp : kvps) {
+    changes.push_back(
+        {kvp->captured_key, kvp->value.data(), kvp->size, kvp->expires_at});
+  }
+
+  std::lock_guard<std::mutex> delivery(delivery_lock_);
+  std::vector<Subscriber> subscribers;
+  {
+    std::lock_guard<std::mutex> lock(subscribers_lock_);
+    subscribers = subscribers_;
+  }
+  for (auto& subscriber : subscribers) {
+    if (epoch < subscriber.from_epoch) continue;
+    {  // unsubscribed by an earlier callback of this delivery
+      std::lock_guard<std::mutex> lock(subscribers_lock_);
+      if (std::none_of(subscribers_.begin(), subscribers_.end(),
+                       [&](const Subscriber& subscribed) {
+                         return subscribed.id == subscriber.id;
+                       })) {
+        continue;
+      }
+    }
+    subscriber.callback(epoch, changes);
+  }
+}
+
+}  // namespace Recovery
+}  // namespace LineairDB
@@ -0,0 +1,120 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LINEAIRDB_RECOVERY_CHANGE_DATA_CAPTURE_H
+#define LINEAIRDB_RECOVERY_CHANGE_DATA_CAPTURE_H
+
+#include <lineairdb/database.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "recovery/logger.h"
+#include "types.h"
+
+namespace LineairDB {
+namespace Recovery {
+
+/**
+ * @brief
+ * Delivers the log records to the subscribers of the change stream.
+ * Worker threads stage their log records in memory, without any
+ * serialization, at the time of flushing logs; a background thread delivers
+ * them epoch by epoch once the epoch has become durable.
+ * @note Records of an epoch are staged before the worker thread reports the
+ * flush of the epoch, and thus all records of a durable epoch have been staged
+ * when the epoch is published.
+ */
+class ChangeDataCapture {
+ public:
+  ChangeDataCapture(const size_t buffer_size);
+  ~ChangeDataCapture();
+
+  // Subscription ids are positive; see Database::Subscribe.
+  size_t Subscribe(Database::ChangeStreamCallbackType callback,
+                   const EpochNumber from_epoch);
+  /**
+   * @brief
+   * Removes the subscription and waits for the delivery in progress, unless
+   * called by a callback (i.e., by the delivery thread).
+   */
+  void Unsubscribe(const size_t subscription_id);
+  bool IsActive() const { return active_.load(); }
+
+  /**
+   * @brief
+   * Moves the log records into the staging area, without blocking.
+   */
+  void Stage(Logger::LogRecords& records);
+  /**
+   * @brief
+   * Blocks while the number of undelivered changes in durable epochs exceeds
+   * the buffer size. Called by the worker threads between their jobs, so
+   * that the backpressure never stalls the epoch.
+   */
+  void WaitForCapacity();
+  void Publish(const EpochNumber durable_epoch);
+
+  /**
+   * @brief
+   * Blocks until the given epoch has become durable and all the changes of
+   * the epochs up to it have been delivered to the subscribers.
+   */
+  void WaitForDelivery(const EpochNumber epoch);
+
+ private:
+  struct Subscriber {
+    size_t id;
+    EpochNumber from_epoch;
+    Database::ChangeStreamCallbackType callback;
+  };
+  struct Batch {
+    Logger::LogRecords records;
+    size_t changes = 0;
+  };
+
+  void DeliveryJob();
+  void Deliver(const EpochNumber epoch, Batch& batch);
+  bool IsDeliverable();
+  size_t GetDeliverableChanges();
+
+  const size_t buffer_size_;
+  std::atomic<bool> active_;
+  bool stop_;
+
+  std::mutex staged_lock_;
+  std::condition_variable staged_cv_;
+  std::map<EpochNumber, Batch> staged_;
+  EpochNumber published_epoch_;
+  bool delivering_;
+
+  std::mutex subscribers_lock_;
+  std::vector<Subscriber> subscribers_;
+  size_t next_subscription_id_;
+  // Held by the delivery thread while it invokes the callbacks, which are
+  // invoked without subscribers_lock_ so that they may (un)subscribe.
+  std::mutex delivery_lock_;
+
+  std::thread delivery_thread_;
+};
+
+}  // namespace Recovery
+}  // namespace LineairDB
+#endif /* LINEAIRDB_RECOVERY_CHANGE_DATA_CAPTURE_H */
@@ -21,6 +21,7 @@
 #include <lineairdb/tx_status.h>
 #include <types.h>
 
+#include <algorithm>
 #include <cstring>
 #include <experimental/filesystem>
 #include <fstream>
@@ -34,50 +35,180 @@
 namespace LineairDB {
 namespace Recovery {
 
-ThreadLocalLogger::ThreadLocalLogger() { LineairDB::Util::SetUpSPDLog(); }
+ThreadLocalLogger::ThreadLocalLogger(ChangeDataCapture& change_data_capture,
+                                     const size_t flush_threshold,
+                                     const size_t partitions)
+    : change_data_capture_(change_data_capture),
+      flush_threshold_(flush_threshold),
+      partitions_(partitions),
+      writer_stopped_(false) {
+  LineairDB::Util::SetUpSPDLog();
+  // Thread ids continue from the files of earlier instances, so that their
+  // logs are never overwritten.
+  for (auto& filename : Logger::GetLogFiles()) {
+    size_t thread_id, partition, partitions;
+    Logger::ParseLogFileName(filename, thread_id, partition, partitions);
+    auto next = ThreadIdCounter.load();
+    while (next <= thread_id &&
+           !ThreadIdCounter.compare_exchange_weak(next, thread_id + 1)) {}
+  }
+  if (0 < flush_threshold_) writer_ = std::thread([&]() { WriterJob(); });
+}
 
-void ThreadLocalLogger::RememberMe(const EpochNumber epoch) {
+ThreadLocalLogger::~ThreadLocalLogger() {
+  if (!writer_.joinable()) return;
+  {
+    std::lock_guard<std::mutex> lock(writer_lock_);
+    writer_stopped_ = true;
+  }
+  writer_wakeup_.notify_one();
+  writer_.join();
+}
+
+ThreadLocalLogger::ThreadLocalStorageNode* ThreadLocalLogger::GetMyStorage() {
   auto* my_storage = thread_key_storage_.Get();
+  if (my_storage->partitions.empty()) {
+    const size_t files = std::max<size_t>(partitions_, 1);
+    for (size_t partition = 0; partition < files; partition++) {
+      my_storage->partitions.push_back(
+          {std::ofstream(Logger::GetLogFileName(my_storage->thread_id,
+                                                partition, partitions_),
+                         std::ofstream::out | std::ofstream::binary |
+                             std::ofstream::app),
+           {}});
+    }
+  }
+  return my_storage;
+}
+
+void ThreadLocalLogger::RememberMe(const EpochNumber epoch) {
+  auto* my_storage = GetMyStorage();
   my_storage->durable_epoch.store(epoch);
 }
 
 void ThreadLocalLogger::Enqueue(const WriteSetType& ws_ref, EpochNumber epoch) {
   if (ws_ref.empty()) return;
 
-  /** Make log record and add it into local buffer  **/
-  Recovery::Logger::LogRecord record;
-  record.epoch = epoch;
+  /** Add the writes into the log record of this epoch in local buffers **/
+  auto* my_storage   = GetMyStorage();
+  auto& partitions   = my_storage->partitions;
+  size_t record_size = 0;
 
   for (auto& snapshot : ws_ref) {
-    assert(snapshot.size < 256 &&
-           "WANTFIX: LineairDB's log manager can hold only 256-bytes for a "
-           "buffer of a single write operation.");
     Logger::LogRecord::KeyValuePair kvp;
-    kvp.key = snapshot.key;
-    std::memcpy(reinterpret_cast<void*>(&kvp.value), snapshot.value_copy,
-                snapshot.size);
+    auto* item    = snapshot.index_cache;
+    kvp.record_id = item->record_id;
+    kvp.has_key   = false;
+    kvp.key_hash  = 0;
+    // Log the key if no record of an earlier (or the same) epoch contains it.
+    auto logged_epoch = item->key_logged_epoch.load();
+    while (epoch < logged_epoch) {
+      if (item->key_logged_epoch.compare_exchange_weak(logged_epoch, epoch)) {
+        kvp.has_key  = true;
+        kvp.key      = snapshot.key;
+        kvp.key_hash = snapshot.key_hash;
+        break;
+      }
+    }
+    kvp.value.assign(snapshot.value_copy, snapshot.value_copy + snapshot.size);
     kvp.size               = snapshot.size;
     kvp.version_with_epoch = snapshot.version_in_epoch;
+    kvp.expires_at         = snapshot.expires_at;
+    if (change_data_capture_.IsActive()) kvp.captured_key = snapshot.key;
+
+    // All the records of a data item are in the partition of its key, and
+    // thus the partitions can be recovered independently.
+    auto& records = partitions[partitions_ == 0
+                                   ? 0
+                                   : snapshot.key_hash % partitions_]
+                        .log_records;
+    if (records.empty() || records.back().epoch != epoch) {
+      records.emplace_back();
+      records.back().epoch = epoch;
+      record_size += sizeof(Logger::LogRecord);
+    }
+    record_size += sizeof(kvp) + kvp.key.size() + kvp.value.size();
+    records.back().key_value_pairs.emplace_back(std::move(kvp));
+  }
+  my_storage->buffered_bytes += record_size;
 
-    record.key_value_pairs.emplace_back(std::move(kvp));
+  // Records written in the middle of an epoch are not yet durable: the
+  // durable epoch of this thread advances only in #FlushLogs, and recovery
+  // ignores the records beyond the durable epoch.
+  if (0 < flush_threshold_ && flush_threshold_ <= my_storage->buffered_bytes) {
+    HandOver(my_storage);
   }
-  auto* my_storage = thread_key_storage_.Get();
-  my_storage->log_records.emplace_back(std::move(record));
 }
 
-void ThreadLocalLogger::FlushLogs(EpochNumber stable_epoch) {
-  auto* my_storage = thread_key_storage_.Get();
+void ThreadLocalLogger::HandOver(ThreadLocalStorageNode* my_storage) {
+  WriteJob job = {my_storage, {}};
+  for (auto& partition : my_storage->partitions) {
+    job.records.emplace_back(std::move(partition.log_records));
+    partition.log_records.clear();
+  }
+  my_storage->buffered_bytes = 0;
+  {
+    std::lock_guard<std::mutex> lock(writer_lock_);
+    my_storage->pending_writes++;
+    write_jobs_.push(std::move(job));
+  }
+  writer_wakeup_.notify_one();
+}
 
-  if (!my_storage->log_records.empty()) {
-    msgpack::pack(my_storage->log_file, my_storage->log_records);
-    my_storage->log_file << std::endl;
-    my_storage->log_file.flush();
-    my_storage->log_records.clear();
+void ThreadLocalLogger::WriterJob() {
+  std::unique_lock<std::mutex> lock(writer_lock_);
+  for (;;) {
+    writer_wakeup_.wait(
+        lock, [&]() { return writer_stopped_ || !write_jobs_.empty(); });
+    if (write_jobs_.empty()) return;
+    auto job = std::move(write_jobs_.front());
+    write_jobs_.pop();
+    lock.unlock();
+    for (size_t i = 0; i < job.records.size(); i++) {
+      WriteRecords(job.storage->partitions[i], job.records[i]);
+    }
+    lock.lock();
+    job.storage->pending_writes--;
+    writes_done_.notify_all();
+  }
+}
+
+void ThreadLocalLogger::FlushLogs(EpochNumber stable_epoch) {
+  auto* my_storage = GetMyStorage();
+  if (writer_.joinable()) {
+    // The records handed over precede the buffered ones in the files.
+    std::unique_lock<std::mutex> lock(writer_lock_);
+    writes_done_.wait(lock, [&]() { return my_storage->pending_writes == 0; });
   }
 
+  // NOTE: records must be staged before storing the durable epoch below.
+  WriteBufferedRecords(my_storage);
+  for (auto& partition : my_storage->partitions) {
+    partition.log_file.flush();
+  }
+  // This worker is between its jobs, i.e., offline, and thus waiting for
+  // slow subscribers never stalls the epoch.
+  if (change_data_capture_.IsActive()) change_data_capture_.WaitForCapacity();
   my_storage->durable_epoch.store(stable_epoch);
 }
 
+void ThreadLocalLogger::WriteBufferedRecords(
+    ThreadLocalStorageNode* my_storage) {
+  for (auto& partition : my_storage->partitions) {
+    WriteRecords(partition, partition.log_records);
+  }
+  my_storage->buffered_bytes = 0;
+}
+
+void ThreadLocalLogger::WriteRecords(Partition& partition,
+                                     Logger::LogRecords& records) {
+  if (records.empty()) return;
+  msgpack::pack(partition.log_file, records);
+  // Staged records are delivered once their epochs have become durable.
+  if (change_data_capture_.IsActive()) change_data_capture_.Stage(records);
+  records.clear();
+}
+
 EpochNumber ThreadLocalLogger::GetMinDurableEpochForAllThreads() {
   EpochNumber min_flushed_epoch = EpochFramework::THREAD_OFFLINE;
   thread_key_storage_.ForEach(
@@ -88,8 +219,7 @@ EpochNumber ThreadLocalLogger::GetMinDurableEpochForAllThreads() {
   return min_flushed_epoch;
 }
 
-std::atomic<size_t> ThreadLocalLogger::ThreadLocalStorageNode::ThreadIdCounter =
-    {0};
+std::atomic<size_t> ThreadLocalLogger::ThreadIdCounter = {0};
 
 }  // namespace Recovery
 }  // namespace LineairDB
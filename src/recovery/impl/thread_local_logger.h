@@ -20,13 +20,18 @@
 #include <lineairdb/tx_status.h>
 #include <stdio.h>
 
+#include <condition_variable>
 #include <cstdio>
 #include <fstream>
 #include <functional>
 #include <msgpack.hpp>
+#include <mutex>
 #include <queue>
 #include <sstream>
+#include <thread>
+#include <vector>
 
+#include "recovery/change_data_capture.h"
 #include "recovery/logger.h"
 #include "recovery/logger_base.h"
 #include "types.h"
@@ -38,36 +43,82 @@ namespace Recovery {
 
 class ThreadLocalLogger final : public LoggerBase {
  public:
-  ThreadLocalLogger();
+  /**
+   * @param flush_threshold If positive, a thread hands its buffered records
+   * over to the writer thread as soon as they exceed this size in bytes.
+   * @param partitions If positive, each thread writes its records into this
+   * number of files, partitioned by the hash values of keys.
+   */
+  ThreadLocalLogger(ChangeDataCapture& change_data_capture,
+                    const size_t flush_threshold, const size_t partitions);
+  ~ThreadLocalLogger();
   void RememberMe(const EpochNumber) final override;
   void Enqueue(const WriteSetType& ws_ref_, EpochNumber epoch) final override;
   void FlushLogs(EpochNumber stable_epoch) final override;
   EpochNumber GetMinDurableEpochForAllThreads() final override;
 
  private:
-  struct ThreadLocalStorageNode {
-   private:
-    static std::atomic<size_t> ThreadIdCounter;
+  static std::atomic<size_t> ThreadIdCounter;
 
-   public:
-    size_t thread_id;
-    std::atomic<EpochNumber> durable_epoch;
+  struct Partition {
     std::ofstream log_file;
     Logger::LogRecords log_records;
-    MSGPACK_DEFINE(log_records);
+  };
+  struct ThreadLocalStorageNode {
+    size_t thread_id;
+    std::atomic<EpochNumber> durable_epoch;
+    // Opened at the first access of the thread; see #GetMyStorage.
+    std::vector<Partition> partitions;
+    // Approximate size of the buffered records, compared with the flush
+    // threshold.
+    size_t buffered_bytes;
+    // The buffers handed over to the writer thread and not yet written; the
+    // log files are accessed only by the writer while it is positive.
+    // Guarded by #writer_lock_.
+    size_t pending_writes;
 
     ThreadLocalStorageNode()
         : thread_id(ThreadIdCounter.fetch_add(1)),
           durable_epoch(0),
-          log_file(
-              "lineairdb_logs/thread" + std::to_string(thread_id) + ".json",
-              std::ofstream::out | std::ofstream::binary | std::ofstream::ate) {
-    }
+          buffered_bytes(0),
+          pending_writes(0) {}
     ~ThreadLocalStorageNode() {}
   };
+  // Buffered records of a thread, per partition, to be written by the writer
+  // thread.
+  struct WriteJob {
+    ThreadLocalStorageNode* storage;
+    std::vector<Logger::LogRecords> records;
+  };
+
+  ThreadLocalStorageNode* GetMyStorage();
+  /**
+   * Writes the buffered records into the log files, without flushing them.
+   * Log files are sequences of msgpack objects, each of which is an array of
+   * LogRecord.
+   */
+  void WriteBufferedRecords(ThreadLocalStorageNode* my_storage);
+  void WriteRecords(Partition& partition, Logger::LogRecords& records);
+  /**
+   * Hands the buffered records over to the writer thread, so that the worker
+   * never writes the files in the middle of an epoch, while it is online.
+   */
+  void HandOver(ThreadLocalStorageNode* my_storage);
+  void WriterJob();
 
  private:
+  ChangeDataCapture& change_data_capture_;
+  const size_t flush_threshold_;
+  const size_t partitions_;
   ThreadKeyStorage<ThreadLocalStorageNode> thread_key_storage_;
+
+  // The writer thread, running only with a positive flush threshold.
+  std::mutex writer_lock_;
+  std::condition_variable writer_wakeup_;
+  std::condition_variable writes_done_;
+  std::queue<WriteJob> write_jobs_;
+  bool writer_stopped_;
+  std::thread writer_;
 };
 
 }  // namespace Recovery
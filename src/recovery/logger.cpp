@@ -16,11 +16,15 @@
 
 #include "logger.h"
 
+#include <fcntl.h>
 #include <glob.h>
 #include <lineairdb/config.h>
 #include <lineairdb/database.h>
 #include <lineairdb/tx_status.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <cstdio>
 #include <cstring>
 #include <experimental/filesystem>
 #include <fstream>
@@ -28,26 +32,56 @@
 #include <iostream>
 #include <memory>
 #include <msgpack.hpp>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <util/logger.hpp>
 
+#include "change_data_capture.h"
 #include "impl/thread_local_logger.h"
 #include "types.h"
 
 namespace LineairDB {
 namespace Recovery {
 
+static inline std::vector<std::string> glob(const std::string& pat) {
+  using namespace std;
+  glob_t glob_result;
+  ::glob(pat.c_str(), GLOB_TILDE, NULL, &glob_result);
+  vector<string> ret;
+  for (unsigned int i = 0; i < glob_result.gl_pathc; ++i) {
+    ret.push_back(string(glob_result.gl_pathv[i]));
+  }
+  globfree(&glob_result);
+  return ret;
+}
+
 Logger::Logger(const Config& config)
-    : durable_epoch_(0),
+    : change_data_capture_(std::make_unique<ChangeDataCapture>(
+          config.change_stream_buffer_size)),
+      durable_epoch_(0),
       durable_epoch_working_file_(DurableEpochNumberWorkingFileName,
                                   std::ofstream::trunc) {
   std::experimental::filesystem::create_directory("lineairdb_logs");
   LineairDB::Util::SetUpSPDLog();
+  // Logs of an earlier instance are not replayed by this instance, and
+  // would be mixed up with the logs of this instance by a later recovery.
+  if (config.enable_logging && !config.enable_recovery) {
+    for (auto& filename : GetLogFiles()) {
+      std::experimental::filesystem::remove(filename);
+    }
+    std::experimental::filesystem::remove(DurableEpochNumberFileName);
+  }
   switch (config.logger) {
     case Config::Logger::ThreadLocalLogger:
-      logger_ = std::make_unique<ThreadLocalLogger>();
+      logger_ = std::make_unique<ThreadLocalLogger>(
+          *change_data_capture_, config.log_flush_threshold,
+          config.log_partitions);
       break;
     default:
-      logger_ = std::make_unique<ThreadLocalLogger>();
+      logger_ = std::make_unique<ThreadLocalLogger>(
+          *change_data_capture_, config.log_flush_threshold,
+          config.log_partitions);
       break;
   }
 }
@@ -87,9 +121,21 @@ EpochNumber Logger::FlushDurableEpoch() {
   durable_epoch_working_file_.open(DurableEpochNumberWorkingFileName,
                                    std::fstream::trunc);
 
+  change_data_capture_->Publish(durable_epoch_);
   return durable_epoch_;
 }
 
+size_t Logger::Subscribe(Database::ChangeStreamCallbackType callback,
+                         const EpochNumber from_epoch) {
+  return change_data_capture_->Subscribe(std::move(callback), from_epoch);
+}
+void Logger::Unsubscribe(const size_t subscription_id) {
+  change_data_capture_->Unsubscribe(subscription_id);
+}
+void Logger::WaitForChangeDelivery(const EpochNumber epoch) {
+  change_data_capture_->WaitForDelivery(epoch);
+}
+
 EpochNumber Logger::GetDurableEpoch() { return durable_epoch_; }
 void Logger::SetDurableEpoch(const EpochNumber e) { durable_epoch_ = e; }
 
@@ -110,39 +156,170 @@ EpochNumber Logger::GetDurableEpochFromLog() {
   return epoch;
 }
 
-static inline std::vector<std::string> glob(const std::string& pat) {
-  using namespace std;
-  glob_t glob_result;
-  ::glob(pat.c_str(), GLOB_TILDE, NULL, &glob_result);
-  vector<string> ret;
-  for (unsigned int i = 0; i < glob_result.gl_pathc; ++i) {
-    ret.push_back(string(glob_result.gl_pathv[i]));
+
+std::string Logger::GetLogFileName(const size_t thread_id,
+                                   const size_t partition,
+                                   const size_t partitions) {
+  std::string filename = "lineairdb_logs/thread" + std::to_string(thread_id);
+  if (0 < partitions) {
+    filename += "_partition" + std::to_string(partition) + "of" +
+                std::to_string(partitions);
   }
-  globfree(&glob_result);
-  return ret;
+  return filename + ".json";
 }
 
-WriteSetType Logger::GetRecoverySetFromLogs(const EpochNumber durable_epoch) {
-  auto logfiles = glob("lineairdb_logs/thread*");
+bool Logger::ParseLogFileName(const std::string& filename, size_t& thread_id,
+                              size_t& partition, size_t& partitions) {
+  const auto basename =
+      std::experimental::filesystem::path(filename).filename().string();
+  int length = 0;
+  if (sscanf(basename.c_str(), "thread%zu_partition%zuof%zu.json%n",
+             &thread_id, &partition, &partitions, &length) == 3 &&
+      static_cast<size_t>(length) == basename.size() &&
+      partition < partitions) {
+    return true;
+  }
+  partition = partitions = 0;
+  length                 = 0;
+  return sscanf(basename.c_str(), "thread%zu.json%n", &thread_id, &length) ==
+             1 &&
+         static_cast<size_t>(length) == basename.size();
+}
+
+std::vector<std::string> Logger::GetLogFiles() {
+  std::vector<std::string> logfiles;
+  for (auto& filename : glob("lineairdb_logs/thread*")) {
+    size_t thread_id, partition, partitions;
+    if (ParseLogFileName(filename, thread_id, partition, partitions)) {
+      logfiles.push_back(filename);
+    }
+  }
+  return logfiles;
+}
+
+std::vector<std::vector<std::string>> Logger::GetLogFileGroups() {
+  auto logfiles = GetLogFiles();
+  size_t partitions_of_all = 0;
+  for (auto& filename : logfiles) {
+    size_t thread_id, partition, partitions;
+    ParseLogFileName(filename, thread_id, partition, partitions);
+    if (partitions == 0 ||
+        (partitions_of_all != 0 && partitions_of_all != partitions)) {
+      return {logfiles};
+    }
+    partitions_of_all = partitions;
+  }
+  if (partitions_of_all == 0) return {logfiles};
+
+  std::vector<std::vector<std::string>> groups(partitions_of_all);
+  for (auto& filename : logfiles) {
+    size_t thread_id, partition, partitions;
+    ParseLogFileName(filename, thread_id, partition, partitions);
+    groups[partition].push_back(filename);
+  }
+  return groups;
+}
+
+void Logger::RewriteLogFile(const std::string& filename, const size_t length,
+                            const LogRecords& appended) {
+  const auto working = filename + ".rewriting";
+  {
+    std::ifstream in(filename, std::ifstream::in | std::ifstream::binary);
+    std::ofstream out(working, std::ofstream::out | std::ofstream::binary |
+                                   std::ofstream::trunc);
+    std::vector<char> buffer(ReadBufferSize);
+    for (size_t copied = 0; copied < length && in.good();) {
+      in.read(buffer.data(), std::min(buffer.size(), length - copied));
+      out.write(buffer.data(), in.gcount());
+      copied += in.gcount();
+    }
+    if (!appended.empty()) msgpack::pack(out, appended);
+    out.flush();
+    if (!in.good() || !out.good()) {
+      SPDLOG_ERROR("    fail to rewrite the log file {0}", filename);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // NOTE POSIX ensures that rename syscall provides atomicity; the content
+  // and then the directory entry are synced so that a crash leaves either
+  // the original or the rewritten file.
+  auto sync = [](const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    return 0 <= fd && fsync(fd) == 0 && close(fd) == 0;
+  };
+  if (!sync(working) || rename(working.c_str(), filename.c_str()) ||
+      !sync(std::experimental::filesystem::path(filename)
+                .parent_path()
+                .string())) {
+    SPDLOG_ERROR("    fail to replace the log file {0}. errno: {1}", filename,
+                 errno);
+    exit(EXIT_FAILURE);
+  }
+}
+
+WriteSetType Logger::GetRecoverySetFromLogs(
+    const EpochNumber durable_epoch, const std::vector<std::string>& logfiles,
+    uint64_t& highest_record_id) {
+  highest_record_id = 0;
   SPDLOG_DEBUG("Replay the logs in epoch 0-{0}", durable_epoch);
-  WriteSetType recovery_set;
-  recovery_set.clear();
+
+  // Log records refer data items by record ids; the key of each id appears in
+  // one (or a few) of the records, which may be in any file.
+  struct RecoveryEntry {
+    std::string key;
+    bool has_key;
+    uint64_t key_hash;
+    DataItem* item;
+  };
+  std::unordered_map<uint64_t, RecoveryEntry> entries;
 
   for (auto filename : logfiles) {
     std::ifstream file(filename, std::ifstream::in | std::ifstream::binary);
     SPDLOG_DEBUG(" Recovery filename {0}", filename);
     if (!file.good()) exit(EXIT_FAILURE);
-    LogRecord log_record;
 
-    std::string line;
-    while (std::getline(file, line)) {
+    // A log file is a sequence of msgpack objects. Since msgpack data may
+    // contain newlines, the file is read by the streaming unpacker instead of
+    // by lines. An incomplete object at the end (a write torn by a crash) is
+    // ignored; it contains only records beyond the durable epoch.
+    // Records beyond the durable epoch have never been acknowledged. They
+    // are removed from the file: otherwise, a later recovery with a higher
+    // durable epoch would replay them over the writes acknowledged after this
+    // recovery. The file is cut at the first object containing such a record,
+    // and the durable records after the cut are appended again; see
+    // #RewriteLogFile.
+    msgpack::unpacker unpacker;
+    msgpack::object_handle oh;
+    size_t parsed  = 0;  // the end of the last object read
+    size_t cut_at  = 0;
+    bool cut       = false;
+    bool truncated = false;  // the tail is torn or corrupted
+    LogRecords kept;
+    for (;;) {
       LogRecords log_records;
       try {
-        // TODO FIXME:
-        // msgpack::unpack sometimes hang-up.
-        msgpack::object_handle oh = msgpack::unpack(line.data(), line.size());
-        msgpack::object obj       = oh.get();
-        obj.convert(log_records);
+        if (!unpacker.next(oh)) {
+          if (!file.good()) break;
+          unpacker.reserve_buffer(ReadBufferSize);
+          file.read(unpacker.buffer(), ReadBufferSize);
+          unpacker.buffer_consumed(file.gcount());
+          continue;
+        }
+        const size_t begin = parsed;
+        parsed             = unpacker.parsed_size();
+        oh.get().convert(log_records);
+        if (!cut) {
+          cut_at = begin;
+          cut    = std::any_of(
+              log_records.begin(), log_records.end(),
+              [&](const LogRecord& r) { return durable_epoch < r.epoch; });
+        }
+      } catch (const msgpack::unpack_error& e) {
+        SPDLOG_WARN("    ignore the corrupted tail of {0}: {1}", filename,
+                    e.what());
+        truncated = true;
+        break;
       } catch (const std::bad_cast& e) {
         SPDLOG_ERROR("    msgpack deserialize failure: {0}", e.what());
         exit(EXIT_FAILURE);
@@ -150,40 +327,86 @@ WriteSetType Logger::GetRecoverySetFromLogs(const EpochNumber durable_epoch) {
 
       for (auto& log_record : log_records) {
         assert(0 < log_record.epoch);
-        if (log_record.epoch <= durable_epoch) {
-          for (auto& kvp : log_record.key_value_pairs) {
-            SPDLOG_DEBUG("    kvp", kvp.key);
-            bool not_found = true;
-            for (auto& item : recovery_set) {
-              if (item.key == kvp.key) {
-                not_found = false;
-                if (item.index_cache->transaction_id.load() <
-                    kvp.version_with_epoch) {
-                  item.index_cache->Reset(
-                      reinterpret_cast<std::byte*>(&kvp.value), kvp.size);
-                  item.index_cache->transaction_id = kvp.version_with_epoch;
-                  SPDLOG_DEBUG("    update-> key {0}, version {1} in epoch {2}",
-                               kvp.key, kvp.version_with_epoch & (~0llu >> 32),
-                               kvp.version_with_epoch >> 32);
-                }
-              }
-            }
-            if (not_found) {
-              SPDLOG_DEBUG("    insert-> key {0}, version {1} in epoch {2}",
-                           kvp.key, kvp.version_with_epoch & (~0llu >> 32),
-                           kvp.version_with_epoch >> 32);
-              recovery_set.push_back(
-                  {kvp.key, nullptr, 0,
-                   new DataItem(reinterpret_cast<std::byte*>(&kvp.value),
-                                kvp.size, kvp.version_with_epoch),
-                   kvp.version_with_epoch});
-            }
+        if (durable_epoch < log_record.epoch) continue;
+        if (cut) kept.push_back(log_record);
+        for (auto& kvp : log_record.key_value_pairs) {
+          highest_record_id = std::max(highest_record_id, kvp.record_id);
+          auto it = entries.find(kvp.record_id);
+          if (it == entries.end()) {
+            SPDLOG_DEBUG("    insert-> id {0}, version {1} in epoch {2}",
+                         kvp.record_id, kvp.version_with_epoch & (~0llu >> 32),
+                         kvp.version_with_epoch >> 32);
+            auto* item      = new DataItem(kvp.value.data(), kvp.size,
+                                           kvp.version_with_epoch);
+            item->record_id  = kvp.record_id;
+            item->expires_at = kvp.expires_at;
+            item->key_logged_epoch.store(0);
+            entries.emplace(kvp.record_id, RecoveryEntry{kvp.key, kvp.has_key,
+                                                         kvp.key_hash, item});
+            continue;
+          }
+
+          auto& entry = it->second;
+          if (kvp.has_key && !entry.has_key) {
+            entry.key      = kvp.key;
+            entry.has_key  = true;
+            entry.key_hash = kvp.key_hash;
+          }
+          if (entry.item->transaction_id.load() < kvp.version_with_epoch) {
+            entry.item->Reset(kvp.value.data(), kvp.size);
+            entry.item->transaction_id = kvp.version_with_epoch;
+            entry.item->expires_at     = kvp.expires_at;
+            SPDLOG_DEBUG("    update-> id {0}, version {1} in epoch {2}",
+                         kvp.record_id, kvp.version_with_epoch & (~0llu >> 32),
+                         kvp.version_with_epoch >> 32);
           }
         }
       }
     }
 
     SPDLOG_DEBUG(" Close filename {0}", filename);
+    file.close();
+    if (0 < unpacker.nonparsed_size()) truncated = true;  // torn by a crash
+    if (cut || truncated) {
+      SPDLOG_INFO("    discard the records beyond the durable epoch in {0}",
+                  filename);
+      RewriteLogFile(filename, cut ? cut_at : parsed, kept);
+    }
+  }
+
+  // A key may have several record ids, if the reaper has removed its data item
+  // and it has been written again; the latest version of the key is kept.
+  // All the records of a key are in the same group of files.
+  WriteSetType recovery_set;
+  recovery_set.reserve(entries.size());
+  std::unordered_map<std::string_view, size_t> positions;
+  for (auto& [record_id, entry] : entries) {
+    if (!entry.has_key) {
+      SPDLOG_ERROR("    the key of record id {0} is not found in the logs",
+                   record_id);
+      delete entry.item;
+      continue;
+    }
+    if (entry.item->IsExpired()) {
+      delete entry.item;
+      continue;
+    }
+    const auto version = entry.item->transaction_id.load();
+    auto it            = positions.find(entry.key);
+    if (it != positions.end()) {
+      auto& recovered = recovery_set[it->second];
+      if (version < recovered.version_in_epoch) {
+        delete entry.item;
+        continue;
+      }
+      delete recovered.index_cache;
+      recovered.index_cache      = entry.item;
+      recovered.version_in_epoch = version;
+      continue;
+    }
+    positions.emplace(entry.key, recovery_set.size());
+    recovery_set.push_back(
+        {entry.key, entry.key_hash, nullptr, 0, entry.item, version});
   }
   return recovery_set;
 }
@@ -17,10 +17,13 @@
 #define LINEAIRDB_RECOVERY_LOGGER_H
 
 #include <lineairdb/config.h>
+#include <lineairdb/database.h>
 
 #include <fstream>
 #include <memory>
 #include <msgpack.hpp>
+#include <string>
+#include <vector>
 
 #include "logger_base.h"
 #include "types.h"
@@ -28,6 +31,8 @@
 namespace LineairDB {
 namespace Recovery {
 
+class ChangeDataCapture;
+
 class Logger {
  public:
   constexpr static EpochNumber NumberIsNotUpdated = 0;
@@ -35,6 +40,7 @@ class Logger {
       "lineairdb_logs/durable_epoch.json";
   constexpr static auto DurableEpochNumberWorkingFileName =
       "lineairdb_logs/durable_epoch_working.json";
+  constexpr static size_t ReadBufferSize = 1 << 20;
 
   Logger(const Config&);
   ~Logger();
@@ -48,15 +54,64 @@ class Logger {
   EpochNumber GetDurableEpoch();
   void SetDurableEpoch(const EpochNumber);
   static EpochNumber GetDurableEpochFromLog();
-  static WriteSetType GetRecoverySetFromLogs(const EpochNumber durable_epoch);
+  size_t Subscribe(Database::ChangeStreamCallbackType callback,
+                   const EpochNumber from_epoch);
+  void Unsubscribe(const size_t subscription_id);
+  void WaitForChangeDelivery(const EpochNumber epoch);
+
+  /**
+   * Log files are named `thread<N>.json` if the logs are partitioned only by
+   * threads, or `thread<N>_partition<P>of<K>.json` if they are further
+   * partitioned by the hash values of keys (see Config::log_partitions).
+   * Thread ids are never reused across instances, and thus the files of
+   * earlier instances are kept intact.
+   */
+  static std::string GetLogFileName(const size_t thread_id,
+                                    const size_t partition,
+                                    const size_t partitions);
+  /**
+   * @return false if the filename is not of a log file.
+   */
+  static bool ParseLogFileName(const std::string& filename, size_t& thread_id,
+                               size_t& partition, size_t& partitions);
+  static std::vector<std::string> GetLogFiles();
+  /**
+   * @return the log files grouped so that all the records of each data item
+   * are in the same group. Each group can be replayed independently; if the
+   * files are not partitioned by keys (or the number of partitions has been
+   * changed), all of them are in a single group.
+   */
+  static std::vector<std::vector<std::string>> GetLogFileGroups();
+  /**
+   * @param highest_record_id is set to the highest record id in the files,
+   * including the ones of the records that are not recovered (e.g., expired
+   * ones); new data items must not reuse any of them.
+   */
+  static WriteSetType GetRecoverySetFromLogs(
+      const EpochNumber durable_epoch, const std::vector<std::string>& files,
+      uint64_t& highest_record_id);
 
   struct LogRecord {
     struct KeyValuePair {
+      uint64_t record_id;
+      // The mapping from the record id to the key is logged only once, i.e.,
+      // in the first log record of each data item.
+      bool has_key;
       std::string key;
-      std::array<std::byte, 256> value;
+      std::vector<std::byte> value;
       size_t size;
       uint64_t version_with_epoch;
-      MSGPACK_DEFINE(key, value, size, version_with_epoch);
+      // Util::HashKey(key) if has_key, so that recovery need not rehash the
+      // keys.
+      uint64_t key_hash;
+      // DataItem::expires_at of the value.
+      uint64_t expires_at;
+      MSGPACK_DEFINE(record_id, has_key, key, value, size, version_with_epoch,
+                     key_hash, expires_at);
+
+      // Not serialized: the key is always held for the change stream, only
+      // if there exist subscribers.
+      std::string captured_key;
     };
 
     EpochNumber epoch;
@@ -68,6 +123,15 @@ class Logger {
   typedef std::vector<LogRecord> LogRecords;
 
  private:
+  /**
+   * Replaces the given log file with its first length bytes followed by the
+   * given records. The new content is written into a working file, which is
+   * synced and renamed over the original one.
+   */
+  static void RewriteLogFile(const std::string& filename, const size_t length,
+                             const LogRecords& appended);
+
+  std::unique_ptr<ChangeDataCapture> change_data_capture_;
   std::unique_ptr<LoggerBase> logger_;
   EpochNumber durable_epoch_;
   std::ofstream durable_epoch_working_file_;
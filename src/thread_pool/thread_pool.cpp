@@ -31,12 +31,17 @@ ThreadPool::ThreadPool(size_t pool_size)
     : stop_(false),
       shutdown_(false),
       work_queues_(pool_size),
-      no_steal_queues_(pool_size) {
+      no_steal_queues_(pool_size),
+      deadline_queues_(pool_size),
+      notifications_(0) {
   assert(work_queues_.size() == pool_size);
   for (size_t i = 0; i < pool_size; i++) {
     worker_threads_.emplace_back([&]() {
+      uint64_t handled       = 0;
+      size_t deadline_streak = 0;
       for (;;) {
-        Dequeue();
+        HandleNotification(handled);
+        Dequeue(deadline_streak);
         if (stop_ && IsEmpty() && shutdown_) { break; }
       }
     });
@@ -46,13 +51,22 @@ ThreadPool::ThreadPool(size_t pool_size)
 ThreadPool::~ThreadPool() {
   stop_     = true;
   shutdown_ = true;
-  for (auto& thread : worker_threads_) { thread.join(); }
+  for (auto& thread : worker_threads_) {
+    if (thread.joinable()) thread.join();
+  }
 }
 
 size_t ThreadPool::GetPoolSize() const { return worker_threads_.size(); }
 void ThreadPool::StopAcceptingTransactions() { stop_ = true; }
 void ThreadPool::ResumeAcceptingTransactions() { stop_ = false; }
-void ThreadPool::Shutdown() { shutdown_ = true; }
+// NOTE: joins the workers so that no job or notification handler is running
+// after this method returns.
+void ThreadPool::Shutdown() {
+  shutdown_ = true;
+  for (auto& thread : worker_threads_) {
+    if (thread.joinable()) thread.join();
+  }
+}
 
 bool ThreadPool::Enqueue(std::function<void()>&& job) {
   if (stop_) return false;
@@ -61,6 +75,16 @@ bool ThreadPool::Enqueue(std::function<void()>&& job) {
   return queue.enqueue(job);
 }
 
+bool ThreadPool::Enqueue(std::function<void()>&& job, const Deadline deadline) {
+  if (stop_) return false;
+  thread_local static std::mt19937 random(0xDEADBEEF);
+  auto& queue = deadline_queues_[random() % deadline_queues_.size()];
+  std::lock_guard<std::mutex> lock(queue.lock);
+  queue.jobs.push({deadline, std::move(job)});
+  queue.size.fetch_add(1);
+  return true;
+}
+
 bool ThreadPool::EnqueueForAllThreads(std::function<void()>&& job) {
   if (stop_) return false;
   for (auto& queue : no_steal_queues_) {
@@ -69,6 +93,19 @@ bool ThreadPool::EnqueueForAllThreads(std::function<void()>&& job) {
   return true;
 }
 
+void ThreadPool::SetNotificationHandler(std::function<void()>&& handler) {
+  notification_handler_ = std::move(handler);
+}
+
+void ThreadPool::NotifyAllThreads() { notifications_.fetch_add(1); }
+
+void ThreadPool::HandleNotification(uint64_t& handled) {
+  const auto notified = notifications_.load();
+  if (notified == handled) return;
+  handled = notified;
+  if (notification_handler_) notification_handler_();
+}
+
 // FYI:
 // https://github.com/cameron314/concurrentqueue/blob/d1ce7d3e3a6376f3d8e2831f6728e0048f339f77/samples.md#wait-for-a-queue-to-become-empty-without-dequeueing
 // tl;dr concurrentqueue::size_approx is not always accurate.
@@ -81,6 +118,9 @@ bool ThreadPool::IsEmpty() {
   for (auto& queue : no_steal_queues_) {
     if (queue.size_approx() != 0) { return false; }
   }
+  for (auto& queue : deadline_queues_) {
+    if (queue.size.load() != 0) { return false; }
+  }
   return true;
 }
 
@@ -95,12 +135,23 @@ void ThreadPool::WaitForQueuesToBecomeEmpty() {
   while (ends.load() < worker_threads_.size()) std::this_thread::yield();
 }
 
-void ThreadPool::Dequeue() {
+void ThreadPool::Dequeue(size_t& deadline_streak) {
   size_t idx              = GetIdxByThreadId();
   auto* my_queue          = &work_queues_[idx];
   auto* my_no_steal_queue = &no_steal_queues_[idx];
   auto* selected_queue    = my_queue;
 
+  if (deadline_streak < MaxConsecutiveDeadlineJobs) {
+    for (size_t i = 0; i < deadline_queues_.size(); i++) {
+      auto& queue = deadline_queues_[(idx + i) % deadline_queues_.size()];
+      if (DequeueEarliestDeadline(queue)) {
+        deadline_streak++;
+        return;
+      }
+    }
+  }
+  deadline_streak = 0;
+
   if (my_queue->size_approx() == 0 && my_no_steal_queue->size_approx() != 0) {
     selected_queue = my_no_steal_queue;
   } else {
@@ -125,6 +176,22 @@ void ThreadPool::Dequeue() {
   }
 }
 
+bool ThreadPool::DequeueEarliestDeadline(DeadlineQueue& queue) {
+  if (queue.size.load() == 0) return false;
+  std::function<void()> f;
+  {
+    std::lock_guard<std::mutex> lock(queue.lock);
+    if (queue.jobs.empty()) return false;
+    // NOTE: std::priority_queue::top returns a const reference.
+    f = std::move(const_cast<DeadlineJob&>(queue.jobs.top()).job);
+    queue.jobs.pop();
+  }
+  f();
+  // Decremented after the execution so that #IsEmpty does not miss the job.
+  queue.size.fetch_sub(1);
+  return true;
+}
+
 size_t ThreadPool::GetIdxByThreadId() {
   thread_local size_t idx = ~0llu;
   if (idx == ~0llu) {
@@ -17,8 +17,11 @@
 #ifndef LINEAIRDB_THREADPOOL_H
 #define LINEAIRDB_THREADPOOL_H
 
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <mutex>
+#include <queue>
 #include <thread>
 #include <vector>
 
@@ -29,13 +32,31 @@ namespace LineairDB {
 /**
  * @brief
  * MPMC (Multiple producer / multiple consumer) thread pool.
+ * Jobs with deadlines are kept in per-thread priority queues and precede the
+ * other (FIFO) jobs; each thread runs them in the earliest-deadline-first
+ * order, and steals them from the other threads before stealing FIFO jobs.
+ * A thread runs a FIFO job, if any, after MaxConsecutiveDeadlineJobs jobs
+ * with deadlines so that a steady flow of them never starves FIFO jobs.
  */
 class ThreadPool {
  public:
+  using Deadline = std::chrono::steady_clock::time_point;
+  static constexpr size_t MaxConsecutiveDeadlineJobs = 16;
+
   ThreadPool(size_t pool_size = std::thread::hardware_concurrency());
   ~ThreadPool();
   bool Enqueue(std::function<void()>&&);
+  bool Enqueue(std::function<void()>&&, const Deadline);
   bool EnqueueForAllThreads(std::function<void()>&&);
+  /**
+   * @brief
+   * Sets the handler which each worker thread runs between its jobs after
+   * #NotifyAllThreads. Unlike #EnqueueForAllThreads, notifications are not
+   * queued: a worker observing several of them runs the handler once.
+   * @note Must be set before the first notification.
+   */
+  void SetNotificationHandler(std::function<void()>&&);
+  void NotifyAllThreads();
   void StopAcceptingTransactions();
   void ResumeAcceptingTransactions();
   void Shutdown();
@@ -44,8 +65,23 @@ class ThreadPool {
   size_t GetPoolSize() const;
 
  private:
+  struct DeadlineJob {
+    Deadline deadline;
+    std::function<void()> job;
+    bool operator<(const DeadlineJob& rhs) const {
+      return rhs.deadline < deadline;  // the earliest deadline on top
+    }
+  };
+  struct DeadlineQueue {
+    std::mutex lock;
+    std::priority_queue<DeadlineJob> jobs;
+    std::atomic<size_t> size{0};
+  };
+
   size_t GetIdxByThreadId();
-  void Dequeue();
+  void Dequeue(size_t& deadline_streak);
+  void HandleNotification(uint64_t& handled);
+  bool DequeueEarliestDeadline(DeadlineQueue&);
 
  private:
   bool stop_;
@@ -53,6 +89,9 @@ class ThreadPool {
   std::vector<moodycamel::ConcurrentQueue<std::function<void()>>> work_queues_;
   std::vector<moodycamel::ConcurrentQueue<std::function<void()>>>
       no_steal_queues_;
+  std::vector<DeadlineQueue> deadline_queues_;
+  std::function<void()> notification_handler_;
+  std::atomic<uint64_t> notifications_;
   std::vector<std::thread> worker_threads_;
   std::vector<std::thread::id> thread_ids_;
   std::mutex thread_ids_lock_;
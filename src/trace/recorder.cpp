@@ -0,0 +1,103 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "recorder.h"
+
+#include <lineairdb/config.h>
+#include <lineairdb/tx_status.h>
+
+#include <chrono>
+#include <experimental/filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+#include "trace/trace_format.h"
+
+namespace LineairDB {
+namespace Trace {
+
+Recorder::Recorder(const Config& config)
+    : enabled_(config.enable_trace_recording),
+      started_at_(std::chrono::steady_clock::now()) {
+  if (!enabled_) return;
+  std::experimental::filesystem::remove_all(TraceDirectory);
+  std::experimental::filesystem::create_directory(TraceDirectory);
+}
+
+// NOTE: the thread-local buffers are flushed by the destructor of
+// ThreadKeyStorage; the recorder has to be destroyed after all threads
+// recording events have finished.
+Recorder::~Recorder() = default;
+
+uint64_t Recorder::Now() const {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - started_at_)
+      .count();
+}
+
+void Recorder::Begin(const uint64_t submitted_ns) {
+  if (!enabled_) return;
+  auto& buffer = thread_key_storage_.Get()->buffer;
+  Append(buffer, EventType::Begin);
+  Append(buffer, submitted_ns);
+}
+
+void Recorder::Read(const std::string_view key) {
+  if (!enabled_) return;
+  auto& buffer = thread_key_storage_.Get()->buffer;
+  Append(buffer, EventType::Read);
+  AppendKey(buffer, key);
+}
+
+void Recorder::Write(const std::string_view key, const size_t size) {
+  if (!enabled_) return;
+  auto& buffer = thread_key_storage_.Get()->buffer;
+  Append(buffer, EventType::Write);
+  AppendKey(buffer, key);
+  Append<uint32_t>(buffer, static_cast<uint32_t>(size));
+}
+
+void Recorder::End(const TxStatus status) {
+  if (!enabled_) return;
+  auto* my_storage = thread_key_storage_.Get();
+  Append(my_storage->buffer, status == TxStatus::Committed ? EventType::Commit
+                                                           : EventType::Abort);
+  Append(my_storage->buffer, Now());
+  if (FlushThreshold <= my_storage->buffer.size()) my_storage->Flush();
+}
+
+Recorder::ThreadLocalStorageNode::ThreadLocalStorageNode()
+    : trace_file(std::string(TraceDirectory) + "/thread" +
+                     std::to_string(ThreadIdCounter.fetch_add(1)) + ".trace",
+                 std::ofstream::out | std::ofstream::binary |
+                     std::ofstream::trunc) {
+  trace_file.write(Magic, sizeof(Magic));
+  trace_file.write(reinterpret_cast<const char*>(&FormatVersion),
+                   sizeof(FormatVersion));
+}
+Recorder::ThreadLocalStorageNode::~ThreadLocalStorageNode() { Flush(); }
+
+void Recorder::ThreadLocalStorageNode::Flush() {
+  trace_file.write(buffer.data(), buffer.size());
+  trace_file.flush();
+  buffer.clear();
+}
+
+std::atomic<size_t> Recorder::ThreadLocalStorageNode::ThreadIdCounter = {0};
+
+}  // namespace Trace
+}  // namespace LineairDB
@@ -0,0 +1,80 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LINEAIRDB_TRACE_RECORDER_H
+#define LINEAIRDB_TRACE_RECORDER_H
+
+#include <lineairdb/config.h>
+#include <lineairdb/tx_status.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string_view>
+#include <vector>
+
+#include "trace/trace_format.h"
+#include "util/thread_key_storage.h"
+
+namespace LineairDB {
+namespace Trace {
+
+/**
+ * @brief
+ * Records the keys, the operations and the boundaries of the executed
+ * transactions into per-thread binary files (see trace/trace_format.h).
+ * Events are buffered in thread-local memory and written in large chunks;
+ * every method returns immediately if the recording is disabled.
+ * The trace directory is cleared at the construction.
+ */
+class Recorder {
+ public:
+  Recorder(const Config& config);
+  ~Recorder();
+
+  bool IsEnabled() const { return enabled_; }
+  uint64_t Now() const;
+
+  void Begin(const uint64_t submitted_ns);
+  void Read(const std::string_view key);
+  void Write(const std::string_view key, const size_t size);
+  void End(const TxStatus status);
+
+ private:
+  struct ThreadLocalStorageNode {
+   private:
+    static std::atomic<size_t> ThreadIdCounter;
+
+   public:
+    std::ofstream trace_file;
+    std::vector<char> buffer;
+
+    ThreadLocalStorageNode();
+    ~ThreadLocalStorageNode();
+    void Flush();
+  };
+
+  static constexpr size_t FlushThreshold = 64 * 1024;
+
+  const bool enabled_;
+  const std::chrono::steady_clock::time_point started_at_;
+  ThreadKeyStorage<ThreadLocalStorageNode> thread_key_storage_;
+};
+
+}  // namespace Trace
+}  // namespace LineairDB
+#endif /* LINEAIRDB_TRACE_RECORDER_H */
@@ -0,0 +1,117 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LINEAIRDB_TRACE_FORMAT_H
+#define LINEAIRDB_TRACE_FORMAT_H
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace LineairDB {
+namespace Trace {
+
+/**
+ * Binary format of workload trace files.
+ * A file starts with #Magic and #FormatVersion, followed by events of the
+ * transactions executed by a single thread. Integers are written in the
+ * native byte order; traces are meant to be replayed on the same platform.
+ *
+ *   Begin : type(u8) submitted_ns(u64)
+ *   Read  : type(u8) key_size(u32) key
+ *   Write : type(u8) key_size(u32) key value_size(u32)
+ *   Commit: type(u8) finished_ns(u64)
+ *   Abort : type(u8) finished_ns(u64)
+ *
+ * Timestamps are nanoseconds elapsed since the beginning of the recording.
+ * Values are not recorded; replays write as many bytes as recorded.
+ */
+constexpr char Magic[8]          = {'L', 'D', 'B', 'T', 'R', 'A', 'C', 'E'};
+constexpr uint32_t FormatVersion = 1;
+constexpr char TraceDirectory[]  = "lineairdb_traces";
+
+enum class EventType : uint8_t { Begin, Read, Write, Commit, Abort };
+
+struct Event {
+  EventType type;
+  uint64_t timestamp_ns;
+  std::string key;
+  uint32_t size;
+};
+
+template <typename T>
+void Append(std::vector<char>& buffer, const T value) {
+  const auto* p = reinterpret_cast<const char*>(&value);
+  buffer.insert(buffer.end(), p, p + sizeof(T));
+}
+inline void AppendKey(std::vector<char>& buffer, const std::string_view key) {
+  Append<uint32_t>(buffer, static_cast<uint32_t>(key.size()));
+  buffer.insert(buffer.end(), key.begin(), key.end());
+}
+
+/**
+ * @return false if the stream does not begin with a trace header.
+ */
+inline bool ReadHeader(std::istream& in) {
+  char magic[sizeof(Magic)];
+  uint32_t version = 0;
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char*>(&version), sizeof(version));
+  return in.good() && std::memcmp(magic, Magic, sizeof(Magic)) == 0 &&
+         version == FormatVersion;
+}
+
+/**
+ * @return false at the end of the stream or on a truncated event.
+ */
+inline bool ReadEvent(std::istream& in, Event& event) {
+  auto read = [&](auto& value) {
+    in.read(reinterpret_cast<char*>(&value), sizeof(value));
+    return in.good();
+  };
+  auto read_key = [&]() {
+    uint32_t key_size;
+    if (!read(key_size)) return false;
+    event.key.resize(key_size);
+    in.read(event.key.data(), key_size);
+    return in.good();
+  };
+
+  if (!read(event.type)) return false;
+  event.timestamp_ns = 0;
+  event.size         = 0;
+  event.key.clear();
+  switch (event.type) {
+    case EventType::Begin:
+    case EventType::Commit:
+    case EventType::Abort:
+      return read(event.timestamp_ns);
+    case EventType::Read:
+      return read_key();
+    case EventType::Write:
+      return read_key() && read(event.size);
+    default:
+      return false;
+  }
+}
+
+}  // namespace Trace
+}  // namespace LineairDB
+
+#endif /* LINEAIRDB_TRACE_FORMAT_H */
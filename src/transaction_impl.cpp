@@ -21,7 +21,10 @@
 #include <lineairdb/transaction.h>
 
 #include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <memory>
+#include <string>
 #include <type_traits>
 #include <utility>
 
@@ -31,12 +34,64 @@
 #include "types.h"
 namespace LineairDB {
 
+namespace {
+/**
+ * Blobs are stored as a manifest and chunks, in the key space prefixed by a
+ * null character. The chunks of each generation of a blob are written into
+ * one of two slots alternately (copy-on-write); a reader of a generation thus
+ * never observes the chunks being written by the next generation, and
+ * validates only the version of the manifest.
+ * The chunk keys end with fixed-width suffixes so that they never collide
+ * among different blob keys. A new generation deletes the chunks left in its
+ * slot beyond its own chunk count, by writing them empty and already expired
+ * (see DataItem::expires_at); the reaper removes them from the index.
+ * Keys with the prefixes of blobs are rejected by the other methods of
+ * Transaction.
+ */
+struct BlobManifest {
+  uint64_t generation;
+  uint64_t size;
+  uint64_t chunks;
+  uint64_t previous_chunks;  // chunks of the previous generation
+};
+struct BlobChunkHeader {
+  uint64_t generation;
+};
+constexpr size_t BlobChunkPayloadSize =
+    ValueBufferSize - sizeof(BlobChunkHeader);
+
+std::string BlobManifestKey(const std::string_view key) {
+  std::string manifest_key("\0bm:", 4);
+  manifest_key.append(key);
+  return manifest_key;
+}
+
+bool IsBlobKey(const std::string_view key) {
+  return key.substr(0, 4) == std::string_view("\0bm:", 4) ||
+         key.substr(0, 4) == std::string_view("\0bc:", 4);
+}
+
+std::string BlobChunkKey(const std::string_view key, const uint64_t generation,
+                         const uint64_t index) {
+  std::string chunk_key("\0bc:", 4);
+  chunk_key.append(key);
+  chunk_key.push_back(static_cast<char>(generation % 2));
+  chunk_key.append(reinterpret_cast<const char*>(&index), sizeof(index));
+  return chunk_key;
+}
+}  // namespace
+
 Transaction::Impl::Impl(Database::Impl* db_pimpl) noexcept
     : user_aborted_(false),
+      durable_(true),
+      traced_(true),
+      deadline_(Database::DeadlineType::max()),
       db_pimpl_(db_pimpl),
-      config_ref_(db_pimpl_->GetConfig()) {
+      config_ref_(db_pimpl_->GetConfig()),
+      epoch_(db_pimpl_->GetMyThreadLocalEpoch()),
+      running_dependent_(NotInDependent) {
   TransactionReferences&& tx = {db_pimpl_->GetPointIndex(), read_set_,
-                                write_set_, db_pimpl_->GetMyThreadLocalEpoch()};
+                                write_set_, epoch_, deadline_, config_ref_};
 
   // WANTFIX for performance
   // Here we allocate one (derived) concurrency control instance per
@@ -64,26 +119,127 @@ Transaction::Impl::~Impl() noexcept = default;
 const std::pair<const std::byte* const, const size_t> Transaction::Impl::Read(
     const std::string_view key) {
   if (user_aborted_) return {nullptr, 0};
+  if (traced_) db_pimpl_->GetTraceRecorder().Read(key);
 
   for (auto& snapshot : write_set_) {
     if (snapshot.key == key) {
+      if (snapshot.update) {
+        ApplyUpdate(snapshot);
+        if (user_aborted_) return {nullptr, 0};
+        return {write_set_.back().value_copy, write_set_.back().size};
+      }
+      if (!dependents_.empty()) Untrack(key, true);
       return std::make_pair(snapshot.value_copy, snapshot.size);
     }
   }
 
   for (auto& snapshot : read_set_) {
     if (snapshot.key == key) {
+      if (!dependents_.empty()) Untrack(key, false);
+      if (!snapshot.has_value_copy && !CopyValue(snapshot)) {
+        return {nullptr, 0};
+      }
       return std::make_pair(snapshot.value_copy, snapshot.size);
     }
   }
   const auto result = concurrency_control_->Read(key);
+  if (concurrency_control_->IsTimedOut()) {
+    Abort();
+    return {nullptr, 0};
+  }
+  if (running_dependent_ != NotInDependent) {
+    dependents_[running_dependent_].read_keys.emplace_back(key);
+  }
   read_set_.emplace_back(std::move(result));
-  return {result.value_copy, result.size};
+  auto& snapshot = read_set_.back();
+  return {snapshot.value_copy, snapshot.size};
 }  // namespace LineairDB
 
+Transaction::VersionedValue Transaction::Impl::ReadIfChanged(
+    const std::string_view key, const Transaction::Version known_version) {
+  if (user_aborted_) return {false, known_version, nullptr, 0};
+  if (traced_) db_pimpl_->GetTraceRecorder().Read(key);
+
+  for (auto& snapshot : write_set_) {
+    if (snapshot.key == key) {
+      if (snapshot.update) {
+        ApplyUpdate(snapshot);
+        if (user_aborted_) return {false, known_version, nullptr, 0};
+        auto& applied = write_set_.back();
+        return {true, 0, applied.value_copy, applied.size};
+      }
+      if (!dependents_.empty()) Untrack(key, true);
+      return {true, 0, snapshot.value_copy, snapshot.size};
+    }
+  }
+
+  Snapshot* snapshot = nullptr;
+  for (auto& read : read_set_) {
+    if (read.key != key) continue;
+    if (!dependents_.empty()) Untrack(key, false);
+    snapshot = &read;
+    break;
+  }
+  if (snapshot == nullptr) {
+    // An unchanged data item is only validated; no snapshot is made.
+    const bool unchanged =
+        concurrency_control_->ReadIfUnchanged(key, known_version);
+    if (concurrency_control_->IsTimedOut()) {
+      Abort();
+      return {false, known_version, nullptr, 0};
+    }
+    if (unchanged) return {false, known_version, nullptr, 0};
+    const auto result =
+        concurrency_control_->ReadIfChanged(key, known_version);
+    if (concurrency_control_->IsTimedOut()) {
+      Abort();
+      return {false, known_version, nullptr, 0};
+    }
+    if (running_dependent_ != NotInDependent) {
+      dependents_[running_dependent_].read_keys.emplace_back(key);
+    }
+    read_set_.emplace_back(std::move(result));
+    snapshot = &read_set_.back();
+  }
+
+  if (snapshot->read_version == known_version) {
+    return {false, known_version, nullptr, 0};
+  }
+  if (!snapshot->has_value_copy && !CopyValue(*snapshot)) {
+    return {false, known_version, nullptr, 0};
+  }
+  return {true, snapshot->read_version, snapshot->value_copy, snapshot->size};
+}
+
+void Transaction::Impl::WriteIfVersion(
+    const std::string_view key, const Transaction::Version expected_version,
+    const std::byte value[], const size_t size) {
+  if (user_aborted_) return;
+  if (ReadIfChanged(key, expected_version).changed) {
+    Abort();
+    return;
+  }
+  Write(key, value, size);
+}
+
+bool Transaction::Impl::CopyValue(Snapshot& snapshot) {
+  const auto version = snapshot.index_cache->CopyStableVersion(
+      snapshot.value_copy, snapshot.size, &snapshot.expires_at);
+  if (version != snapshot.read_version) {
+    // The validation of this read never passes.
+    Abort();
+    return false;
+  }
+  snapshot.has_value_copy = true;
+  return true;
+}
+
 void Transaction::Impl::Write(const std::string_view key,
-                              const std::byte value[], const size_t size) {
+                              const std::byte value[], const size_t size,
+                              const uint64_t expires_at) {
   if (user_aborted_) return;
+  if (traced_) db_pimpl_->GetTraceRecorder().Write(key, size);
+  if (expires_at != 0) db_pimpl_->NotifyExpiringWrite(key, expires_at);
 
   bool is_rmf = false;
   for (auto& snapshot : read_set_) {
@@ -95,17 +251,297 @@ void Transaction::Impl::Write(const std::string_view key,
 
   for (auto& snapshot : write_set_) {
     if (snapshot.key != key) continue;
+    if (!dependents_.empty()) Untrack(key, true);
+    if (running_dependent_ != NotInDependent) {
+      // The repair discards the writes of the running dependent, which must
+      // not include the writes of the others.
+      auto& dependent = dependents_[running_dependent_];
+      auto& written   = dependent.written_keys;
+      if (std::find(written.begin(), written.end(), key) == written.end()) {
+        dependent.repairable = false;
+      }
+    }
+    snapshot.update = nullptr;  // overwrites the deferred update, if any
     snapshot.Reset(value, size);
+    snapshot.expires_at = expires_at;
     if (is_rmf) snapshot.is_read_modify_write = true;
     return;
   }
 
+  if (running_dependent_ != NotInDependent) {
+    dependents_[running_dependent_].written_keys.emplace_back(key);
+  }
   concurrency_control_->Write(key, value, size);
   Snapshot sp(key, value, size, nullptr);
+  sp.expires_at = expires_at;
   write_set_.emplace_back(std::move(sp));
 }
 
+void Transaction::Impl::TrackedRead(const std::string_view key,
+                                    Transaction::DependentType dependent) {
+  if (user_aborted_) return;
+  if (running_dependent_ != NotInDependent) {
+    // a part of the running dependent
+    ReadAndCall(key, dependent);
+    return;
+  }
+  dependents_.push_back({std::string(key), std::move(dependent), {}, {}, true});
+  RunDependent(dependents_.size() - 1);
+}
+
+void Transaction::Impl::Update(const std::string_view key,
+                               Transaction::UpdateType update) {
+  if (user_aborted_) return;
+  const auto same_key = [&](const Snapshot& s) { return s.key == key; };
+  if (std::any_of(read_set_.begin(), read_set_.end(), same_key) ||
+      std::any_of(write_set_.begin(), write_set_.end(), same_key)) {
+    // This transaction already depends on the value; update it now.
+    const auto current = Read(key);
+    if (user_aborted_) return;
+    std::byte value[ValueBufferSize];
+    if (current.second != 0) std::memcpy(value, current.first, current.second);
+    const size_t size = update(value, current.second, ValueBufferSize);
+    Write(key, value, size, ExpirationOf(key));
+    return;
+  }
+
+  // The size of the new value is unknown until the commit.
+  if (traced_) {
+    db_pimpl_->GetTraceRecorder().Read(key);
+    db_pimpl_->GetTraceRecorder().Write(key, 0);
+  }
+  if (running_dependent_ != NotInDependent) {
+    dependents_[running_dependent_].written_keys.emplace_back(key);
+  }
+  concurrency_control_->Write(key, nullptr, 0);
+  write_set_.emplace_back(key, nullptr, 0, nullptr);
+  write_set_.back().update = std::move(update);
+}
+
+void Transaction::Impl::ApplyUpdate(Snapshot& deferred) {
+  const std::string key(deferred.key);
+  auto update = std::move(deferred.update);
+  write_set_.erase(write_set_.begin() + (&deferred - write_set_.data()));
+  if (!dependents_.empty()) Untrack(key, true);
+
+  const auto current = Read(key);
+  if (user_aborted_) return;
+  std::byte value[ValueBufferSize];
+  if (current.second != 0) std::memcpy(value, current.first, current.second);
+  const size_t size = update(value, current.second, ValueBufferSize);
+  Write(key, value, size, ExpirationOf(key));
+}
+
+uint64_t Transaction::Impl::ExpirationOf(const std::string_view key) {
+  for (auto& snapshot : write_set_) {
+    if (snapshot.key == key) return snapshot.expires_at;
+  }
+  for (auto& snapshot : read_set_) {
+    if (snapshot.key == key) return snapshot.expires_at;
+  }
+  return 0;
+}
+
+void Transaction::Impl::ReadAndCall(
+    const std::string_view key, const Transaction::DependentType& function) {
+  const auto result = Read(key);
+  if (user_aborted_) return;
+  // NOTE: the function may read more and reallocate the read set.
+  std::byte value[ValueBufferSize];
+  if (result.second != 0) std::memcpy(value, result.first, result.second);
+  function(result.second != 0 ? value : nullptr, result.second);
+}
+
+void Transaction::Impl::RunDependent(const size_t index) {
+  running_dependent_ = index;
+  ReadAndCall(dependents_[index].key, dependents_[index].function);
+  running_dependent_ = NotInDependent;
+}
+
+void Transaction::Impl::Untrack(const std::string_view key,
+                                const bool written) {
+  for (size_t index = 0; index < dependents_.size(); index++) {
+    if (index == running_dependent_) continue;
+    auto& dependent = dependents_[index];
+    auto& keys      = written ? dependent.written_keys : dependent.read_keys;
+    if (std::find(keys.begin(), keys.end(), key) != keys.end()) {
+      dependent.repairable = false;
+    }
+  }
+}
+
+bool Transaction::Impl::Repair() {
+  if (dependents_.empty() || concurrency_control_->IsTimedOut()) return false;
+  const auto invalidated = concurrency_control_->GetInvalidatedReads();
+  if (invalidated.empty()) return false;
+
+  std::vector<size_t> reruns;
+  for (auto position : invalidated) {
+    const auto& key = read_set_[position].key;
+    auto owner      = std::find_if(
+        dependents_.begin(), dependents_.end(), [&](const Dependent& d) {
+          return std::find(d.read_keys.begin(), d.read_keys.end(), key) !=
+                 d.read_keys.end();
+        });
+    if (owner == dependents_.end() || !owner->repairable) return false;
+    reruns.push_back(owner - dependents_.begin());
+  }
+  std::sort(reruns.begin(), reruns.end());
+  reruns.erase(std::unique(reruns.begin(), reruns.end()), reruns.end());
+
+  concurrency_control_->PrepareRepair(invalidated);
+  for (auto position : invalidated) {
+    auto& snapshot = read_set_[position];
+    auto refreshed = concurrency_control_->Read(snapshot.key);
+    if (concurrency_control_->IsTimedOut()) return false;
+    refreshed.is_read_modify_write = snapshot.is_read_modify_write;
+    snapshot                       = std::move(refreshed);
+  }
+
+  // Dependents are executed again in the original order, after their
+  // previous writes are discarded.
+  for (auto index : reruns) {
+    auto& written = dependents_[index].written_keys;
+    write_set_.erase(
+        std::remove_if(write_set_.begin(), write_set_.end(),
+                       [&](const Snapshot& snapshot) {
+                         return std::find(written.begin(), written.end(),
+                                          snapshot.key) != written.end();
+                       }),
+        write_set_.end());
+    written.clear();
+    RunDependent(index);
+    if (user_aborted_) return false;
+  }
+  return true;
+}
+
+void Transaction::Impl::WriteBlob(const std::string_view key,
+                                  Transaction::BlobProducerType producer) {
+  if (user_aborted_) return;
+
+  const auto manifest_key = BlobManifestKey(key);
+  const bool rewritten =
+      std::any_of(write_set_.begin(), write_set_.end(),
+                  [&](const Snapshot& s) { return s.key == manifest_key; });
+
+  BlobManifest manifest = {0, 0, 0, 0};
+  const auto current    = Read(manifest_key);
+  if (user_aborted_) return;
+  if (current.second == sizeof(BlobManifest)) {
+    std::memcpy(&manifest, current.first, sizeof(BlobManifest));
+  }
+  // The chunks which may remain in the slot of the new generation.
+  uint64_t stale_chunks = manifest.previous_chunks;
+  if (rewritten) {
+    // Rewrites the generation written by this transaction; its chunks in the
+    // write set are overwritten or deleted.
+    stale_chunks = std::max(manifest.chunks, manifest.previous_chunks);
+  } else {
+    manifest.generation++;
+    manifest.previous_chunks = manifest.chunks;
+  }
+  manifest.size   = 0;
+  manifest.chunks = 0;
+
+  const auto put_chunk = [&](const std::string_view chunk_key,
+                             const std::byte* value, const size_t size,
+                             const uint64_t expires_at) {
+    if (rewritten) {
+      Write(chunk_key, value, size, expires_at);
+      return;
+    }
+    // Fast path: chunk keys of this generation are not in the read/write
+    // set of this transaction, and thus we skip the duplication check.
+    if (traced_) db_pimpl_->GetTraceRecorder().Write(chunk_key, size);
+    if (expires_at != 0) db_pimpl_->NotifyExpiringWrite(chunk_key, expires_at);
+    if (running_dependent_ != NotInDependent) {
+      dependents_[running_dependent_].written_keys.emplace_back(chunk_key);
+    }
+    concurrency_control_->Write(chunk_key, value, size);
+    write_set_.emplace_back(chunk_key, value, size, nullptr);
+    write_set_.back().expires_at = expires_at;
+  };
+
+  std::byte buffer[ValueBufferSize];
+  const BlobChunkHeader header = {manifest.generation};
+  std::memcpy(buffer, &header, sizeof(BlobChunkHeader));
+  for (;;) {
+    const size_t filled =
+        producer(buffer + sizeof(BlobChunkHeader), BlobChunkPayloadSize);
+    if (filled == 0) break;
+    assert(filled <= BlobChunkPayloadSize);
+
+    put_chunk(BlobChunkKey(key, manifest.generation, manifest.chunks), buffer,
+              sizeof(BlobChunkHeader) + filled, 0);
+    manifest.size += filled;
+    manifest.chunks++;
+  }
+  for (auto index = manifest.chunks; index < stale_chunks; index++) {
+    // Already expired; see DataItem::IsExpired.
+    put_chunk(BlobChunkKey(key, manifest.generation, index), nullptr, 0, 1);
+  }
+
+  Write(manifest_key, reinterpret_cast<std::byte*>(&manifest),
+        sizeof(BlobManifest));
+}
+
+size_t Transaction::Impl::ReadBlob(const std::string_view key,
+                                   Transaction::BlobConsumerType consumer) {
+  if (user_aborted_) return 0;
+
+  const auto manifest_key = BlobManifestKey(key);
+  const auto current      = Read(manifest_key);
+  if (current.second != sizeof(BlobManifest)) return 0;
+  BlobManifest manifest;
+  std::memcpy(&manifest, current.first, sizeof(BlobManifest));
+
+  const bool written_by_me =
+      std::any_of(write_set_.begin(), write_set_.end(),
+                  [&](const Snapshot& s) { return s.key == manifest_key; });
+
+  std::byte buffer[ValueBufferSize];
+  for (uint64_t index = 0; index < manifest.chunks; index++) {
+    const auto chunk_key = BlobChunkKey(key, manifest.generation, index);
+    size_t size          = 0;
+    if (written_by_me) {
+      for (auto& snapshot : write_set_) {
+        if (snapshot.key != chunk_key) continue;
+        size = snapshot.size;
+        std::memcpy(buffer, snapshot.value_copy, size);
+        break;
+      }
+    } else {
+      // Chunks are not added into the read set; the version of the manifest
+      // read above is validated at the commit instead.
+      auto* item = db_pimpl_->GetPointIndex().Get(chunk_key);
+      if (item != nullptr) item->CopyStableVersion(buffer, size);
+    }
+
+    BlobChunkHeader header = {0};
+    if (sizeof(BlobChunkHeader) <= size) {
+      std::memcpy(&header, buffer, sizeof(BlobChunkHeader));
+    }
+    if (header.generation != manifest.generation) {
+      // The slot has been overwritten by a newer generation; the manifest
+      // validation never passes.
+      Abort();
+      return 0;
+    }
+    consumer(buffer + sizeof(BlobChunkHeader), size - sizeof(BlobChunkHeader));
+  }
+  return manifest.size;
+}
+
 void Transaction::Impl::Abort() { user_aborted_ = true; }
+bool Transaction::Impl::RejectBlobKey(const std::string_view key) {
+  if (!IsBlobKey(key)) return false;
+  SPDLOG_ERROR(
+      "The key space of blobs is reserved; the transaction is aborted.");
+  Abort();
+  return true;
+}
+void Transaction::Impl::MarkAsNonDurable() { durable_ = false; }
 bool Transaction::Impl::Precommit() {
   if (user_aborted_) {
     concurrency_control_->PostProcessing(TxStatus::Aborted);
@@ -113,6 +549,11 @@ bool Transaction::Impl::Precommit() {
   }
 
   bool committed = concurrency_control_->Precommit();
+  // Abort repair; see Transaction::TrackedRead.
+  for (size_t repairs = 0; !committed && repairs < MaxRepairs; repairs++) {
+    if (!config_ref_.enable_abort_repair || !Repair()) break;
+    committed = concurrency_control_->Precommit();
+  }
   if (committed) {
     concurrency_control_->PostProcessing(TxStatus::Committed);
   } else {
@@ -123,13 +564,54 @@ bool Transaction::Impl::Precommit() {
 
 const std::pair<const std::byte* const, const size_t> Transaction::Read(
     const std::string_view key) {
+  if (tx_pimpl_->RejectBlobKey(key)) return {nullptr, 0};
   return tx_pimpl_->Read(key);
 }
 void Transaction::Write(const std::string_view key, const std::byte value[],
                         const size_t size) {
+  if (tx_pimpl_->RejectBlobKey(key)) return;
   tx_pimpl_->Write(key, value, size);
 }
+void Transaction::Write(const std::string_view key, const std::byte value[],
+                        const size_t size,
+                        const std::chrono::milliseconds ttl) {
+  if (tx_pimpl_->RejectBlobKey(key)) return;
+  // A non-positive TTL makes the value expire immediately.
+  const uint64_t lifetime = std::max<int64_t>(ttl.count(), 0);
+  tx_pimpl_->Write(key, value, size, DataItem::Now() + lifetime);
+}
+void Transaction::TrackedRead(const std::string_view key,
+                              DependentType dependent) {
+  if (tx_pimpl_->RejectBlobKey(key)) return;
+  tx_pimpl_->TrackedRead(key, std::move(dependent));
+}
+void Transaction::Update(const std::string_view key, UpdateType update) {
+  if (tx_pimpl_->RejectBlobKey(key)) return;
+  tx_pimpl_->Update(key, std::move(update));
+}
+Transaction::VersionedValue Transaction::ReadIfChanged(
+    const std::string_view key, const Version known_version) {
+  if (tx_pimpl_->RejectBlobKey(key)) {
+    return {false, known_version, nullptr, 0};
+  }
+  return tx_pimpl_->ReadIfChanged(key, known_version);
+}
+void Transaction::WriteIfVersion(const std::string_view key,
+                                 const Version expected_version,
+                                 const std::byte value[], const size_t size) {
+  if (tx_pimpl_->RejectBlobKey(key)) return;
+  tx_pimpl_->WriteIfVersion(key, expected_version, value, size);
+}
+void Transaction::WriteBlob(const std::string_view key,
+                            BlobProducerType producer) {
+  tx_pimpl_->WriteBlob(key, producer);
+}
+size_t Transaction::ReadBlob(const std::string_view key,
+                             BlobConsumerType consumer) {
+  return tx_pimpl_->ReadBlob(key, consumer);
+}
 void Transaction::Abort() { tx_pimpl_->Abort(); }
+void Transaction::MarkAsNonDurable() { tx_pimpl_->MarkAsNonDurable(); }
 bool Transaction::Precommit() { return tx_pimpl_->Precommit(); }
 
 Transaction::Transaction(void* db_pimpl) noexcept
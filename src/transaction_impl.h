@@ -21,8 +21,11 @@
 #include <lineairdb/database.h>
 #include <lineairdb/transaction.h>
 
+#include <chrono>
 #include <memory>
+#include <string>
 #include <string_view>
+#include <vector>
 
 #include "concurrency_control/concurrency_control_base.h"
 #include "types.h"
@@ -56,19 +59,94 @@ class Transaction::Impl {
 
   const std::pair<const std::byte* const, const size_t> Read(
       const std::string_view key);
+  /**
+   * @param expires_at See DataItem::expires_at; 0 if it never expires.
+   */
   void Write(const std::string_view key, const std::byte value[],
-             const size_t size);
+             const size_t size, const uint64_t expires_at = 0);
+  Transaction::VersionedValue ReadIfChanged(
+      const std::string_view key, const Transaction::Version known_version);
+  void WriteIfVersion(const std::string_view key,
+                      const Transaction::Version expected_version,
+                      const std::byte value[], const size_t size);
+  void TrackedRead(const std::string_view key,
+                   Transaction::DependentType dependent);
+  void Update(const std::string_view key, Transaction::UpdateType update);
+  void WriteBlob(const std::string_view key,
+                 Transaction::BlobProducerType producer);
+  size_t ReadBlob(const std::string_view key,
+                  Transaction::BlobConsumerType consumer);
   void Abort();
+  /**
+   * Aborts this transaction if the given key of an user is in the key space
+   * reserved for blobs.
+   * @return true if aborted.
+   */
+  bool RejectBlobKey(const std::string_view key);
+  void MarkAsNonDurable();
   bool Precommit();
 
  private:
+  static constexpr size_t MaxRepairs     = 8;
+  static constexpr size_t NotInDependent = ~0llu;
+
+  /**
+   * A function given to TrackedRead, with the keys which it has read or
+   * written first in this transaction. It becomes unrepairable when the rest
+   * of the transaction accesses these keys.
+   */
+  struct Dependent {
+    std::string key;
+    Transaction::DependentType function;
+    std::vector<std::string> read_keys;
+    std::vector<std::string> written_keys;
+    bool repairable;
+  };
+
+  /**
+   * Copies the value of a snapshot in the read set, which has not been copied
+   * by ReadIfChanged; aborts if the data item has been changed since.
+   */
+  bool CopyValue(Snapshot& snapshot);
+  /**
+   * Applies a deferred update in the write set now, by reading the data
+   * item; the write snapshot is moved to the end of the write set.
+   */
+  void ApplyUpdate(Snapshot& deferred);
+  // The expiration time of the value which this transaction has read or
+  // written for the key, which an update keeps.
+  uint64_t ExpirationOf(const std::string_view key);
+  void ReadAndCall(const std::string_view key,
+                   const Transaction::DependentType& function);
+  void RunDependent(const size_t index);
+  // Marks the dependents (except the running one) which have read or written
+  // the key as unrepairable.
+  void Untrack(const std::string_view key, const bool written);
+  /**
+   * Refreshes the invalidated reads of the last (failed) precommit and
+   * executes again the dependents which have read them.
+   * @return false if the transaction cannot be repaired.
+   */
+  bool Repair();
+
   bool user_aborted_;
+  bool durable_;
+  // Resumable transactions may run on several workers in turn; their events
+  // are not recorded since the traces are per worker.
+  bool traced_;
+  Database::DeadlineType deadline_;
   Database::Impl* db_pimpl_;
   const Config& config_ref_;
+  // The epoch of the worker running this transaction. A resumable
+  // transaction refreshes it whenever it resumes, maybe on another worker.
+  EpochNumber epoch_;
   std::unique_ptr<ConcurrencyControlBase> concurrency_control_;
 
   ReadSetType read_set_;
   WriteSetType write_set_;
+
+  std::vector<Dependent> dependents_;
+  size_t running_dependent_;
 };
 }  // namespace LineairDB
 #endif /* LINEAIRDB_TRANSACTION_IMPL_H */
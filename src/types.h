@@ -17,14 +17,24 @@
 #ifndef LINEAIRDB_TYPES_H
 #define LINEAIRDB_TYPES_H
 
+#include <lineairdb/transaction.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
 #include <cstring>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <type_traits>
 #include <vector>
 
 #include "concurrency_control/pivot_object.hpp"
+#include "util/hash.h"
 #include "util/logger.hpp"
+#include "util/memory_placement.h"
 
 namespace LineairDB {
 
@@ -33,18 +43,98 @@ typedef uint32_t EpochNumber;
 // TODO set this parameter by configuration
 constexpr size_t ValueBufferSize = 512;
 
+struct Snapshot;
+
+/**
+ * @brief
+ * A batch of deferred updates into a hot data item, combined by its lock
+ * holder; see Config::enable_flat_combining. The holder opens the batch, the
+ * transactions updating only the data item join it instead of waiting for the
+ * lock, and the holder closes it after its validation. Each data item reuses
+ * one batch, allocated when it becomes hot for the first time.
+ */
+struct CombiningBatch {
+  // Discarded: the lock holder has aborted, and so the joined transaction.
+  enum State : uint32_t { Joined, Committed, Aborted, Published, Discarded };
+  struct Request {
+    Snapshot* snapshot;  // in the write set of the joined transaction
+    std::atomic<uint32_t> state;
+  };
+
+  std::mutex lock;
+  std::condition_variable validated;  // notified when a joiner validates
+  std::condition_variable closed;     // notified when the holder closes it
+  bool open         = false;
+  EpochNumber epoch = 0;
+  std::vector<Request*> requests;
+};
+
 struct DataItem {
+  static constexpr EpochNumber KeyIsNotLogged = UINT32_MAX;
+
   std::atomic<uint64_t> transaction_id;
+  // Dense identifier assigned at the insertion into the index. Logs refer
+  // data items by this number and the key is logged only once.
+  uint64_t record_id;
+  // The smallest epoch of the log records which contain the key.
+  std::atomic<EpochNumber> key_logged_epoch;
+  // Odd while the lock holder installs its new value, until it unlocks. The
+  // value of a locked data item is the last committed version if it is even.
+  std::atomic<uint32_t> install_counter;
+  // The number of the transactions which have waited for the lock; decayed
+  // by the combining. Used by only Config::enable_flat_combining.
+  std::atomic<uint32_t> lock_contention;
   std::byte value[ValueBufferSize];
   size_t size;
+  // Allocated by the first lock holder which combines the updates. A pointer
+  // into the heap of the process; flat combining is thus not supported in a
+  // shared memory segment (see Config::shared_memory_segment).
+  std::atomic<CombiningBatch*> combining_batch;
+  // The time (see #Now) when the value expires; 0 if it never expires. Set
+  // with the value under the lock. See Transaction::Write with a TTL.
+  uint64_t expires_at;
+  // Set when the reaper has removed this data item from the index. A
+  // transaction which has looked it up before must look up the key again.
+  std::atomic<bool> reaped;
   std::atomic<NWRPivotObject>
       pivot_object;  // Used by only NWR-extended protocols
 
-  DataItem() : transaction_id(0), size(0), pivot_object() {}
+  DataItem()
+      : transaction_id(0),
+        record_id(0),
+        key_logged_epoch(KeyIsNotLogged),
+        install_counter(0),
+        lock_contention(0),
+        size(0),
+        combining_batch(nullptr),
+        expires_at(0),
+        reaped(false),
+        pivot_object() {}
   DataItem(const std::byte* v, size_t s, uint64_t tid = 0)
-      : transaction_id(tid), size(0), pivot_object() {
+      : transaction_id(tid),
+        record_id(0),
+        key_logged_epoch(KeyIsNotLogged),
+        install_counter(0),
+        lock_contention(0),
+        size(0),
+        combining_batch(nullptr),
+        expires_at(0),
+        reaped(false),
+        pivot_object() {
     Reset(v, s);
   }
+  ~DataItem() { delete combining_batch.load(); }
+
+  static void* operator new(size_t size) {
+    return Util::AllocateRecord<DataItem>(size);
+  }
+  static void* operator new(size_t size, const Util::Placement placement) {
+    return Util::AllocateRecord<DataItem>(size, placement);
+  }
+  static void operator delete(void* p) { Util::DeallocateRecord<DataItem>(p); }
+  static void operator delete(void* p, const Util::Placement) {
+    Util::DeallocateRecord<DataItem>(p);
+  }
 
   void Reset(const std::byte* v, size_t s) {
     if (ValueBufferSize < s) {
@@ -55,28 +145,105 @@ struct DataItem {
     size = s;
     std::memcpy(value, v, s);
   }
+
+  /**
+   * @return the version which a writer in the given epoch publishes on the
+   * unlock of a data item it has locked at the given version (with the lock
+   * bit). Versions are ordered by the epoch in the upper 32 bits and then by
+   * the order of the commits within the epoch, and thus each commit publishes
+   * a version greater than any version the data item has had.
+   */
+  static uint64_t NextVersion(const uint64_t locked, const EpochNumber epoch) {
+    return std::max((static_cast<uint64_t>(epoch) << 32) | 2, locked + 1);
+  }
+
+  // Milliseconds since the Unix epoch, the unit of #expires_at.
+  static uint64_t Now() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+  }
+  static bool IsExpired(const uint64_t expiration) {
+    return expiration != 0 && expiration <= Now();
+  }
+  bool IsExpired() const { return IsExpired(expires_at); }
+
+  /**
+   * @brief
+   * Copies the latest committed version into the given buffer without
+   * joining any transaction. A locked data item is read without waiting for
+   * the lock holder, unless it is installing its new value; see
+   * #install_counter. An expired value is copied as absent (size 0).
+   * @param expires_at_out If given, set to the expiration time of the copied
+   * value; 0 if absent.
+   * @return the transaction id of the copied version.
+   */
+  uint64_t CopyStableVersion(std::byte* buffer, size_t& size_out,
+                             uint64_t* expires_at_out = nullptr) const {
+    for (;;) {
+      auto tx_id      = transaction_id.load();
+      auto installing = install_counter.load();
+      if (installing & 1) {
+        std::this_thread::yield();
+        continue;
+      }
+      auto expiration = expires_at;
+      size_out        = size;
+      std::memcpy(buffer, value, size_out);
+      if (transaction_id.load() == tx_id &&
+          install_counter.load() == installing) {
+        if (IsExpired(expiration)) {
+          size_out   = 0;
+          expiration = 0;
+        }
+        if (expires_at_out != nullptr) *expires_at_out = expiration;
+        return tx_id & ~1llu;  // the version before the lock
+      }
+    }
+  }
 };
 
 struct Snapshot {
   std::string key;
+  // Util::HashKey(key), computed once and reused for the index probes.
+  size_t key_hash;
   std::byte value_copy[ValueBufferSize];
   size_t size;
   DataItem* index_cache;
   uint64_t version_in_epoch;
   bool is_read_modify_write;
+  // The version of the data item read, without the lock bit (read set only).
+  uint64_t read_version;
+  // False if the value has not been copied since its version was known to
+  // the caller; see Transaction::ReadIfChanged.
+  bool has_value_copy;
+  // If set, the value is computed by this function from the last committed
+  // one at the commit (write set only); see Transaction::Update.
+  Transaction::UpdateType update;
+  // The expiration time of the value (see DataItem::expires_at); 0 if it
+  // never expires or is absent.
+  uint64_t expires_at;
 
   Snapshot(const std::string_view k, const std::byte v[], const size_t s,
            DataItem* const i, const uint64_t ver = 0)
+      : Snapshot(k, Util::HashKey(k), v, s, i, ver) {}
+  Snapshot(const std::string_view k, const size_t h, const std::byte v[],
+           const size_t s, DataItem* const i, const uint64_t ver = 0)
       : key(k),
+        key_hash(h),
         size(s),
         index_cache(i),
         version_in_epoch(ver),
-        is_read_modify_write(false) {
+        is_read_modify_write(false),
+        read_version(0),
+        has_value_copy(true),
+        expires_at(0) {
     if (v != nullptr) Reset(v, s);
   }
 
+  // Orders snapshots by record id; index_cache must be resolved.
   static bool Compare(Snapshot& left, Snapshot& right) {
-    return left.key < right.key;
+    return left.index_cache->record_id < right.index_cache->record_id;
   }
 
   void Reset(const std::byte* v, size_t s) {
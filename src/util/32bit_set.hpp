@@ -70,16 +70,22 @@ class HalfWordSet {
     return Put(Hashptr(seedptr), version);
   }
 
-  void PutHigherside(const void* seedptr, const uint32_t version) {
-    const uint32_t current = Get(seedptr);
+  void PutHigherside(const uint32_t seed, const uint32_t version) {
+    const uint32_t current = Get(seed);
     if (current >= version) return;
-    Put(seedptr, version);
+    Put(seed, version);
+  }
+  void PutHigherside(const void* seedptr, const uint32_t version) {
+    PutHigherside(Hashptr(seedptr), version);
   }
 
-  void PutLowerside(const void* seedptr, const uint32_t version) {
-    const uint32_t current = Get(seedptr);
+  void PutLowerside(const uint32_t seed, const uint32_t version) {
+    const uint32_t current = Get(seed);
     if (current <= version) return;
-    Put(seedptr, version);
+    Put(seed, version);
+  }
+  void PutLowerside(const void* seedptr, const uint32_t version) {
+    PutLowerside(Hashptr(seedptr), version);
   }
 
   uint32_t Get(const uint32_t seed) {
@@ -19,7 +19,10 @@
 
 #include <assert.h>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <functional>
 #include <thread>
 
 #include "util/thread_key_storage.h"
@@ -43,20 +46,21 @@ namespace LineairDB {
 class EpochFramework {
  public:
   static constexpr EpochNumber THREAD_OFFLINE = UINT32_MAX;
+  using Duration                               = std::chrono::nanoseconds;
 
  public:
-  EpochFramework(size_t epoch_duration_ms = 40)
+  EpochFramework(Duration epoch_duration = std::chrono::milliseconds(40))
       : start_(false),
         stop_(false),
         global_epoch_(1),
-        epoch_writer_([=]() { EpochWriterJob(epoch_duration_ms); }) {}
-  EpochFramework(size_t epoch_duration_ms,
+        epoch_writer_([=]() { EpochWriterJob(epoch_duration); }) {}
+  EpochFramework(Duration epoch_duration,
                  std::function<void(EpochNumber)>&& pt)
       : start_(false),
         stop_(false),
         global_epoch_(1),
         publish_target_(pt),
-        epoch_writer_([=]() { EpochWriterJob(epoch_duration_ms); }) {}
+        epoch_writer_([=]() { EpochWriterJob(epoch_duration); }) {}
 
   ~EpochFramework() { Stop(); }
 
@@ -108,12 +112,16 @@ class EpochFramework {
     return min_epoch;
   }
 
-  void EpochWriterJob(size_t epoch_duration_ms) {
-    const uint64_t epoch_duration = epoch_duration_ms * 1000 * 1000;
+  void EpochWriterJob(const Duration epoch_duration) {
+    using Clock = std::chrono::steady_clock;
     while (!start_.load()) std::this_thread::yield();
 
+    // Epochs are started at fixed intervals, instead of sleeping for the
+    // duration after the (variable) work of each epoch.
+    auto deadline = Clock::now();
     for (;;) {
-      std::this_thread::sleep_for(std::chrono::nanoseconds(epoch_duration));
+      deadline = std::max(deadline + epoch_duration, Clock::now());
+      WaitUntil(deadline);
       EpochNumber min_epoch = GetSmallestEpoch();
       EpochNumber old_epoch = global_epoch_;
       if (min_epoch == THREAD_OFFLINE || min_epoch == old_epoch) {
@@ -124,11 +132,33 @@ class EpochFramework {
     }
   }
 
+  /**
+   * @brief
+   * Sleeps until slightly before the deadline and spins for the rest, since
+   * the sleep of the operating system oversleeps by tens of microseconds.
+   * The spin margin is calibrated by the observed oversleeps.
+   */
+  void WaitUntil(const std::chrono::steady_clock::time_point deadline) {
+    using Clock          = std::chrono::steady_clock;
+    const auto wakeup_at = deadline - spin_margin_;
+    if (Clock::now() < wakeup_at) {
+      std::this_thread::sleep_until(wakeup_at);
+      const auto overslept = Clock::now() - wakeup_at;
+      // Twice the moving average of the oversleeps.
+      const Duration margin = (spin_margin_ * 3 + overslept * 2) / 4;
+      spin_margin_ = std::clamp(margin, MinSpinMargin, MaxSpinMargin);
+    }
+    while (Clock::now() < deadline) std::this_thread::yield();
+  }
+
  private:
   std::atomic<bool> start_;
   std::atomic<bool> stop_;
   std::atomic<EpochNumber> global_epoch_;
   const std::function<void(EpochNumber)> publish_target_;
+  static constexpr Duration MinSpinMargin = std::chrono::microseconds(5);
+  static constexpr Duration MaxSpinMargin = std::chrono::microseconds(200);
+  Duration spin_margin_                   = std::chrono::microseconds(50);
   std::thread epoch_writer_;
   ThreadKeyStorage<EpochNumber> tls_;
 };
@@ -0,0 +1,120 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LINEAIRDB_UTIL_HASH_H
+#define LINEAIRDB_UTIL_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace LineairDB {
+namespace Util {
+
+/**
+ * Hash function of keys.
+ * The hash value of a key is computed once, when the key enters a
+ * transaction, and is carried with the key: snapshots in read/write sets,
+ * index nodes and log records hold it, and index probes and rehashing reuse
+ * it. Since the values are persisted in the logs, #HashKey must be stable
+ * across builds and platforms of the same byte order; replacing it requires
+ * the logs to be recovered by the older version and rewritten.
+ *
+ * The implementation is wyhash (final version 4) by Wang Yi, which is
+ * released into the public domain (The Unlicense).
+ * @see https://github.com/wangyi-fudan/wyhash
+ */
+namespace WyHash {
+
+constexpr uint64_t Secret[4] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+                                0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+
+inline void Multiply(uint64_t& a, uint64_t& b) {
+  const __uint128_t r = static_cast<__uint128_t>(a) * b;
+  a                   = static_cast<uint64_t>(r);
+  b                   = static_cast<uint64_t>(r >> 64);
+}
+inline uint64_t Mix(uint64_t a, uint64_t b) {
+  Multiply(a, b);
+  return a ^ b;
+}
+inline uint64_t Read8(const uint8_t* p) {
+  uint64_t v;
+  std::memcpy(&v, p, 8);
+  return v;
+}
+inline uint64_t Read4(const uint8_t* p) {
+  uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+inline uint64_t Read3(const uint8_t* p, const size_t k) {
+  return (static_cast<uint64_t>(p[0]) << 16) |
+         (static_cast<uint64_t>(p[k >> 1]) << 8) | p[k - 1];
+}
+
+inline uint64_t Hash(const void* key, const size_t len, uint64_t seed = 0) {
+  const auto* p = static_cast<const uint8_t*>(key);
+  seed ^= Mix(seed ^ Secret[0], Secret[1]);
+  uint64_t a, b;
+  if (len <= 16) {
+    if (len >= 4) {
+      a = (Read4(p) << 32) | Read4(p + ((len >> 3) << 2));
+      b = (Read4(p + len - 4) << 32) | Read4(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+      a = Read3(p, len);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = Mix(Read8(p) ^ Secret[1], Read8(p + 8) ^ seed);
+        see1 = Mix(Read8(p + 16) ^ Secret[2], Read8(p + 24) ^ see1);
+        see2 = Mix(Read8(p + 32) ^ Secret[3], Read8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = Mix(Read8(p) ^ Secret[1], Read8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = Read8(p + i - 16);
+    b = Read8(p + i - 8);
+  }
+  a ^= Secret[1];
+  b ^= seed;
+  Multiply(a, b);
+  return Mix(a ^ Secret[0] ^ len, b ^ Secret[1]);
+}
+
+}  // namespace WyHash
+
+inline size_t HashKey(const std::string_view key) {
+  return WyHash::Hash(key.data(), key.size());
+}
+
+}  // namespace Util
+}  // namespace LineairDB
+
+#endif /* LINEAIRDB_UTIL_HASH_H */
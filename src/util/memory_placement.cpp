@@ -0,0 +1,227 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "memory_placement.h"
+
+#include <sys/mman.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "util/logger.hpp"
+
+#if __has_include(<jemalloc/jemalloc.h>)
+#include <jemalloc/jemalloc.h>
+#define LINEAIRDB_HAS_JEMALLOC
+#endif
+
+namespace LineairDB {
+namespace Util {
+
+namespace {
+constexpr size_t CacheLineSize = 64;
+
+std::atomic<size_t> number_of_slabs{0};
+
+// The huge page frames of the slab regions, as a bitmap per 32 GB of the
+// address space. Frames are never unregistered, and thus the bitmaps are
+// read without any lock. Leaked for the same reason as the slabs.
+constexpr size_t AddressBits = 48;
+constexpr size_t FrameBits   = 21;
+constexpr size_t LeafBits    = 14;
+static_assert(HugePageSize == size_t{1} << FrameBits);
+
+struct FrameBitmap {
+  std::atomic<uint64_t> words[(size_t{1} << LeafBits) / 64];
+};
+struct RegionRegistry {
+  std::mutex lock;
+  std::atomic<FrameBitmap*>
+      leaves[size_t{1} << (AddressBits - FrameBits - LeafBits)];
+};
+RegionRegistry& Regions() {
+  static auto* registry = new RegionRegistry();
+  return *registry;
+}
+
+void RegisterRegion(const void* p, const size_t size) {
+  const auto begin = reinterpret_cast<uintptr_t>(p);
+  if ((begin + size) >> AddressBits != 0) {
+    SPDLOG_ERROR("Huge pages are mapped beyond the {0}-bit address space.",
+                 AddressBits);
+    exit(EXIT_FAILURE);
+  }
+  auto& regions = Regions();
+  std::lock_guard<std::mutex> lock(regions.lock);
+  for (auto frame = begin >> FrameBits; frame < (begin + size) >> FrameBits;
+       frame++) {
+    auto& leaf = regions.leaves[frame >> LeafBits];
+    if (leaf.load() == nullptr) leaf.store(new FrameBitmap());
+    const auto bit = frame & ((size_t{1} << LeafBits) - 1);
+    leaf.load()->words[bit / 64].fetch_or(uint64_t{1} << (bit % 64));
+  }
+}
+
+size_t RoundUp(const size_t size, const size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+}  // namespace
+
+void* MapHugePages(const size_t size) {
+  const size_t length = RoundUp(size, HugePageSize);
+#ifdef MAP_HUGETLB
+  void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (p != MAP_FAILED) return p;
+#endif
+
+  // Transparent huge pages back only the aligned huge page frames; map an
+  // extra huge page and trim the unaligned head and tail.
+  auto* raw = static_cast<std::byte*>(mmap(nullptr, length + HugePageSize,
+                                           PROT_READ | PROT_WRITE,
+                                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  if (raw == MAP_FAILED) {
+    SPDLOG_ERROR("Failed to map {0} bytes. errno: {1}", length, errno);
+    exit(EXIT_FAILURE);
+  }
+  auto* aligned = reinterpret_cast<std::byte*>(
+      RoundUp(reinterpret_cast<uintptr_t>(raw), HugePageSize));
+  const size_t head = aligned - raw;
+  if (0 < head) munmap(raw, head);
+  munmap(aligned + length, HugePageSize - head);
+#ifdef MADV_HUGEPAGE
+  madvise(aligned, length, MADV_HUGEPAGE);
+#endif
+  return aligned;
+}
+
+void UnmapHugePages(void* p, const size_t size) {
+  munmap(p, RoundUp(size, HugePageSize));
+}
+
+bool IsPlacedOnHugePages(const void* p) {
+  const auto address = reinterpret_cast<uintptr_t>(p);
+  if (address >> AddressBits != 0) return false;
+  const auto frame = address >> FrameBits;
+  const auto* leaf = Regions().leaves[frame >> LeafBits].load();
+  if (leaf == nullptr) return false;
+  const auto bit = frame & ((size_t{1} << LeafBits) - 1);
+  return (leaf->words[bit / 64].load() >> (bit % 64)) & 1;
+}
+
+// Returns the slots cached by the exiting thread to their slabs. Constructed
+// in each thread at its first use of a slab.
+struct HugePageSlab::CacheReleaser {
+  bool armed = false;  // set to construct this in the calling thread
+  ~CacheReleaser() {
+    for (auto& cache : local_caches_) {
+      if (cache.slab == nullptr) continue;
+      cache.slab->Release(cache, cache.count);
+      cache.released = true;
+    }
+  }
+};
+thread_local HugePageSlab::LocalCache HugePageSlab::local_caches_[MaxSlabs];
+thread_local HugePageSlab::CacheReleaser HugePageSlab::releaser_;
+
+HugePageSlab::HugePageSlab(const size_t object_size)
+    : slot_size_(RoundUp(object_size, CacheLineSize)),
+      id_(number_of_slabs.fetch_add(1)),
+      current_(nullptr),
+      remaining_(0) {
+  if (MaxSlabs <= id_) {
+    SPDLOG_ERROR("Too many slabs: the capacity is {0}.", MaxSlabs);
+    exit(EXIT_FAILURE);
+  }
+}
+
+HugePageSlab::LocalCache& HugePageSlab::MyCache() {
+  auto& cache = local_caches_[id_];
+  if (cache.slab == nullptr) {
+    cache.slab      = this;
+    releaser_.armed = true;
+  }
+  return cache;
+}
+
+void* HugePageSlab::Allocate() {
+  auto& cache = MyCache();
+  if (cache.count == 0) Refill(cache, cache.released ? 1 : BatchSize);
+  return cache.slots[--cache.count];
+}
+
+void HugePageSlab::Deallocate(void* p) {
+  auto& cache                 = MyCache();
+  cache.slots[cache.count++] = p;
+  if (cache.released) {
+    Release(cache, cache.count);
+  } else if (cache.count == 2 * BatchSize) {
+    Release(cache, BatchSize);
+  }
+}
+
+void HugePageSlab::Refill(LocalCache& cache, const size_t n) {
+  std::lock_guard<std::mutex> lock(lock_);
+  while (cache.count < n && !free_slots_.empty()) {
+    cache.slots[cache.count++] = free_slots_.back();
+    free_slots_.pop_back();
+  }
+  while (cache.count < n) {
+    if (remaining_ < slot_size_) {
+      current_   = static_cast<std::byte*>(MapHugePages(RegionSize));
+      remaining_ = RegionSize;
+      RegisterRegion(current_, RegionSize);
+    }
+    cache.slots[cache.count++] = current_;
+    current_ += slot_size_;
+    remaining_ -= slot_size_;
+  }
+}
+
+void HugePageSlab::Release(LocalCache& cache, const size_t n) {
+  std::lock_guard<std::mutex> lock(lock_);
+  free_slots_.insert(free_slots_.end(), cache.slots + cache.count - n,
+                     cache.slots + cache.count);
+  cache.count -= n;
+}
+
+bool BindThisThreadToArena([[maybe_unused]] const size_t n) {
+#ifdef LINEAIRDB_HAS_JEMALLOC
+  static std::mutex arenas_lock;
+  static std::vector<unsigned> arenas;
+  unsigned arena;
+  {
+    std::lock_guard<std::mutex> lock(arenas_lock);
+    while (arenas.size() <= n) {
+      unsigned created;
+      size_t size = sizeof(created);
+      if (mallctl("arenas.create", &created, &size, nullptr, 0) != 0) {
+        return false;
+      }
+      arenas.push_back(created);
+    }
+    arena = arenas[n];
+  }
+  return mallctl("thread.arena", nullptr, nullptr, &arena, sizeof(arena)) == 0;
+#else
+  return false;
+#endif
+}
+
+}  // namespace Util
+}  // namespace LineairDB
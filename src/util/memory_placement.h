@@ -0,0 +1,189 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LINEAIRDB_MEMORY_PLACEMENT_H
+#define LINEAIRDB_MEMORY_PLACEMENT_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace LineairDB {
+namespace Util {
+
+/**
+ * Memory placement layer.
+ * The index buckets and the records (data items and index nodes) are
+ * long-lived and randomly probed; with 4 KB pages, a probe on a large table
+ * mostly misses the dTLB. When huge page placement is enabled, they are
+ * allocated from 2 MB pages instead (see LineairDB::Config::enable_huge_pages).
+ */
+constexpr size_t HugePageSize = 2 * 1024 * 1024;
+
+/**
+ * @brief
+ * Maps anonymous memory backed by huge pages. MAP_HUGETLB is tried first; if
+ * no huge page is reserved, the mapping is aligned to HugePageSize and
+ * advised for transparent huge pages. The size is rounded up to
+ * HugePageSize. Exits on failure, as well as the other allocation failures.
+ */
+void* MapHugePages(const size_t size);
+void UnmapHugePages(void* p, const size_t size);
+
+/**
+ * @brief
+ * The placement argument of the allocation functions of record types, e.g.,
+ * `new (Placement::HugePages) DataItem`. Each index places its records as
+ * configured for its own instance; records are released by `delete`
+ * wherever they are placed.
+ */
+enum class Placement { Heap, HugePages };
+bool IsPlacedOnHugePages(const void* p);
+
+/**
+ * @brief
+ * Fixed-size object allocator carving huge-page regions. Each thread caches
+ * slots per slab and takes the lock of the slab only to move a batch of
+ * slots from or to it. Freed objects are cached by the freeing thread; the
+ * excess and the cache of an exiting thread are returned to the slab.
+ * @note Regions are never returned to the OS: the memory of the records
+ * freed by an instance is reused by the later allocations of the process,
+ * but the peak footprint is kept until the process exits. The slabs are
+ * shared by all instances, one per record type; the process exits if more
+ * than MaxSlabs slabs are created.
+ */
+class HugePageSlab {
+ public:
+  explicit HugePageSlab(const size_t object_size);
+  void* Allocate();
+  void Deallocate(void* p);
+
+ private:
+  static constexpr size_t RegionSize = 16 * HugePageSize;
+  static constexpr size_t BatchSize  = 32;
+  static constexpr size_t MaxSlabs   = 8;  // at most one per record type
+
+  // Trivially destructible, so that it is still usable while the thread
+  // destroys its other thread-local objects; see CacheReleaser.
+  struct LocalCache {
+    HugePageSlab* slab;
+    bool released;  // the thread is exiting; bypass the cache
+    size_t count;
+    void* slots[2 * BatchSize];
+  };
+  struct CacheReleaser;
+
+  LocalCache& MyCache();
+  void Refill(LocalCache& cache, const size_t n);
+  void Release(LocalCache& cache, const size_t n);
+
+  const size_t slot_size_;
+  const size_t id_;
+  std::mutex lock_;
+  std::vector<void*> free_slots_;
+  std::byte* current_;
+  size_t remaining_;
+
+  static thread_local LocalCache local_caches_[MaxSlabs];
+  static thread_local CacheReleaser releaser_;
+};
+
+/**
+ * @brief
+ * Class-specific allocation functions for record types. Slabs are leaked
+ * intentionally so that records released at the static destruction are
+ * still returned to a living slab.
+ */
+template <typename T>
+HugePageSlab& SlabFor() {
+  static auto* slab = new HugePageSlab(sizeof(T));
+  return *slab;
+}
+template <typename T>
+void* AllocateRecord(const size_t size,
+                     const Placement placement = Placement::Heap) {
+  if (placement != Placement::HugePages || size != sizeof(T)) {
+    return ::operator new(size);
+  }
+  return SlabFor<T>().Allocate();
+}
+template <typename T>
+void DeallocateRecord(void* p) {
+  if (IsPlacedOnHugePages(p)) {
+    SlabFor<T>().Deallocate(p);
+  } else {
+    ::operator delete(p);
+  }
+}
+
+/**
+ * @brief
+ * STL allocator placing large arrays (e.g., the buckets of a hash table) on
+ * huge pages. Arrays smaller than a huge page, and all arrays of a disabled
+ * allocator, are allocated by std::allocator.
+ */
+template <typename T>
+class HugePageAllocator {
+ public:
+  typedef T value_type;
+
+  explicit HugePageAllocator(const bool enabled = false) : enabled_(enabled) {}
+  template <typename U>
+  HugePageAllocator(const HugePageAllocator<U>& other)
+      : enabled_(other.IsEnabled()) {}
+
+  T* allocate(const size_t n) {
+    if (!UsesHugePages(n)) return std::allocator<T>().allocate(n);
+    return static_cast<T*>(MapHugePages(n * sizeof(T)));
+  }
+  void deallocate(T* p, const size_t n) {
+    if (!UsesHugePages(n)) return std::allocator<T>().deallocate(p, n);
+    UnmapHugePages(p, n * sizeof(T));
+  }
+  bool IsEnabled() const { return enabled_; }
+
+  template <typename U>
+  bool operator==(const HugePageAllocator<U>& other) const {
+    return enabled_ == other.IsEnabled();
+  }
+  template <typename U>
+  bool operator!=(const HugePageAllocator<U>& other) const {
+    return !(*this == other);
+  }
+
+ private:
+  bool UsesHugePages(const size_t n) const {
+    return enabled_ && HugePageSize <= n * sizeof(T);
+  }
+  bool enabled_;
+};
+
+/**
+ * @brief
+ * Binds the calling thread to the n-th dedicated jemalloc arena, creating it
+ * if needed. Arenas are reused by the threads of subsequent instances bound
+ * to the same number. The allocations of transaction-local data (read/write
+ * sets, snapshots and procedures) then never contend on the shared arenas.
+ * @return false if the library is built without jemalloc.
+ */
+bool BindThisThreadToArena(const size_t n);
+
+}  // namespace Util
+}  // namespace LineairDB
+
+#endif /* LINEAIRDB_MEMORY_PLACEMENT_H */
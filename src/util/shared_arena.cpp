@@ -0,0 +1,205 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "shared_arena.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+#include "util/logger.hpp"
+
+namespace LineairDB {
+namespace Util {
+
+namespace {
+constexpr size_t BlockAlignment = 64;
+// Blocks up to SmallLimit bytes are classified by multiples of
+// BlockAlignment, and the larger ones by powers of two.
+constexpr size_t SmallLimit      = 4096;
+constexpr size_t SmallClasses    = SmallLimit / BlockAlignment;
+constexpr size_t NumberOfClasses = SmallClasses + 48;
+constexpr uint64_t Magic         = 0x4c696e6561697244ull;  // "LineairD"
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<bool>::is_always_lock_free);
+static_assert(std::is_trivially_destructible_v<SharedSpinLock>);
+
+size_t ClassOf(const size_t size) {
+  if (size <= SmallLimit) {
+    return (std::max<size_t>(size, 1) + BlockAlignment - 1) / BlockAlignment -
+           1;
+  }
+  size_t shift = 13;  // 8 KB
+  while ((size_t{1} << shift) < size) shift++;
+  return SmallClasses + shift - 13;
+}
+size_t SizeOfClass(const size_t size_class) {
+  if (size_class < SmallClasses) return (size_class + 1) * BlockAlignment;
+  return size_t{1} << (size_class - SmallClasses + 13);
+}
+}  // namespace
+
+struct SharedArena::Header {
+  std::atomic<uint64_t> magic;  // set when the creator has initialized it
+  uint64_t size;
+  std::atomic<uint64_t> root;
+  std::atomic<uint64_t> attachments;
+  // Set while a mapping holds the lock of #LockExclusively; left set by a
+  // holder which has crashed.
+  std::atomic<bool> held;
+  SharedSpinLock lock;
+  // The offset of the unallocated space and the heads of the free lists;
+  // guarded by the lock. Each free block holds the offset of the next one.
+  uint64_t used;
+  uint64_t free_lists[NumberOfClasses];
+};
+
+SharedArena::SharedArena(const std::string& name, const size_t size)
+    : base_(nullptr),
+      size_(0),
+      created_(false),
+      fd_(-1),
+      locked_(false),
+      holder_crashed_(false) {
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd != -1) {
+    created_ = true;
+    size_    = size;
+    if (size_ < sizeof(Header) || ftruncate(fd, size_) != 0) {
+      SPDLOG_ERROR("Failed to create the shared memory segment {0} of {1} "
+                   "bytes. errno: {2}",
+                   name, size_, errno);
+      exit(EXIT_FAILURE);
+    }
+  } else if (errno == EEXIST) {
+    fd = shm_open(name.c_str(), O_RDWR, 0600);
+    // The creator may not have sized it yet.
+    struct stat st {};
+    while (fd != -1 && fstat(fd, &st) == 0 && st.st_size == 0) {
+      std::this_thread::yield();
+    }
+    size_ = st.st_size;
+  }
+  if (fd == -1) {
+    SPDLOG_ERROR("Failed to open the shared memory segment {0}. errno: {1}",
+                 name, errno);
+    exit(EXIT_FAILURE);
+  }
+
+  void* p = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  fd_     = fd;
+  if (p == MAP_FAILED) {
+    SPDLOG_ERROR("Failed to map the shared memory segment {0}. errno: {1}",
+                 name, errno);
+    exit(EXIT_FAILURE);
+  }
+  base_        = static_cast<std::byte*>(p);
+  auto* header = reinterpret_cast<Header*>(base_);
+
+  if (created_) {
+    // The segment is zero-filled, and so are the free lists and the root.
+    header->size = size_;
+    header->used =
+        (sizeof(Header) + BlockAlignment - 1) / BlockAlignment * BlockAlignment;
+    header->magic.store(Magic, std::memory_order_release);
+  } else {
+    while (header->magic.load(std::memory_order_acquire) != Magic) {
+      std::this_thread::yield();
+    }
+  }
+  header->attachments.fetch_add(1);
+}
+
+SharedArena::~SharedArena() {
+  auto* header = reinterpret_cast<Header*>(base_);
+  if (locked_) header->held.store(false);  // detached cleanly
+  header->attachments.fetch_sub(1);
+  munmap(base_, size_);
+  close(fd_);  // releases the lock of #LockExclusively, if any
+}
+
+bool SharedArena::Unlink(const std::string& name) {
+  return shm_unlink(name.c_str()) == 0;
+}
+
+void* SharedArena::Allocate(const size_t size) {
+  auto* header            = reinterpret_cast<Header*>(base_);
+  const size_t size_class = ClassOf(size);
+  const size_t block_size = SizeOfClass(size_class);
+  uint64_t offset         = 0;
+
+  header->lock.lock();
+  if (header->free_lists[size_class] != 0) {
+    offset = header->free_lists[size_class];
+    std::memcpy(&header->free_lists[size_class], base_ + offset,
+                sizeof(uint64_t));
+  } else if (block_size <= header->size - header->used) {
+    offset = header->used;
+    header->used += block_size;
+  }
+  header->lock.unlock();
+
+  if (offset == 0) {
+    SPDLOG_ERROR("The shared memory segment is exhausted: the size is {0}.",
+                 header->size);
+    exit(EXIT_FAILURE);
+  }
+  return base_ + offset;
+}
+
+void SharedArena::Deallocate(void* p, const size_t size) {
+  if (p == nullptr) return;
+  auto* header            = reinterpret_cast<Header*>(base_);
+  const size_t size_class = ClassOf(size);
+  const uint64_t offset   = OffsetOf(p);
+
+  header->lock.lock();
+  std::memcpy(p, &header->free_lists[size_class], sizeof(uint64_t));
+  header->free_lists[size_class] = offset;
+  header->lock.unlock();
+}
+
+std::atomic<uint64_t>& SharedArena::Root() {
+  return reinterpret_cast<Header*>(base_)->root;
+}
+
+bool SharedArena::LockExclusively() {
+  if (flock(fd_, LOCK_EX | LOCK_NB) != 0) return false;
+  locked_         = true;
+  auto* header    = reinterpret_cast<Header*>(base_);
+  holder_crashed_ = header->held.exchange(true);
+  // The crashed holder may have died in #Allocate or #Deallocate. NOTE: the
+  // mappings allocating blocks are expected to hold the lock of the segment.
+  if (holder_crashed_) header->lock.unlock();
+  return true;
+}
+
+size_t SharedArena::Attachments() const {
+  return reinterpret_cast<Header*>(base_)->attachments.load();
+}
+
+}  // namespace Util
+}  // namespace LineairDB
@@ -0,0 +1,147 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LINEAIRDB_UTIL_SHARED_ARENA_H
+#define LINEAIRDB_UTIL_SHARED_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+namespace LineairDB {
+namespace Util {
+
+/**
+ * @brief
+ * Lock placed in a shared memory segment, since a std::mutex serializes only
+ * the threads of one process. Zero-filled memory is an unlocked lock.
+ */
+class SharedSpinLock {
+ public:
+  void lock() {
+    for (;;) {
+      if (!locked_.exchange(true, std::memory_order_acquire)) return;
+      while (locked_.load(std::memory_order_relaxed)) std::this_thread::yield();
+    }
+  }
+  void unlock() { locked_.store(false, std::memory_order_release); }
+
+ private:
+  std::atomic<bool> locked_;
+};
+
+/**
+ * @brief
+ * Allocator carving a named POSIX shared memory segment, which several
+ * processes (or several mappings in one process) map at different addresses.
+ * Objects placed in the segment thus refer to each other by offsets from the
+ * beginning of the segment instead of raw pointers; see #OffsetOf and #At.
+ * The offset 0 is the header of the segment and stands for nullptr.
+ *
+ * Blocks are aligned to cache lines. Freed blocks are kept in free lists of
+ * size classes in the segment and reused by any process; the segment never
+ * grows, and an allocation beyond its size exits. The free lists are guarded
+ * by a SharedSpinLock in the segment. The header also counts the mappings
+ * of the segment; see #Attachments.
+ * @note Objects placed in the segment must not hold any raw pointer or
+ * heap-allocated member (e.g., std::string), and their atomics must be
+ * lock-free, as the lock of a non-lock-free atomic is local to the process.
+ */
+class SharedArena {
+ public:
+  /**
+   * @brief
+   * Maps the named segment (e.g., "/lineairdb"), creating it with the given
+   * size if it does not exist. The size of an existing segment is kept.
+   * Exits on failure.
+   */
+  SharedArena(const std::string& name, const size_t size);
+  // Unmaps the segment; its contents persist until #Unlink.
+  ~SharedArena();
+  SharedArena(const SharedArena&) = delete;
+  SharedArena& operator=(const SharedArena&) = delete;
+
+  /**
+   * @brief
+   * Removes the named segment. The processes which have mapped it keep their
+   * mappings.
+   * @return false if no such segment exists.
+   */
+  static bool Unlink(const std::string& name);
+
+  void* Allocate(const size_t size);
+  // The size must be the one given to #Allocate.
+  void Deallocate(void* p, const size_t size);
+
+  uint64_t OffsetOf(const void* p) const {
+    if (p == nullptr) return 0;
+    return static_cast<uint64_t>(static_cast<const std::byte*>(p) - base_);
+  }
+  template <typename T>
+  T* At(const uint64_t offset) const {
+    if (offset == 0) return nullptr;
+    return reinterpret_cast<T*>(base_ + offset);
+  }
+
+  /**
+   * @brief
+   * The offset of the root object of the segment (e.g., the index), through
+   * which the processes attaching the segment find the objects placed by the
+   * others. 0 until someone sets it.
+   */
+  std::atomic<uint64_t>& Root();
+  /**
+   * @brief
+   * The number of the live mappings of the segment, including this one. A
+   * process which has crashed is still counted.
+   */
+  size_t Attachments() const;
+  /**
+   * @brief
+   * Takes the lock of the segment, which at most one mapping holds at a time
+   * until it is unmapped. Unlike #Attachments, the lock of a process which
+   * has crashed is released by the kernel.
+   * @return false if another mapping holds the lock.
+   */
+  bool LockExclusively();
+  /**
+   * @brief
+   * Whether the previous holder of the lock of #LockExclusively has crashed
+   * instead of unmapping the segment. The arena itself is then repaired by
+   * #LockExclusively, while the objects placed in the segment may be left
+   * locked or half-written by the crashed holder.
+   */
+  bool HolderHasCrashed() const { return holder_crashed_; }
+  bool HasCreated() const { return created_; }
+  size_t Size() const { return size_; }
+
+ private:
+  struct Header;
+
+  std::byte* base_;
+  size_t size_;
+  bool created_;
+  int fd_;  // kept open for #LockExclusively
+  bool locked_;
+  bool holder_crashed_;
+};
+
+}  // namespace Util
+}  // namespace LineairDB
+
+#endif /* LINEAIRDB_UTIL_SHARED_ARENA_H */
@@ -0,0 +1,84 @@
+/*
+ *   Copyright (C) 2020 Nippon Telegraph and Telephone Corporation.
+
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+
+ *   http://www.apache.org/licenses/LICENSE-2.0
+
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <lineairdb/lineairdb.h>
+
+#include <atomic>
+#include <experimental/filesystem>
+#include <memory>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#ifndef LINEAIRDB_HAS_COROUTINES
+#error "This test must be compiled with the support of C++20 coroutines."
+#endif
+
+class CoroutineTest : public ::testing::Test {
+ protected:
+  std::unique_ptr<LineairDB::Database> db_;
+  virtual void SetUp() {
+    std::experimental::filesystem::remove_all("lineairdb_logs");
+    LineairDB::Config config;
+    config.max_thread = 4;
+    db_               = std::make_unique<LineairDB::Database>(config);
+  }
+};
+
+TEST_F(CoroutineTest, SuspendAndResume) {
+  std::atomic<bool> other_committed(false);
+  std::atomic<size_t> terminated(0);
+  std::thread resumer;
+
+  auto transfer = [&](LineairDB::Transaction& tx) -> LineairDB::Procedure {
+    tx.Write<int>("alice", 1);
+    // Resumed after another transaction has been committed.
+    co_await LineairDB::Suspend([&](LineairDB::Database::ResumeType resume) {
+      resumer = std::thread([&, resume]() {
+        while (!other_committed.load()) { std::this_thread::yield(); }
+        resume();
+      });
+    });
+    auto alice = tx.Read<int>("alice");
+    EXPECT_TRUE(alice.has_value());
+    tx.Write<int>("bob", alice.value_or(0) + 1);
+  };
+  db_->ExecuteResumableTransaction(
+      LineairDB::Resumable(transfer), [&](LineairDB::TxStatus status) {
+        ASSERT_EQ(LineairDB::TxStatus::Committed, status);
+        terminated++;
+      });
+  db_->ExecuteTransaction(
+      [&](LineairDB::Transaction& tx) { tx.Write<int>("carol", 1); },
+      [&](LineairDB::TxStatus) { other_committed = true; });
+  db_->Fence();
+  resumer.join();
+  ASSERT_EQ(1, terminated.load());
+
+  std::atomic<bool> read(false);
+  db_->ExecuteTransaction(
+      [&](LineairDB::Transaction& tx) {
+        auto bob = tx.Read<int>("bob");
+        ASSERT_TRUE(bob.has_value());
+        ASSERT_EQ(2, bob.value());
+      },
+      [&](LineairDB::TxStatus status) {
+        ASSERT_EQ(LineairDB::TxStatus::Committed, status);
+        read = true;
+      });
+  db_->Fence();
+  ASSERT_TRUE(read.load());
+}
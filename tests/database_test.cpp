@@ -19,14 +19,22 @@
 #include <lineairdb/transaction.h>
 #include <lineairdb/tx_status.h>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cstring>
 #include <experimental/filesystem>
+#include <fstream>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <sstream>
 #include <thread>
 #include <vector>
 
 #include "gtest/gtest.h"
+#include "trace/trace_format.h"
+#include "util/shared_arena.h"
 
 typedef std::function<void(LineairDB::Transaction&)> TransactionProcedure;
 class DatabaseTest : public ::testing::Test {
@@ -205,3 +213,1194 @@ TEST_F(DatabaseTest, Recovery) {
     ASSERT_EQ(initial_value, current_value);
   }});
 }
+
+TEST_F(DatabaseTest, RecoveryAcrossMultipleRestarts) {
+  const LineairDB::Config config = db_->GetConfig();
+
+  // The keys are logged only in the first log record of each data item;
+  // the subsequent records refer the items by their record ids.
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+                    tx.Write<int>("alice", 1);
+                    tx.Write<int>("bob", 1, std::chrono::hours(1));
+                  },
+                  [&](LineairDB::Transaction& tx) {
+                    tx.Write<int>("alice", 2);
+                  }});
+  db_->Fence();
+  db_.reset(nullptr);
+  db_ = std::make_unique<LineairDB::Database>(config);
+
+  // Newly inserted items must not reuse the record ids of recovered ones.
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+                    tx.Write<int>("bob", 3);
+                    tx.Write<int>("carol", 3);
+                  }});
+  db_->Fence();
+  db_.reset(nullptr);
+  db_ = std::make_unique<LineairDB::Database>(config);
+
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    auto alice = tx.Read<int>("alice");
+    auto bob   = tx.Read<int>("bob");
+    auto carol = tx.Read<int>("carol");
+    ASSERT_TRUE(alice.has_value() && bob.has_value() && carol.has_value());
+    ASSERT_EQ(2, alice.value());
+    ASSERT_EQ(3, bob.value());
+    ASSERT_EQ(3, carol.value());
+  }});
+}
+
+TEST_F(DatabaseTest, RecoveryOfExpiredRecordIds) {
+  const LineairDB::Config config = db_->GetConfig();
+
+  DoTransactions({[&](LineairDB::Transaction& tx) { tx.Write<int>("bob", 1); },
+                  [&](LineairDB::Transaction& tx) {
+                    tx.Write<int>("alice", 2, std::chrono::milliseconds(500));
+                  }});
+  db_->Fence();
+  db_.reset(nullptr);
+  std::this_thread::sleep_for(std::chrono::milliseconds(600));
+
+  // The record of alice, which has the highest id, is not recovered; its id
+  // must not be given to carol.
+  db_ = std::make_unique<LineairDB::Database>(config);
+  DoTransactions(
+      {[&](LineairDB::Transaction& tx) { tx.Write<int>("carol", 3); }});
+  db_->Fence();
+  db_.reset(nullptr);
+  db_ = std::make_unique<LineairDB::Database>(config);
+
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    ASSERT_FALSE(tx.Read<int>("alice").has_value());
+    ASSERT_EQ(1, tx.Read<int>("bob").value());
+    ASSERT_EQ(3, tx.Read<int>("carol").value());
+  }});
+}
+
+TEST_F(DatabaseTest, RecoveryAfterCrashAcrossMultipleRestarts) {
+  const LineairDB::Config config = db_->GetConfig();
+  constexpr auto durable_epoch_file = "lineairdb_logs/durable_epoch.json";
+
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    tx.Write<int>("alice", 1);
+  }});
+  std::string durable_epoch;
+  std::ifstream(durable_epoch_file) >> durable_epoch;
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    tx.Write<int>("alice", 2);
+  }});
+  db_->Fence();
+  db_.reset(nullptr);
+  // Simulate a crash before the epoch of the second write became durable;
+  // the log record of the write remains.
+  std::ofstream(durable_epoch_file, std::ofstream::trunc) << durable_epoch;
+
+  db_ = std::make_unique<LineairDB::Database>(config);
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    ASSERT_EQ(1, tx.Read<int>("alice").value());
+    tx.Write<int>("bob", 1);
+  }});
+  // Let the durable epoch pass the one of the discarded write.
+  for (size_t i = 0; i < 10; i++) db_->Fence();
+  db_.reset(nullptr);
+
+  db_ = std::make_unique<LineairDB::Database>(config);
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    ASSERT_EQ(1, tx.Read<int>("alice").value());
+    ASSERT_EQ(1, tx.Read<int>("bob").value());
+  }});
+}
+
+TEST_F(DatabaseTest, RecoveryWithLogFlushThreshold) {
+  // Every record is handed over to the writer thread as soon as enqueued.
+  config_.log_flush_threshold = 1;
+  db_.reset(nullptr);
+  db_ = std::make_unique<LineairDB::Database>(config_);
+
+  std::vector<TransactionProcedure> txns;
+  for (int i = 0; i < 32; i++) {
+    txns.push_back([i](LineairDB::Transaction& tx) {
+      tx.Write<int>("key" + std::to_string(i), i);
+    });
+  }
+  DoTransactions(txns);
+  db_->Fence();
+  db_.reset(nullptr);
+
+  // A record torn by a crash at the end of a log file is ignored.
+  std::ofstream torn("lineairdb_logs/thread0.json",
+                     std::ofstream::binary | std::ofstream::app);
+  torn << '\xdd';
+  torn.close();
+
+  db_ = std::make_unique<LineairDB::Database>(config_);
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    for (int i = 0; i < 32; i++) {
+      auto value = tx.Read<int>("key" + std::to_string(i));
+      ASSERT_TRUE(value.has_value());
+      ASSERT_EQ(i, value.value());
+    }
+  }});
+}
+
+TEST_F(DatabaseTest, RecoveryWithPartitionedLogs) {
+  config_.log_partitions = 4;
+  db_.reset(nullptr);
+  db_ = std::make_unique<LineairDB::Database>(config_);
+
+  std::vector<TransactionProcedure> txns;
+  for (int i = 0; i < 32; i++) {
+    txns.push_back([i](LineairDB::Transaction& tx) {
+      tx.Write<int>("key" + std::to_string(i), i);
+      tx.Write<int>("key" + std::to_string((i + 1) % 32), i + 1);
+    });
+  }
+  DoTransactions(txns);
+  db_->Fence();
+  db_.reset(nullptr);
+  size_t partitioned_files = 0;
+  for (auto& file :
+       std::experimental::filesystem::directory_iterator("lineairdb_logs")) {
+    auto filename = file.path().filename().string();
+    if (filename.find("_partition3of4.json") != std::string::npos) {
+      partitioned_files++;
+    }
+  }
+  ASSERT_LT(0, partitioned_files);
+
+  // The partitions are recovered independently; after the number of
+  // partitions has been changed, the logs are recovered as a whole.
+  for (size_t partitions : {4, 0}) {
+    config_.log_partitions = partitions;
+    db_ = std::make_unique<LineairDB::Database>(config_);
+    DoTransactions({[&](LineairDB::Transaction& tx) {
+      for (int i = 0; i < 32; i++) {
+        auto value = tx.Read<int>("key" + std::to_string(i));
+        ASSERT_TRUE(value.has_value());
+        ASSERT_EQ(i == 0 ? 32 : i, value.value());
+      }
+    }});
+    db_->Fence();
+    db_.reset(nullptr);
+  }
+}
+
+TEST_F(DatabaseTest, NonDurableTransaction) {
+  const LineairDB::Config config = db_->GetConfig();
+  ASSERT_TRUE(config.enable_logging);
+
+  int initial_value = 1;
+  std::atomic<bool> acknowledged(false);
+  db_->ExecuteTransaction(
+      [&](LineairDB::Transaction& tx) {
+        tx.MarkAsNonDurable();
+        tx.Write<int>("session", initial_value);
+      },
+      [&](const LineairDB::TxStatus status) {
+        ASSERT_EQ(LineairDB::TxStatus::Committed, status);
+        acknowledged.store(true);
+      });
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    tx.Write<int>("alice", initial_value);
+  }});
+  db_->Fence();
+  ASSERT_TRUE(acknowledged.load());
+
+  db_.reset(nullptr);
+  db_ = std::make_unique<LineairDB::Database>(config);
+
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    auto alice = tx.Read<int>("alice");
+    ASSERT_TRUE(alice.has_value());
+    ASSERT_EQ(initial_value, alice.value());
+    ASSERT_FALSE(tx.Read<int>("session").has_value());
+  }});
+}
+
+TEST_F(DatabaseTest, SubMillisecondEpochs) {
+  db_.reset(nullptr);
+  config_.epoch_duration_us = 200;
+  db_ = std::make_unique<LineairDB::Database>(config_);
+
+  // With the default (40ms) epochs, each of the transactions below waits for
+  // tens of milliseconds before its callback.
+  constexpr size_t Transactions = 50;
+  const auto begin              = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < Transactions; i++) {
+    std::atomic<bool> committed(false);
+    db_->ExecuteTransaction(
+        [&](LineairDB::Transaction& tx) { tx.Write<size_t>("alice", i); },
+        [&](const LineairDB::TxStatus status) {
+          ASSERT_EQ(LineairDB::TxStatus::Committed, status);
+          committed.store(true);
+        });
+    while (!committed.load()) std::this_thread::yield();
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - begin;
+  ASSERT_LT(elapsed, std::chrono::milliseconds(Transactions * 10));
+
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    auto alice = tx.Read<size_t>("alice");
+    ASSERT_TRUE(alice.has_value());
+    ASSERT_EQ(Transactions - 1, alice.value());
+  }});
+}
+
+TEST_F(DatabaseTest, AbortRepair) {
+  db_.reset(nullptr);
+  config_.enable_abort_repair = true;
+  db_ = std::make_unique<LineairDB::Database>(config_);
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    tx.Write<int>("alice", 1);
+    tx.Write<int>("bob", 1);
+  }});
+
+  size_t alice_executions = 0;
+  size_t bob_executions   = 0;
+  size_t steps            = 0;
+  std::atomic<bool> committed(false);
+  db_->ExecuteResumableTransaction(
+      [&](LineairDB::Transaction& tx, LineairDB::Database::ResumeType resume) {
+        if (steps++ != 0) return true;
+        tx.TrackedRead<int>("alice", [&](const std::optional<int> alice) {
+          alice_executions++;
+          tx.Write<int>("alice_copy", alice.value());
+        });
+        tx.TrackedRead<int>("bob", [&](const std::optional<int> bob) {
+          bob_executions++;
+          tx.Write<int>("bob_copy", bob.value());
+        });
+        // Overwrite alice before the commit of this transaction.
+        db_->ExecuteTransaction(
+            [&](LineairDB::Transaction& tx) { tx.Write<int>("alice", 2); },
+            [&, resume](const LineairDB::TxStatus status) {
+              ASSERT_EQ(LineairDB::TxStatus::Committed, status);
+              resume();
+            });
+        return false;
+      },
+      [&](const LineairDB::TxStatus status) {
+        ASSERT_EQ(LineairDB::TxStatus::Committed, status);
+        committed.store(true);
+      });
+  db_->Fence();
+  ASSERT_TRUE(committed.load());
+  // Only the function depending on alice has been executed again.
+  ASSERT_EQ(2, alice_executions);
+  ASSERT_EQ(1, bob_executions);
+
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    ASSERT_EQ(2, tx.Read<int>("alice_copy").value());
+    ASSERT_EQ(1, tx.Read<int>("bob_copy").value());
+  }});
+}
+
+TEST_F(DatabaseTest, ReadIfChangedAndWriteIfVersion) {
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    auto alice = tx.ReadIfChanged("alice", 0);
+    ASSERT_FALSE(alice.changed);  // never written
+    tx.Write<int>("alice", 1);
+  }});
+
+  LineairDB::Transaction::Version version = 0;
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    auto alice = tx.ReadIfChanged("alice", 0);
+    ASSERT_TRUE(alice.changed);
+    ASSERT_EQ(sizeof(int), alice.size);
+    ASSERT_EQ(1, *reinterpret_cast<const int*>(alice.value));
+    version = alice.version;
+  }});
+  ASSERT_NE(0, version);
+
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    auto alice = tx.ReadIfChanged("alice", version);
+    ASSERT_FALSE(alice.changed);
+    ASSERT_EQ(nullptr, alice.value);
+    ASSERT_EQ(1, tx.Read<int>("alice").value());
+    tx.WriteIfVersion<int>("alice", version, 2);
+  }});
+
+  // The version is stale now.
+  std::atomic<bool> aborted(false);
+  db_->ExecuteTransaction(
+      [&](LineairDB::Transaction& tx) {
+        tx.WriteIfVersion<int>("alice", version, 3);
+      },
+      [&](const LineairDB::TxStatus status) {
+        aborted.store(status == LineairDB::TxStatus::Aborted);
+      });
+  db_->Fence();
+  ASSERT_TRUE(aborted.load());
+
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    auto alice = tx.ReadIfChanged("alice", version);
+    ASSERT_TRUE(alice.changed);
+    ASSERT_NE(version, alice.version);
+    ASSERT_EQ(2, *reinterpret_cast<const int*>(alice.value));
+    version = alice.version;
+  }});
+
+  // An unchanged read is validated at the commit.
+  size_t steps = 0;
+  aborted.store(false);
+  db_->ExecuteResumableTransaction(
+      [&](LineairDB::Transaction& tx, LineairDB::Database::ResumeType resume) {
+        if (steps++ != 0) {
+          tx.Write<int>("bob", 1);
+          return true;
+        }
+        EXPECT_FALSE(tx.ReadIfChanged("alice", version).changed);
+        db_->ExecuteTransaction(
+            [&](LineairDB::Transaction& tx) { tx.Write<int>("alice", 4); },
+            [resume](const LineairDB::TxStatus) { resume(); });
+        return false;
+      },
+      [&](const LineairDB::TxStatus status) {
+        aborted.store(status == LineairDB::TxStatus::Aborted);
+      });
+  db_->Fence();
+  ASSERT_TRUE(aborted.load());
+}
+
+TEST_F(DatabaseTest, OverwriteInOneEpoch) {
+  db_.reset(nullptr);
+  config_.max_thread        = 1;
+  config_.epoch_duration_ms = 1000;
+  db_ = std::make_unique<LineairDB::Database>(config_);
+
+  // The only worker processes the transactions one by one in the submitted
+  // order, without waiting for their epochs; thus all of the transactions
+  // below run in one epoch (most likely).
+  std::vector<LineairDB::TxStatus> results(
+      6, LineairDB::TxStatus::NotYetTerminated);
+  size_t submitted   = 0;
+  const auto execute = [&](TransactionProcedure procedure) {
+    db_->ExecuteTransaction(procedure,
+                            [&, i = submitted](const LineairDB::TxStatus s) {
+                              results[i] = s;
+                            });
+    submitted++;
+  };
+
+  LineairDB::Transaction::Version first  = 0;
+  LineairDB::Transaction::Version second = 0;
+  execute([&](LineairDB::Transaction& tx) { tx.Write<int>("alice", 1); });
+  execute([&](LineairDB::Transaction& tx) {
+    first = tx.ReadIfChanged("alice", 0).version;
+    tx.WriteIfVersion<int>("alice", first, 2);
+  });
+  execute([&](LineairDB::Transaction& tx) {
+    auto alice = tx.ReadIfChanged("alice", first);
+    ASSERT_TRUE(alice.changed);
+    ASSERT_EQ(2, *reinterpret_cast<const int*>(alice.value));
+    second = alice.version;
+  });
+  // The overwritten version is stale even in the same epoch.
+  execute([&](LineairDB::Transaction& tx) {
+    tx.WriteIfVersion<int>("alice", first, 3);
+  });
+  execute([&](LineairDB::Transaction& tx) {
+    tx.WriteIfVersion<int>("alice", second, 3);
+  });
+  execute([&](LineairDB::Transaction& tx) {
+    ASSERT_EQ(3, tx.Read<int>("alice").value());
+  });
+  db_->Fence();
+
+  ASSERT_LT(first, second);
+  ASSERT_EQ(LineairDB::TxStatus::Aborted, results[3]);
+  for (size_t i : {0, 1, 2, 4, 5}) {
+    ASSERT_EQ(LineairDB::TxStatus::Committed, results[i]);
+  }
+}
+
+TEST_F(DatabaseTest, FlatCombining) {
+  db_.reset(nullptr);
+  config_.enable_flat_combining = true;
+  db_ = std::make_unique<LineairDB::Database>(config_);
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    tx.Write<int>("counter", 0);
+  }});
+
+  // Deferred updates into the same data item never abort each other, whether
+  // they are combined or not.
+  const auto increment = [](const std::optional<int> counter) {
+    return counter.value() + 1;
+  };
+  std::vector<TransactionProcedure> increments(
+      200, [&](LineairDB::Transaction& tx) {
+        tx.Update<int>("counter", increment);
+      });
+  ASSERT_EQ(increments.size(), DoTransactionsOnMultiThreads(increments));
+
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    tx.Update<int>("counter", increment);
+    // The update is applied by the read.
+    ASSERT_EQ(201, tx.Read<int>("counter").value());
+    tx.Update<int>("counter", increment);
+    ASSERT_EQ(202, tx.Read<int>("counter").value());
+  }});
+
+  // The combined updates are recovered as well.
+  db_.reset(nullptr);
+  db_ = std::make_unique<LineairDB::Database>(config_);
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    ASSERT_EQ(202, tx.Read<int>("counter").value());
+  }});
+}
+
+TEST_F(DatabaseTest, FlatCombiningUnderContention) {
+  db_.reset(nullptr);
+  config_.enable_flat_combining = true;
+  config_.max_thread            = 16;
+  db_ = std::make_unique<LineairDB::Database>(config_);
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    tx.Write<int>("counter", 0);
+    tx.Write<int>("slow", 0);
+  }});
+
+  // Some holders keep the counter locked while they update the slow data
+  // item; the increments waiting for them make the counter hot, and then
+  // join the batches of the later holders.
+  const auto increment = [](const std::optional<int> counter) {
+    return counter.value() + 1;
+  };
+  const auto slowly = [](const std::optional<int> slow) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    return slow.value();
+  };
+  constexpr size_t transactions = 200;
+  std::atomic<size_t> terminated(0);
+  std::atomic<size_t> committed(0);
+  std::atomic<size_t> combined(0);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < transactions; i++) {
+    threads.emplace_back([&, i]() {
+      db_->ExecuteTransaction(
+          [&, i](LineairDB::Transaction& tx) {
+            tx.Update<int>("counter", increment);
+            if (i % 8 == 0) tx.Update<int>("slow", slowly);
+          },
+          [&](const LineairDB::Database::TxOutcome& outcome) {
+            if (outcome.status == LineairDB::TxStatus::Committed) committed++;
+            if (outcome.combined) combined++;
+            terminated++;
+          });
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  db_->Fence();
+  ASSERT_EQ(transactions, terminated.load());
+  ASSERT_LT(0u, combined.load());
+
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    ASSERT_EQ(committed.load(),
+              static_cast<size_t>(tx.Read<int>("counter").value()));
+  }});
+}
+
+TEST_F(DatabaseTest, FlatCombiningWithAbortingHolders) {
+  db_.reset(nullptr);
+  config_.enable_flat_combining = true;
+  config_.max_thread            = 16;
+  db_ = std::make_unique<LineairDB::Database>(config_);
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    tx.Write<int>("counter", 0);
+    tx.Write<int>("slow", 0);
+    tx.Write<int>("gate", 0);
+  }});
+
+  // The holders lock the counter and then wait for the slow updates, which
+  // change the gate read by the holders. Thus the holders often abort after
+  // the other increments have joined their batches; such increments are
+  // aborted as well.
+  const auto increment = [](const std::optional<int> counter) {
+    return counter.value() + 1;
+  };
+  const auto slowly = [](const std::optional<int> slow) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    return slow.value();
+  };
+  std::vector<TransactionProcedure> procedures;
+  for (size_t i = 0; i < 400; i++) {
+    if (i % 8 == 0) {
+      procedures.push_back([&](LineairDB::Transaction& tx) {
+        auto gate = tx.Read<int>("gate").value();
+        tx.Update<int>("slow", slowly);
+        tx.Write<int>("gate", gate + 1);
+      });
+    } else if (i % 4 == 0) {
+      procedures.push_back([&](LineairDB::Transaction& tx) {
+        tx.Read<int>("gate");
+        tx.Update<int>("counter", increment);
+        tx.Update<int>("slow", slowly);
+      });
+    } else {
+      procedures.push_back([&](LineairDB::Transaction& tx) {
+        tx.Update<int>("counter", increment);
+      });
+    }
+  }
+  const size_t committed = DoTransactionsOnMultiThreads(procedures);
+
+  // Every committed transaction, except the ones updating only the slow
+  // data item and the gate, has incremented the counter exactly once.
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    const auto gate    = tx.Read<int>("gate").value();
+    const auto counter = tx.Read<int>("counter").value();
+    ASSERT_EQ(committed, static_cast<size_t>(gate + counter));
+  }});
+}
+
+TEST_F(DatabaseTest, Expiration) {
+  config_.expiration_reaper_interval_ms = 1;
+  for (const bool no_wait_reads : {false, true}) {
+    db_.reset(nullptr);
+    std::experimental::filesystem::remove_all("lineairdb_logs");
+    config_.enable_no_wait_reads = no_wait_reads;
+    db_ = std::make_unique<LineairDB::Database>(config_);
+    constexpr size_t sessions = 1000;
+    DoTransactions({[&](LineairDB::Transaction& tx) {
+      for (size_t i = 0; i < sessions; i++) {
+        tx.Write<size_t>("session" + std::to_string(i), i,
+                         std::chrono::seconds(1));
+      }
+      tx.Write<int>("counter", 0, std::chrono::seconds(1));
+      tx.Write<int>("alice", 1, std::chrono::hours(1));
+      tx.Write<int>("bob", 1);
+    }});
+    const auto increment = [](const std::optional<int> counter) {
+      return counter.value_or(0) + 1;
+    };
+    LineairDB::Transaction::Version expired_version = 0;
+    LineairDB::Transaction::Version counter_version = 0;
+    DoTransactions({[&](LineairDB::Transaction& tx) {
+                      ASSERT_EQ(0, tx.Read<size_t>("session0").value());
+                      expired_version = tx.ReadIfChanged("session1", 0).version;
+                      counter_version = tx.ReadIfChanged("counter", 0).version;
+                    },
+                    [&](LineairDB::Transaction& tx) {
+                      // An update keeps the expiration time, even if the
+                      // value has not been copied by the read.
+                      ASSERT_FALSE(
+                          tx.ReadIfChanged("counter", counter_version).changed);
+                      tx.Update<int>("counter", increment);
+                    }});
+
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    DoTransactions({[&](LineairDB::Transaction& tx) {
+      ASSERT_FALSE(tx.Read<size_t>("session0").has_value());
+      ASSERT_FALSE(tx.Read<int>("counter").has_value());
+      ASSERT_EQ(1, tx.Read<int>("alice").value());
+      ASSERT_EQ(1, tx.Read<int>("bob").value());
+    }});
+
+    // The reaper removes the expired data items: the key is then missing,
+    // i.e., its version is 0.
+    bool reaped = false;
+    for (size_t i = 0; i < 100 && !reaped; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      DoTransactions({[&](LineairDB::Transaction& tx) {
+        reaped = tx.ReadIfChanged("session" + std::to_string(sessions - 1), 0)
+                     .version == 0;
+      }});
+    }
+    ASSERT_TRUE(reaped);
+    // The version of the expired value is stale.
+    std::atomic<bool> aborted(false);
+    db_->ExecuteTransaction(
+        [&](LineairDB::Transaction& tx) {
+          tx.WriteIfVersion<size_t>("session1", expired_version, 1);
+        },
+        [&](const LineairDB::TxStatus status) {
+          aborted.store(status == LineairDB::TxStatus::Aborted);
+        });
+    db_->Fence();
+    ASSERT_TRUE(aborted.load());
+    DoTransactions({[&](LineairDB::Transaction& tx) {
+      ASSERT_EQ(0, tx.ReadIfChanged("session0", 0).version);
+      tx.Write<size_t>("session0", 42);
+      tx.Update<int>("counter", increment);
+    }});
+
+    // Expired values are not recovered, while the ones written again are.
+    db_.reset(nullptr);
+    db_ = std::make_unique<LineairDB::Database>(config_);
+    DoTransactions({[&](LineairDB::Transaction& tx) {
+      ASSERT_EQ(42, tx.Read<size_t>("session0").value());
+      ASSERT_EQ(0, tx.ReadIfChanged("session1", 0).version);
+      ASSERT_EQ(1, tx.Read<int>("counter").value());
+      ASSERT_EQ(1, tx.Read<int>("alice").value());
+    }});
+  }
+}
+
+TEST_F(DatabaseTest, ParallelScan) {
+  constexpr size_t working_set_size = 2048;
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    for (size_t i = 0; i < working_set_size; i++) {
+      tx.Write<size_t>(std::to_string(i), i);
+    }
+    tx.Read<size_t>("not_exist");
+  }});
+
+  std::atomic<size_t> visited(0);
+  std::atomic<size_t> sum(0);
+  db_->ParallelScan(
+      [&](const std::string_view key,
+          const std::pair<const std::byte* const, const size_t> value) {
+        ASSERT_EQ(sizeof(size_t), value.second);
+        size_t v;
+        std::memcpy(&v, value.first, sizeof(size_t));
+        ASSERT_EQ(std::to_string(v), key);
+        visited++;
+        sum += v;
+      },
+      4);
+  ASSERT_EQ(working_set_size, visited.load());
+  ASSERT_EQ(working_set_size * (working_set_size - 1) / 2, sum.load());
+}
+
+TEST_F(DatabaseTest, InlineConcurrentPointIndex) {
+  db_.reset(nullptr);
+  config_.concurrent_point_index =
+      LineairDB::Config::ConcurrentPointIndex::MPMCInlineConcurrentHashSet;
+  db_ = std::make_unique<LineairDB::Database>(config_);
+
+  int value_of_alice = 1;
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+                    tx.Write<int>("alice", value_of_alice);
+                  },
+                  [&](LineairDB::Transaction& tx) {
+                    auto alice = tx.Read<int>("alice");
+                    ASSERT_EQ(value_of_alice, alice.value());
+                    ASSERT_FALSE(tx.Read<int>("bob").has_value());
+                  }});
+
+  db_.reset(nullptr);
+  db_ = std::make_unique<LineairDB::Database>(config_);
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    auto alice = tx.Read<int>("alice");
+    ASSERT_TRUE(alice.has_value());
+    ASSERT_EQ(value_of_alice, alice.value());
+  }});
+}
+
+TEST_F(DatabaseTest, SharedMemorySegment) {
+  db_.reset(nullptr);
+  LineairDB::Util::SharedArena::Unlink("/lineairdb_database_test");
+  config_.enable_logging        = false;
+  config_.enable_recovery       = false;
+  config_.shared_memory_segment = "/lineairdb_database_test";
+  config_.shared_memory_size    = 64 * 1024 * 1024;
+  db_ = std::make_unique<LineairDB::Database>(config_);
+
+  int value_of_alice = 1;
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+                    tx.Write<int>("alice", value_of_alice);
+                  },
+                  [&](LineairDB::Transaction& tx) {
+                    auto alice = tx.Read<int>("alice");
+                    ASSERT_EQ(value_of_alice, alice.value());
+                    ASSERT_FALSE(tx.Read<int>("bob").has_value());
+                  }});
+
+  // Neither logged nor recovered: the data items are in the segment.
+  db_.reset(nullptr);
+  db_ = std::make_unique<LineairDB::Database>(config_);
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+                    auto alice = tx.Read<int>("alice");
+                    ASSERT_TRUE(alice.has_value());
+                    ASSERT_EQ(value_of_alice, alice.value());
+                    tx.Write<int>("bob", value_of_alice);
+                  },
+                  [&](LineairDB::Transaction& tx) {
+                    ASSERT_TRUE(tx.Read<int>("bob").has_value());
+                  }});
+  db_.reset(nullptr);
+  ASSERT_TRUE(
+      LineairDB::Util::SharedArena::Unlink("/lineairdb_database_test"));
+}
+
+TEST_F(DatabaseTest, ChangeStream) {
+  std::mutex received_lock;
+  std::vector<uint32_t> epochs;
+  std::map<std::string, int> mirror;
+  std::map<std::string, uint64_t> expirations;
+  auto id = db_->Subscribe(
+      [&](const uint32_t epoch,
+          const std::vector<LineairDB::Database::Change>& changes) {
+        std::lock_guard<std::mutex> lock(received_lock);
+        epochs.push_back(epoch);
+        for (auto& change : changes) {
+          ASSERT_EQ(sizeof(int), change.size);
+          int value;
+          std::memcpy(&value, change.value, sizeof(int));
+          mirror[std::string(change.key)]      = value;
+          expirations[std::string(change.key)] = change.expires_at;
+        }
+      });
+  // Wait for the epoch in which the subscription has started.
+  db_->Fence();
+  db_->Fence();
+
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+                    tx.Write<int>("alice", 1);
+                    tx.Write<int>("bob", 1, std::chrono::hours(1));
+                  },
+                  [&](LineairDB::Transaction& tx) {
+                    tx.Write<int>("alice", 2);
+                  },
+                  [&](LineairDB::Transaction& tx) {
+                    tx.Write<int>("carol", 3);
+                    tx.MarkAsNonDurable();
+                  }});
+  db_->Fence();
+
+  size_t msec_elapsed = 0;
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(received_lock);
+      if (mirror.count("bob") && mirror.count("alice") &&
+          mirror.at("alice") == 2) {
+        break;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    ASSERT_LT(++msec_elapsed, db_->GetConfig().epoch_duration_ms * 1000);
+  }
+  db_->Unsubscribe(id);
+
+  std::lock_guard<std::mutex> lock(received_lock);
+  ASSERT_EQ(2, mirror["alice"]);
+  ASSERT_EQ(1, mirror["bob"]);
+  ASSERT_EQ(0u, expirations["alice"]);
+  ASSERT_LT(0u, expirations["bob"]);
+  ASSERT_EQ(0u, mirror.count("carol"));  // non-durable writes are not logged
+  ASSERT_TRUE(std::is_sorted(epochs.begin(), epochs.end()));
+}
+
+TEST_F(DatabaseTest, ChangeStreamOfOneKey) {
+  std::mutex received_lock;
+  std::vector<int> delivered;
+  bool in_order = true;
+  auto id = db_->Subscribe(
+      [&](const uint32_t,
+          const std::vector<LineairDB::Database::Change>& changes) {
+        std::lock_guard<std::mutex> lock(received_lock);
+        std::vector<int> values;
+        for (auto& change : changes) {
+          int value;
+          std::memcpy(&value, change.value, sizeof(int));
+          values.push_back(value);
+        }
+        // Each write increments the counter; a mirror applying the changes
+        // in the delivered order ends with the latest value.
+        in_order &= std::is_sorted(values.begin(), values.end());
+        delivered.insert(delivered.end(), values.begin(), values.end());
+      });
+  db_->Fence();
+  db_->Fence();
+
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    tx.Write<int>("counter", 0);
+  }});
+  // Two threads write the key, mostly in the same epochs.
+  std::atomic<size_t> committed(0);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < 2; i++) {
+    threads.emplace_back([&]() {
+      while (committed.load() < 100) {
+        std::atomic<bool> terminated(false);
+        db_->ExecuteTransaction(
+            [&](LineairDB::Transaction& tx) {
+              auto counter = tx.Read<int>("counter").value();
+              tx.Write<int>("counter", counter + 1);
+            },
+            [&](const LineairDB::TxStatus status) {
+              if (status == LineairDB::TxStatus::Committed) committed++;
+              terminated.store(true);
+            });
+        while (!terminated.load()) std::this_thread::yield();
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  int latest = 0;
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    latest = tx.Read<int>("counter").value();
+  }});
+  size_t msec_elapsed = 0;
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(received_lock);
+      if (static_cast<int>(delivered.size()) == latest + 1) break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    ASSERT_LT(++msec_elapsed, db_->GetConfig().epoch_duration_ms * 1000);
+  }
+  db_->Unsubscribe(id);
+
+  std::lock_guard<std::mutex> lock(received_lock);
+  ASSERT_TRUE(in_order);
+  ASSERT_EQ(latest, delivered.back());
+}
+
+TEST_F(DatabaseTest, UnsubscribeFromCallback) {
+  std::atomic<size_t> invoked(0);
+  std::mutex id_lock;
+  size_t id = 0;
+  {
+    std::lock_guard<std::mutex> lock(id_lock);
+    id = db_->Subscribe(
+        [&](const uint32_t, const std::vector<LineairDB::Database::Change>&) {
+          std::lock_guard<std::mutex> lock(id_lock);
+          invoked++;
+          db_->Unsubscribe(id);
+        });
+  }
+  ASSERT_LT(0u, id);
+  db_->Fence();
+  db_->Fence();
+
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    tx.Write<int>("alice", 1);
+  }});
+  size_t msec_elapsed = 0;
+  while (invoked.load() == 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    ASSERT_LT(++msec_elapsed, db_->GetConfig().epoch_duration_ms * 1000);
+  }
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    tx.Write<int>("bob", 1);
+  }});
+  db_->Fence();
+  std::this_thread::sleep_for(
+      std::chrono::milliseconds(db_->GetConfig().epoch_duration_ms * 4));
+  ASSERT_EQ(1u, invoked.load());
+
+  db_.reset(nullptr);
+  config_.enable_logging = false;
+  db_ = std::make_unique<LineairDB::Database>(config_);
+  ASSERT_EQ(0u, db_->Subscribe(
+                    [](const uint32_t,
+                       const std::vector<LineairDB::Database::Change>&) {}));
+}
+
+TEST_F(DatabaseTest, Blob) {
+  const LineairDB::Config config = db_->GetConfig();
+  auto make_blob = [](size_t size, int seed) {
+    std::vector<std::byte> blob(size);
+    for (size_t i = 0; i < size; i++) {
+      blob[i] = static_cast<std::byte>((i * 31 + seed) % 251);
+    }
+    return blob;
+  };
+  auto writer = [](const std::vector<std::byte>& blob) {
+    return [&blob, offset = size_t(0)](std::byte* buffer,
+                                       const size_t capacity) mutable {
+      const size_t filled = std::min(capacity, blob.size() - offset);
+      std::memcpy(buffer, blob.data() + offset, filled);
+      offset += filled;
+      return filled;
+    };
+  };
+  auto read_blob = [](LineairDB::Transaction& tx, std::string_view key) {
+    std::vector<std::byte> blob;
+    tx.ReadBlob(key, [&](const std::byte* chunk, const size_t size) {
+      blob.insert(blob.end(), chunk, chunk + size);
+    });
+    return blob;
+  };
+
+  const auto large = make_blob(100 * 1024, 1);
+  const auto small = make_blob(1000, 2);
+  size_t large_chunks = 0;
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+                    tx.WriteBlob("document", writer(large));
+                    tx.Write<int>("alice", 1);
+                    // read-your-own-writes
+                    ASSERT_EQ(large, read_blob(tx, "document"));
+                    tx.ReadBlob("document",
+                                [&](auto, auto) { large_chunks++; });
+                  },
+                  [&](LineairDB::Transaction& tx) {
+                    ASSERT_EQ(large, read_blob(tx, "document"));
+                    ASSERT_FALSE(tx.Read<int>("document").has_value());
+                    tx.WriteBlob("document", writer(small));
+                  },
+                  [&](LineairDB::Transaction& tx) {
+                    ASSERT_EQ(small, read_blob(tx, "document"));
+                    ASSERT_EQ(0u, tx.ReadBlob("alice", [](auto, auto) {}));
+                  }});
+
+  // The second blob replaces the chunks of the first one in the write set,
+  // and the chunks left by the large blob in the slot are deleted.
+  using Outcome = LineairDB::Database::TxOutcome;
+  Outcome rewrite, reserved;
+  db_->ExecuteTransaction(
+      [&](LineairDB::Transaction& tx) {
+        tx.WriteBlob("document", writer(large));
+        tx.WriteBlob("document", writer(small));
+        ASSERT_EQ(small, read_blob(tx, "document"));
+      },
+      [&](const Outcome& outcome) { rewrite = outcome; });
+  db_->ExecuteTransaction(
+      [&](LineairDB::Transaction& tx) {
+        tx.Write<int>(std::string_view("\0bm:document", 12), 1);
+      },
+      [&](const Outcome& outcome) { reserved = outcome; });
+  db_->Fence();
+  ASSERT_EQ(LineairDB::TxStatus::Committed, rewrite.status);
+  ASSERT_LT(2u, large_chunks);
+  ASSERT_EQ(large_chunks + 1, rewrite.write_set_size);  // and the manifest
+  ASSERT_EQ(LineairDB::TxStatus::Aborted, reserved.status);
+  ASSERT_EQ(Outcome::UserAbort, reserved.abort_reason);
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    ASSERT_EQ(small, read_blob(tx, "document"));
+  }});
+
+  db_.reset(nullptr);
+  db_ = std::make_unique<LineairDB::Database>(config);
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    ASSERT_EQ(small, read_blob(tx, "document"));
+    ASSERT_EQ(1, tx.Read<int>("alice").value());
+  }});
+}
+
+TEST_F(DatabaseTest, TransactionDeadline) {
+  std::atomic<bool> executed(false);
+  std::atomic<size_t> terminated(0);
+  auto past = std::chrono::steady_clock::now() - std::chrono::seconds(1);
+  db_->ExecuteTransaction([&](LineairDB::Transaction&) { executed = true; },
+                          [&](LineairDB::TxStatus status) {
+                            ASSERT_EQ(LineairDB::TxStatus::Aborted, status);
+                            terminated++;
+                          },
+                          past);
+
+  auto future = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  db_->ExecuteTransaction(
+      [&](LineairDB::Transaction& tx) { tx.Write<int>("alice", 1); },
+      [&](LineairDB::TxStatus status) {
+        ASSERT_EQ(LineairDB::TxStatus::Committed, status);
+        terminated++;
+      },
+      future);
+  db_->Fence();
+  ASSERT_EQ(2, terminated.load());
+  ASSERT_FALSE(executed.load());
+
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    auto alice = tx.Read<int>("alice");
+    ASSERT_TRUE(alice.has_value());
+    ASSERT_EQ(1, alice.value());
+  }});
+}
+
+TEST_F(DatabaseTest, TransactionOutcome) {
+  using Outcome = LineairDB::Database::TxOutcome;
+  std::mutex outcomes_lock;
+  std::map<std::string, Outcome> outcomes;
+  auto record = [&](const std::string name) {
+    return [&, name](const Outcome& outcome) {
+      std::lock_guard<std::mutex> guard(outcomes_lock);
+      outcomes[name] = outcome;
+    };
+  };
+
+  db_->ExecuteTransaction(
+      [&](LineairDB::Transaction& tx) { tx.Write<int>("alice", 1); },
+      record("write"));
+  db_->Fence();
+  db_->ExecuteTransaction(
+      [&](LineairDB::Transaction& tx) { tx.Read<int>("alice"); },
+      record("read"));
+  db_->ExecuteTransaction(
+      [&](LineairDB::Transaction& tx) {
+        tx.Write<int>("bob", 1);
+        tx.Abort();
+      },
+      record("abort"));
+  db_->ExecuteTransaction([&](LineairDB::Transaction&) {}, record("deadline"),
+                          std::chrono::steady_clock::now() -
+                              std::chrono::seconds(1));
+  db_->Fence();
+  ASSERT_EQ(4, outcomes.size());
+
+  const auto& write = outcomes["write"];
+  ASSERT_EQ(LineairDB::TxStatus::Committed, write.status);
+  ASSERT_EQ(Outcome::NotAborted, write.abort_reason);
+  ASSERT_NE(Outcome::NotValidated, write.nwr_result);
+  ASSERT_EQ(0, write.read_set_size);
+  ASSERT_EQ(1, write.write_set_size);
+  ASSERT_NE(0, write.epoch);
+
+  const auto& read = outcomes["read"];
+  ASSERT_EQ(LineairDB::TxStatus::Committed, read.status);
+  ASSERT_EQ(Outcome::NotValidated, read.nwr_result);
+  ASSERT_EQ(1, read.read_set_size);
+  ASSERT_EQ(0, read.write_set_size);
+  ASSERT_LE(write.epoch, read.epoch);
+
+  const auto& aborted = outcomes["abort"];
+  ASSERT_EQ(LineairDB::TxStatus::Aborted, aborted.status);
+  ASSERT_EQ(Outcome::UserAbort, aborted.abort_reason);
+  ASSERT_EQ(0, aborted.epoch);
+
+  const auto& expired = outcomes["deadline"];
+  ASSERT_EQ(LineairDB::TxStatus::Aborted, expired.status);
+  ASSERT_EQ(Outcome::DeadlineExceeded, expired.abort_reason);
+}
+
+TEST_F(DatabaseTest, ResumableTransaction) {
+  std::atomic<bool> other_committed(false);
+  std::atomic<size_t> steps(0);
+  std::atomic<size_t> terminated(0);
+  std::thread resumer;
+  db_->ExecuteResumableTransaction(
+      [&](LineairDB::Transaction& tx, LineairDB::Database::ResumeType resume) {
+        if (steps++ == 0) {
+          tx.Write<int>("alice", 1);
+          // Resumed after another transaction has been committed; it needs
+          // the epoch to advance while this transaction is suspended.
+          resumer = std::thread([&, resume]() {
+            while (!other_committed.load()) { std::this_thread::yield(); }
+            resume();
+          });
+          return false;
+        }
+        auto alice = tx.Read<int>("alice");
+        EXPECT_TRUE(alice.has_value());
+        tx.Write<int>("bob", alice.value_or(0) + 1);
+        return true;
+      },
+      [&](LineairDB::TxStatus status) {
+        ASSERT_EQ(LineairDB::TxStatus::Committed, status);
+        terminated++;
+      });
+  db_->ExecuteTransaction(
+      [&](LineairDB::Transaction& tx) { tx.Write<int>("carol", 1); },
+      [&](LineairDB::TxStatus) { other_committed = true; });
+  db_->Fence();
+  resumer.join();
+  ASSERT_EQ(2, steps.load());
+  ASSERT_EQ(1, terminated.load());
+
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    auto bob = tx.Read<int>("bob");
+    ASSERT_TRUE(bob.has_value());
+    ASSERT_EQ(2, bob.value());
+  }});
+}
+
+TEST_F(DatabaseTest, TraceRecording) {
+  db_.reset(nullptr);
+  config_.enable_trace_recording = true;
+  db_ = std::make_unique<LineairDB::Database>(config_);
+
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+                    tx.Write<int>("alice", 1);
+                  },
+                  [&](LineairDB::Transaction& tx) {
+                    tx.Read<int>("alice");
+                    tx.Abort();
+                  }});
+  db_.reset(nullptr);
+
+  // Each file contains the transactions executed by a thread.
+  std::vector<std::vector<LineairDB::Trace::Event>> transactions;
+  for (auto& file : std::experimental::filesystem::directory_iterator(
+           LineairDB::Trace::TraceDirectory)) {
+    std::ifstream in(file.path(), std::ifstream::binary);
+    ASSERT_TRUE(LineairDB::Trace::ReadHeader(in));
+    LineairDB::Trace::Event event;
+    while (LineairDB::Trace::ReadEvent(in, event)) {
+      if (event.type == LineairDB::Trace::EventType::Begin) {
+        transactions.emplace_back();
+      }
+      transactions.back().push_back(event);
+    }
+  }
+  std::sort(transactions.begin(), transactions.end(),
+            [](const auto& lhs, const auto& rhs) {
+              return lhs.front().timestamp_ns < rhs.front().timestamp_ns;
+            });
+
+  using LineairDB::Trace::EventType;
+  std::vector<EventType> types;
+  for (auto& transaction : transactions) {
+    for (auto& event : transaction) { types.push_back(event.type); }
+  }
+  ASSERT_EQ(std::vector<EventType>({EventType::Begin, EventType::Write,
+                                    EventType::Commit, EventType::Begin,
+                                    EventType::Read, EventType::Abort}),
+            types);
+  ASSERT_EQ("alice", transactions[0][1].key);
+  ASSERT_EQ(sizeof(int), transactions[0][1].size);
+  ASSERT_EQ("alice", transactions[1][1].key);
+}
+
+TEST_F(DatabaseTest, BackupAndRestore) {
+  // Every transaction writes the same value into all the keys; a consistent
+  // backup never contains different values.
+  constexpr size_t keys = 64;
+  auto write_all        = [&](int value) {
+    return [&, value](LineairDB::Transaction& tx) {
+      for (size_t i = 0; i < keys; i++) {
+        tx.Write<int>(std::to_string(i), value);
+      }
+      tx.Write<int>("session", value, std::chrono::seconds(2));
+    };
+  };
+  DoTransactions({write_all(0)});
+
+  std::atomic<bool> finished(false);
+  std::atomic<int> last_submitted(0);
+  std::thread writer([&]() {
+    for (int value = 1; !finished.load(); value++) {
+      db_->ExecuteTransaction(write_all(value), [](LineairDB::TxStatus) {});
+      last_submitted = value;
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  });
+  std::stringstream backup;
+  ASSERT_NE(0u, db_->Backup(backup, 64 * 1024));
+  finished = true;
+  writer.join();
+  db_->Fence();
+
+  db_.reset(nullptr);
+  std::experimental::filesystem::remove_all("lineairdb_logs");
+  db_ = std::make_unique<LineairDB::Database>(config_);
+  ASSERT_TRUE(db_->Restore(backup));
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    auto first = tx.Read<int>("0");
+    ASSERT_TRUE(first.has_value());
+    ASSERT_LE(first.value(), last_submitted.load());
+    for (size_t i = 1; i < keys; i++) {
+      auto value = tx.Read<int>(std::to_string(i));
+      ASSERT_TRUE(value.has_value());
+      ASSERT_EQ(first.value(), value.value());
+    }
+    ASSERT_EQ(first.value(), tx.Read<int>("session").value());
+  }});
+  // The expiration time is restored as well.
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    ASSERT_FALSE(tx.Read<int>("session").has_value());
+  }});
+
+  // A truncated backup is rejected.
+  std::stringstream truncated(backup.str().substr(0, backup.str().size() - 1));
+  ASSERT_FALSE(db_->Restore(truncated));
+
+  // Backups fail without logging.
+  db_.reset(nullptr);
+  config_.enable_logging = false;
+  db_ = std::make_unique<LineairDB::Database>(config_);
+  std::stringstream unlogged;
+  ASSERT_EQ(0u, db_->Backup(unlogged));
+  ASSERT_FALSE(db_->Restore(unlogged));
+}
@@ -274,3 +274,72 @@ TEST_P(ConcurrencyControlTest, AvoidingReadOnlyAnomaly) {
     }
   }
 }
+
+TEST_P(ConcurrencyControlTest, IncrementFromAbsentKey) {
+  TransactionProcedure increment([](LineairDB::Transaction& tx) {
+    auto alice        = tx.Read<int>("alice");
+    int current_value = alice.has_value() ? alice.value() : 0;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    current_value++;
+    tx.Write<int>("alice", current_value);
+  });
+
+  size_t committed_count =
+      DoTransactionsOnMultiThreads({increment, increment, increment});
+  db_->Fence();
+
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    auto alice = tx.Read<int>("alice");
+    ASSERT_TRUE(alice.has_value());
+    ASSERT_EQ(committed_count, static_cast<size_t>(alice.value()));
+  }});
+}
+
+TEST_P(ConcurrencyControlTest, AvoidingWriteSkewAnomalyOnAbsentKeys) {
+  TransactionProcedure readAliceWriteBob([](LineairDB::Transaction& tx) {
+    auto alice = tx.Read<int>("alice");
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if (!alice.has_value()) tx.Write<int>("bob", 1);
+  });
+  TransactionProcedure readBobWriteAlice([](LineairDB::Transaction& tx) {
+    auto bob = tx.Read<int>("bob");
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if (!bob.has_value()) tx.Write<int>("alice", 1);
+  });
+
+  DoTransactionsOnMultiThreads({readAliceWriteBob, readBobWriteAlice});
+  db_->Fence();
+
+  // Either alice or bob may be inserted, but not both.
+  DoTransactions({[](LineairDB::Transaction& tx) {
+    auto alice = tx.Read<int>("alice");
+    auto bob   = tx.Read<int>("bob");
+    ASSERT_FALSE(alice.has_value() && bob.has_value());
+  }});
+}
+
+TEST_P(ConcurrencyControlTest, IncrementWithNoWaitReads) {
+  db_.reset(nullptr);
+  config_.enable_no_wait_reads = true;
+  db_ = std::make_unique<LineairDB::Database>(config_);
+
+  int initial_value = 1;
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    tx.Write<int>("alice", initial_value);
+  }});
+
+  TransactionProcedure increment([](LineairDB::Transaction& tx) {
+    auto alice = tx.Read<int>("alice");
+    ASSERT_TRUE(alice.has_value());
+    tx.Write<int>("alice", alice.value() + 1);
+  });
+  std::vector<TransactionProcedure> increments(16, increment);
+  size_t committed_count = DoTransactionsOnMultiThreads(increments);
+  db_->Fence();
+
+  DoTransactions({[&](LineairDB::Transaction& tx) {
+    auto alice = tx.Read<int>("alice");
+    ASSERT_TRUE(alice.has_value());
+    ASSERT_EQ(initial_value + committed_count, alice.value());
+  }});
+}
@@ -16,10 +16,19 @@
 
 #include "index/concurrent_table.h"
 
+#include <cstdlib>
+#include <memory>
+#include <numeric>
+#include <set>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "types.h"
+#include "util/hash.h"
+#include "util/memory_placement.h"
+#include "util/shared_arena.h"
 
 TEST(ConcurrentTableTest, Instantiate) {
   ASSERT_NO_THROW(LineairDB::Index::ConcurrentTable table);
@@ -43,6 +52,24 @@ TEST(ConcurrentTableTest, GetOrInsert) {
   ASSERT_NE(nullptr, table.GetOrInsert("alice"));
 }
 
+TEST(ConcurrentTableTest, CarriedHashValues) {
+  // The hash values are persisted in the logs and thus must not change.
+  ASSERT_EQ(0x93228a4de0eec5a2ull, LineairDB::Util::HashKey(""));
+  ASSERT_EQ(0xab15353749e48e28ull, LineairDB::Util::HashKey("alice"));
+  ASSERT_EQ(0xf02ca995a33c7552ull,
+            LineairDB::Util::HashKey(
+                "a key longer than forty-eight bytes, to cover the loop"));
+
+  LineairDB::Index::ConcurrentTable table;
+  auto* item = table.GetOrInsert("alice", LineairDB::Util::HashKey("alice"));
+  ASSERT_EQ(item, table.Get("alice"));
+  ASSERT_EQ(item, table.Get("alice", LineairDB::Util::HashKey("alice")));
+  for (size_t i = 0; i < 10000; i++) {  // rehashing reuses the hash values
+    table.Put(std::to_string(i), new LineairDB::DataItem);
+  }
+  ASSERT_EQ(item, table.GetOrInsert("alice"));
+}
+
 TEST(ConcurrentTableTest, ConcurrentInserting) {
   std::vector<std::thread> threads;
   std::vector<LineairDB::DataItem*> items;
@@ -111,3 +138,289 @@ TEST(ConcurrentTableTest, TremendousGetAndPut) {
   }
   for (auto& thread : threads) { thread.join(); }
 }
+
+TEST(ConcurrentTableTest, ParallelScanWithConcurrentInserting) {
+  LineairDB::Index::ConcurrentTable table;
+  constexpr size_t working_set_size = 8192;
+  for (size_t i = 0; i < working_set_size; i++) {
+    table.Put(std::to_string(i), new LineairDB::DataItem);
+  }
+
+  // Inserting keys triggers rehashing during the scan.
+  std::thread inserter([&]() {
+    for (size_t i = working_set_size; i < 4 * working_set_size; i++) {
+      table.Put(std::to_string(i), new LineairDB::DataItem);
+    }
+  });
+
+  std::vector<std::atomic<size_t>> visited(4 * working_set_size);
+  table.ForEachInParallel(
+      [&](const std::string_view key, const LineairDB::DataItem*) {
+        visited[std::stoul(std::string(key))]++;
+      },
+      4);
+  inserter.join();
+
+  for (size_t i = 0; i < working_set_size; i++) {
+    ASSERT_EQ(1u, visited[i].load());
+  }
+  for (size_t i = working_set_size; i < 4 * working_set_size; i++) {
+    ASSERT_GE(1u, visited[i].load());
+  }
+}
+
+TEST(ConcurrentTableTest, Erase) {
+  LineairDB::Index::ConcurrentTable table;
+  const size_t hash = LineairDB::Util::HashKey("alice");
+  auto* alice       = table.GetOrInsert("alice", hash);
+  LineairDB::DataItem other;
+  ASSERT_FALSE(table.Erase("alice", hash, &other));
+  ASSERT_FALSE(table.Erase("bob", LineairDB::Util::HashKey("bob"), alice));
+  ASSERT_TRUE(table.Erase("alice", hash, alice));
+  ASSERT_EQ(nullptr, table.Get("alice", hash));
+  ASSERT_FALSE(table.Erase("alice", hash, alice));
+
+  // Erased keys can be inserted again, and rehashing drops their tombstones
+  // instead of growing the table.
+  constexpr size_t working_set_size = 8192;
+  for (size_t i = 0; i < 16 * working_set_size; i++) {
+    const auto key = std::to_string(i % working_set_size);
+    auto* item     = table.GetOrInsert(key);
+    ASSERT_EQ(item, table.Get(key));
+    if (i < 15 * working_set_size) {
+      ASSERT_TRUE(table.Erase(key, LineairDB::Util::HashKey(key), item));
+    }
+  }
+  auto* new_alice = table.GetOrInsert("alice", hash);
+  ASSERT_NE(nullptr, new_alice);
+  ASSERT_EQ(new_alice, table.Get("alice", hash));
+  table.ReclaimErased();
+
+  size_t visited = 0;
+  table.ForEachInParallel(
+      [&](const std::string_view, const LineairDB::DataItem*) { visited++; },
+      1);
+  ASSERT_EQ(working_set_size + 1, visited);
+}
+
+TEST(ConcurrentTableTest, InlineDataItems) {
+  LineairDB::Config config;
+  config.concurrent_point_index =
+      LineairDB::Config::ConcurrentPointIndex::MPMCInlineConcurrentHashSet;
+  LineairDB::Index::ConcurrentTable table(config);
+  constexpr size_t working_set_size = 8192;
+
+  int value = 1;
+  ASSERT_TRUE(table.Put(
+      "alice", new LineairDB::DataItem(reinterpret_cast<std::byte*>(&value),
+                                       sizeof(int))));
+  ASSERT_FALSE(table.Put("alice", new LineairDB::DataItem));
+  auto* alice = table.Get("alice");
+  ASSERT_NE(nullptr, alice);
+  ASSERT_EQ(value, *reinterpret_cast<int*>(alice->value));
+
+  // Embedded items never move, even when the table is rehashed.
+  for (size_t i = 0; i < working_set_size; i++) {
+    ASSERT_NE(nullptr, table.GetOrInsert(std::to_string(i)));
+  }
+  ASSERT_EQ(alice, table.Get("alice"));
+  ASSERT_EQ(table.GetOrInsert("0"), table.Get("0"));
+}
+
+TEST(ConcurrentTableTest, SharedArena) {
+  const std::string name = "/lineairdb_shared_arena_test";
+  LineairDB::Util::SharedArena::Unlink(name);
+  LineairDB::Util::SharedArena arena(name, 1024 * 1024);
+  LineairDB::Util::SharedArena mapped(name, 0);  // the size is kept
+  ASSERT_TRUE(arena.HasCreated());
+  ASSERT_FALSE(mapped.HasCreated());
+  ASSERT_EQ(arena.Size(), mapped.Size());
+  ASSERT_EQ(2u, arena.Attachments());
+
+  // Offsets refer the same object in any mapping.
+  auto* p = static_cast<int*>(arena.Allocate(sizeof(int)));
+  *p      = 42;
+  ASSERT_EQ(0u, arena.OffsetOf(p) % 64);
+  ASSERT_NE(static_cast<void*>(p), mapped.At<int>(arena.OffsetOf(p)));
+  ASSERT_EQ(42, *mapped.At<int>(arena.OffsetOf(p)));
+  ASSERT_EQ(nullptr, mapped.At<int>(arena.OffsetOf(nullptr)));
+
+  // Freed blocks are reused by any mapping.
+  mapped.Deallocate(mapped.At<int>(arena.OffsetOf(p)), sizeof(int));
+  ASSERT_EQ(p, arena.Allocate(sizeof(int)));
+  ASSERT_TRUE(LineairDB::Util::SharedArena::Unlink(name));
+}
+
+TEST(ConcurrentTableTest, SharedMemorySegment) {
+  LineairDB::Config config;
+  config.shared_memory_segment = "/lineairdb_concurrent_table_test";
+  config.shared_memory_size    = 64 * 1024 * 1024;
+  LineairDB::Util::SharedArena::Unlink(config.shared_memory_segment);
+  constexpr size_t working_set_size = 8192;
+
+  auto table = std::make_unique<LineairDB::Index::ConcurrentTable>(config);
+  int value  = 1;
+  ASSERT_TRUE(table->Put(
+      "alice", new LineairDB::DataItem(reinterpret_cast<std::byte*>(&value),
+                                       sizeof(int))));
+  for (size_t i = 0; i < working_set_size; i++) {  // rehashes the table
+    ASSERT_NE(nullptr, table->GetOrInsert(std::to_string(i)));
+  }
+
+  std::vector<uint64_t> record_ids;
+  for (size_t i = 0; i < working_set_size; i++) {
+    record_ids.push_back(table->Get(std::to_string(i))->record_id);
+  }
+  const size_t hash = LineairDB::Util::HashKey("alice");
+  ASSERT_TRUE(table->Erase("alice", hash, table->Get("alice", hash)));
+  table->ReclaimErased();
+
+  // Only one instance attaches the segment at a time.
+  ASSERT_EXIT(LineairDB::Index::ConcurrentTable{config},
+              ::testing::ExitedWithCode(EXIT_FAILURE), "");
+
+  // The entries outlive the instance, and the next one continues the record
+  // ids.
+  table.reset(nullptr);
+  table = std::make_unique<LineairDB::Index::ConcurrentTable>(config);
+  ASSERT_EQ(nullptr, table->Get("alice", hash));
+  const uint64_t bob = table->GetOrInsert("bob")->record_id;
+  for (size_t i = 0; i < working_set_size; i++) {
+    ASSERT_EQ(record_ids[i], table->Get(std::to_string(i))->record_id);
+    ASSERT_LT(record_ids[i], bob);
+  }
+  ASSERT_TRUE(LineairDB::Util::SharedArena::Unlink(
+      config.shared_memory_segment));
+}
+
+TEST(ConcurrentTableTest, SharedMemorySegmentLeftByCrash) {
+  LineairDB::Config config;
+  config.shared_memory_segment = "/lineairdb_concurrent_table_test";
+  config.shared_memory_size    = 64 * 1024 * 1024;
+  config.enable_recovery       = false;  // the earlier logs are removed
+  LineairDB::Util::SharedArena::Unlink(config.shared_memory_segment);
+  int value = 1;
+  {
+    LineairDB::Index::ConcurrentTable table(config);
+    table.GetOrInsert("alice")->Reset(reinterpret_cast<std::byte*>(&value),
+                                      sizeof(int));
+    table.GetOrInsert("bob")->Reset(reinterpret_cast<std::byte*>(&value),
+                                    sizeof(int));
+    table.Get("alice")->transaction_id.store(2);
+    table.Get("alice")->key_logged_epoch.store(1);
+  }
+
+  // A process crashes while holding the lock of alice and installing the
+  // value of bob.
+  ASSERT_EXIT(
+      {
+        LineairDB::Index::ConcurrentTable table(config);
+        table.Get("alice")->transaction_id.store(3);
+        auto* bob = table.Get("bob");
+        bob->transaction_id.store(1);
+        bob->install_counter.store(1);
+        std::_Exit(EXIT_SUCCESS);
+      },
+      ::testing::ExitedWithCode(EXIT_SUCCESS), "");
+
+  LineairDB::Index::ConcurrentTable table(config);
+  auto* alice = table.Get("alice");
+  ASSERT_EQ(2u, alice->transaction_id.load());
+  ASSERT_EQ(value, *reinterpret_cast<int*>(alice->value));
+  ASSERT_EQ(LineairDB::DataItem::KeyIsNotLogged, alice->key_logged_epoch);
+  auto* bob = table.Get("bob");
+  size_t size;
+  std::byte buffer[sizeof(int)];
+  ASSERT_EQ(2u, bob->CopyStableVersion(buffer, size));  // the value is lost
+  ASSERT_EQ(0u, size);
+  ASSERT_NE(nullptr, table.GetOrInsert("carol"));
+  ASSERT_TRUE(LineairDB::Util::SharedArena::Unlink(
+      config.shared_memory_segment));
+}
+
+TEST(ConcurrentTableTest, HugePagePlacement) {
+  LineairDB::Config config;
+  config.enable_huge_pages = true;
+
+  constexpr size_t working_set_size = 8192;
+  {
+    LineairDB::Index::ConcurrentTable table(config);
+    for (size_t i = 0; i < working_set_size; i++) {
+      auto* item = table.GetOrInsert(std::to_string(i));
+      ASSERT_TRUE(LineairDB::Util::IsPlacedOnHugePages(item));
+      item->Reset(reinterpret_cast<std::byte*>(&i), sizeof(size_t));
+    }
+    for (size_t i = 0; i < working_set_size; i++) {
+      auto* item = table.Get(std::to_string(i));
+      ASSERT_EQ(i, *reinterpret_cast<size_t*>(item->value));
+    }
+  }
+
+  // The placement is per instance; records placed on huge pages are released
+  // by delete as well as the others.
+  LineairDB::Index::ConcurrentTable placed_table(config);
+  LineairDB::Index::ConcurrentTable table;
+  auto* placed = placed_table.GetOrInsert("alice");
+  auto* item   = table.GetOrInsert("alice");
+  ASSERT_TRUE(LineairDB::Util::IsPlacedOnHugePages(placed));
+  ASSERT_FALSE(LineairDB::Util::IsPlacedOnHugePages(item));
+  auto* released = new (LineairDB::Util::Placement::HugePages)
+      LineairDB::DataItem;
+  ASSERT_TRUE(LineairDB::Util::IsPlacedOnHugePages(released));
+  delete released;
+
+  using Allocator = LineairDB::Util::HugePageAllocator<uint64_t>;
+  std::vector<uint64_t, Allocator> buckets(
+      LineairDB::Util::HugePageSize / sizeof(uint64_t), Allocator(true));
+  for (auto& bucket : buckets) { bucket = 1; }
+  ASSERT_EQ(buckets.size(), std::accumulate(buckets.begin(), buckets.end(),
+                                            static_cast<size_t>(0)));
+}
+
+TEST(ConcurrentTableTest, HugePageSlabAcrossThreads) {
+  constexpr auto huge_pages = LineairDB::Util::Placement::HugePages;
+  constexpr size_t thread_count = 4;
+  constexpr size_t item_count   = 1000;
+
+  // Each thread frees the items of another one, and then allocates again.
+  std::vector<std::vector<LineairDB::DataItem*>> items(thread_count);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < thread_count; i++) {
+    threads.emplace_back([&, i]() {
+      for (size_t j = 0; j < item_count; j++) {
+        items[i].emplace_back(new (huge_pages) LineairDB::DataItem);
+      }
+    });
+  }
+  for (auto& thread : threads) { thread.join(); }
+  threads.clear();
+  for (size_t i = 0; i < thread_count; i++) {
+    threads.emplace_back([&, i]() {
+      auto& others = items[(i + 1) % thread_count];
+      for (auto* item : others) { delete item; }
+      others.clear();
+    });
+  }
+  for (auto& thread : threads) { thread.join(); }
+  threads.clear();
+  for (size_t i = 0; i < thread_count; i++) {
+    threads.emplace_back([&, i]() {
+      for (size_t j = 0; j < item_count; j++) {
+        items[i].emplace_back(new (huge_pages) LineairDB::DataItem);
+      }
+    });
+  }
+  for (auto& thread : threads) { thread.join(); }
+
+  std::set<LineairDB::DataItem*> distinct;
+  for (auto& allocated : items) {
+    for (auto* item : allocated) {
+      ASSERT_TRUE(LineairDB::Util::IsPlacedOnHugePages(item));
+      distinct.insert(item);
+    }
+  }
+  ASSERT_EQ(thread_count * item_count, distinct.size());
+  for (auto& allocated : items) {
+    for (auto* item : allocated) { delete item; }
+  }
+}
@@ -16,9 +16,12 @@
 
 #include "thread_pool/thread_pool.h"
 
+#include <atomic>
+#include <chrono>
 #include <mutex>
 #include <set>
 #include <thread>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -99,3 +102,87 @@ TEST(ThreadPoolTest, EnqueueForAllThreads) {
 
   Blocking(num_of_running_txns);
 }
+
+TEST(ThreadPoolTest, NotifyAllThreads) {
+  LineairDB::ThreadPool thread_pool(10);
+  std::atomic<size_t> num_of_notified_threads(10);
+
+  thread_pool.SetNotificationHandler([&]() {
+    thread_local bool im_already_notified = false;
+    if (im_already_notified == false) {
+      im_already_notified = true;
+      num_of_notified_threads--;
+    }
+  });
+  thread_pool.NotifyAllThreads();
+
+  Blocking(num_of_notified_threads);
+  thread_pool.StopAcceptingTransactions();
+  thread_pool.Shutdown();
+}
+
+TEST(ThreadPoolTest, EarliestDeadlineFirst) {
+  LineairDB::ThreadPool thread_pool(1);
+  std::atomic<bool> started(false);
+  std::atomic<bool> released(false);
+  std::mutex order_lock;
+  std::vector<size_t> order;
+  std::atomic<size_t> num_of_running_txns(4);
+
+  thread_pool.Enqueue([&]() {
+    started = true;
+    while (!released) { std::this_thread::yield(); }
+  });
+  while (!started) { std::this_thread::yield(); }
+
+  auto now    = std::chrono::steady_clock::now();
+  auto record = [&](size_t id) {
+    return [&, id]() {
+      std::lock_guard<std::mutex> lock(order_lock);
+      order.push_back(id);
+      num_of_running_txns--;
+    };
+  };
+  thread_pool.Enqueue(record(0));
+  thread_pool.Enqueue(record(3), now + std::chrono::seconds(3));
+  thread_pool.Enqueue(record(1), now + std::chrono::seconds(1));
+  thread_pool.Enqueue(record(2), now + std::chrono::seconds(2));
+  released = true;
+
+  Blocking(num_of_running_txns);
+  ASSERT_EQ(std::vector<size_t>({1, 2, 3, 0}), order);
+}
+
+TEST(ThreadPoolTest, DeadlineJobsDoNotStarveFIFOJobs) {
+  constexpr size_t bound = LineairDB::ThreadPool::MaxConsecutiveDeadlineJobs;
+  LineairDB::ThreadPool thread_pool(1);
+  std::atomic<bool> started(false);
+  std::atomic<bool> released(false);
+  std::mutex order_lock;
+  std::vector<size_t> order;
+  std::atomic<size_t> num_of_running_txns(2 * bound + 1);
+
+  thread_pool.Enqueue([&]() {
+    started = true;
+    while (!released) { std::this_thread::yield(); }
+  });
+  while (!started) { std::this_thread::yield(); }
+
+  auto now    = std::chrono::steady_clock::now();
+  auto record = [&](size_t id) {
+    return [&, id]() {
+      std::lock_guard<std::mutex> lock(order_lock);
+      order.push_back(id);
+      num_of_running_txns--;
+    };
+  };
+  thread_pool.Enqueue(record(0));
+  for (size_t id = 1; id <= 2 * bound; id++) {
+    thread_pool.Enqueue(record(id), now + std::chrono::seconds(id));
+  }
+  released = true;
+
+  Blocking(num_of_running_txns);
+  ASSERT_EQ(2 * bound + 1, order.size());
+  ASSERT_EQ(0u, order[bound]);
+}